@@ -17,6 +17,7 @@
 #include "nr-mac-header-vs.h"
 #include "nr-mac-pdu-info.h"
 #include "nr-mac-sched-sap.h"
+#include "nr-mac-scheduler-l4s-policy.h"
 #include "nr-mac-scheduler.h"
 #include "nr-mac-short-bsr-ce.h"
 #include "nr-phy-mac-common.h"
@@ -1115,7 +1116,17 @@ NrGnbMac::DoReportBufferStatus(NrMacSapProvider::ReportBufferStatusParameters pa
                 << params.txQueueSize << ", Transmission Queue HOL Delay=" << params.txQueueHolDelay
                 << ", Retransmission Queue Size=" << params.retxQueueSize
                 << ", Retransmission Queue HOL delay=" << params.retxQueueHolDelay
-                << ", PDU Size=" << params.statusPduSize);
+                << ", PDU Size=" << params.statusPduSize << ", L4S Queue Size="
+                << params.l4sTxQueueSize << ", L4S Queue HOL Delay=" << params.l4sTxQueueHolDelay
+                << ", Classic Queue Size=" << params.classicTxQueueSize
+                << ", Classic Queue HOL Delay=" << params.classicTxQueueHolDelay);
+
+    // The per-class sizes and delays only reach an L4S policy aggregated to the MAC
+    Ptr<NrMacSchedulerL4sPolicy> l4sPolicy = GetObject<NrMacSchedulerL4sPolicy>();
+    if (l4sPolicy)
+    {
+        l4sPolicy->ReportBufferStatus(params);
+    }
 
     m_macSchedSapProvider->SchedDlRlcBufferReq(schedParams);
 }
@@ -1499,6 +1510,12 @@ NrGnbMac::DoRemoveUe(uint16_t rnti)
     m_miDlHarqProcessesPackets.erase(rnti);
     m_rlcAttached.erase(rnti);
 
+    Ptr<NrMacSchedulerL4sPolicy> l4sPolicy = GetObject<NrMacSchedulerL4sPolicy>();
+    if (l4sPolicy)
+    {
+        l4sPolicy->RemoveUe(rnti);
+    }
+
     // remove unprocessed preamble received for RACH during handover
     auto jt = m_allocatedNcRaPreambleMap.begin();
     while (jt != m_allocatedNcRaPreambleMap.end())
@@ -1581,6 +1598,12 @@ NrGnbMac::DoReleaseLc(uint16_t rnti, uint8_t lcid)
         m_rlcAttached.find(rnti);
     rntiIt->second.erase(lcid);
 
+    Ptr<NrMacSchedulerL4sPolicy> l4sPolicy = GetObject<NrMacSchedulerL4sPolicy>();
+    if (l4sPolicy)
+    {
+        l4sPolicy->RemoveLc(rnti, lcid);
+    }
+
     struct NrMacCschedSapProvider::CschedLcReleaseReqParameters params;
     params.m_rnti = rnti;
     params.m_logicalChannelIdentity.push_back(lcid);
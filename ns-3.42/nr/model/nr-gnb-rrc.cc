@@ -431,11 +431,11 @@ NrUeManager::SetupDataRadioBearer(NrEpsBearer bearer,
     rlc->SetPacketDelayBudgetMs(bearer.GetPacketDelayBudgetMs());
     
     drbInfo->m_rlc = rlc;
-    
-    if(rlcTypeId == NrRlcUm::GetTypeId()){
-        NS_LOG_INFO("Setting GNB Association for RLC UM " << std::to_string(reinterpret_cast<uintptr_t>(this)));
-        rlc->SetGnbAssociation();
-    }
+
+    // Any RLC created here lives at the gNB, whatever its type
+    NS_LOG_INFO("Setting GNB Association for " << rlcTypeId.GetName() << " "
+                                               << std::to_string(reinterpret_cast<uintptr_t>(this)));
+    rlc->SetGnbAssociation();
 
     rlc->SetLcId(lcid);
 
@@ -1924,6 +1924,13 @@ NrGnbRrc::GetTypeId()
                                 "RlcAmAlways",
                                 PER_BASED,
                                 "PacketErrorRateBased"))
+            .AddAttribute("UmRlcType",
+                          "The RLC type used for the EPS bearers mapped to RLC UM by "
+                          "EpsBearerToRlcMapping, e.g. ns3::NrRlcUm or ns3::NrRlcUmDualpi2. "
+                          "It must be a subclass of ns3::NrRlc.",
+                          TypeIdValue(NrRlcUm::GetTypeId()),
+                          MakeTypeIdAccessor(&NrGnbRrc::SetUmRlcType, &NrGnbRrc::GetUmRlcType),
+                          MakeTypeIdChecker())
             .AddAttribute("SystemInformationPeriodicity",
                           "The interval for sending system information (Time value)",
                           TimeValue(MilliSeconds(80)),
@@ -3205,8 +3212,7 @@ NrGnbRrc::GetRlcType(NrEpsBearer bearer)
         return NrRlcSm::GetTypeId();
 
     case RLC_UM_ALWAYS:
-        return NrRlcUm::GetTypeId(); // change to NrLrcUm to disable dualPi2
-        // return NrRlcUmDualpi2::GetTypeId(); // change to NrLrcUm to disable dualPi2
+        return m_umRlcType;
 
     case RLC_AM_ALWAYS:
         return NrRlcAm::GetTypeId();
@@ -3214,8 +3220,7 @@ NrGnbRrc::GetRlcType(NrEpsBearer bearer)
     case PER_BASED:
         if (bearer.GetPacketErrorLossRate() > 1.0e-5)
         {
-            return NrRlcUm::GetTypeId(); // change to NrLrcUm to disable dualPi2
-            // return NrRlcUmDualpi2::GetTypeId(); // change to NrLrcUm to disable dualPi2
+            return m_umRlcType;
         }
         else
         {
@@ -3303,6 +3308,25 @@ NrGnbRrc::GetSrsPeriodicity() const
     return g_srsPeriodicity[m_srsCurrentPeriodicityId];
 }
 
+void
+NrGnbRrc::SetUmRlcType(TypeId type)
+{
+    NS_LOG_FUNCTION(this << type);
+    if (!type.IsChildOf(NrRlc::GetTypeId()))
+    {
+        NS_FATAL_ERROR("illecit UM RLC type " << type.GetName() << ". It must be a subclass of "
+                                              << NrRlc::GetTypeId().GetName());
+    }
+    m_umRlcType = type;
+}
+
+TypeId
+NrGnbRrc::GetUmRlcType() const
+{
+    NS_LOG_FUNCTION(this);
+    return m_umRlcType;
+}
+
 uint16_t
 NrGnbRrc::GetNewSrsConfigurationIndex()
 {
@@ -1405,6 +1405,19 @@ class NrGnbRrc : public Object
      */
     uint32_t GetSrsPeriodicity() const;
 
+    /**
+     * \brief Set the RLC type used for the bearers mapped to RLC UM
+     *
+     * \param type the TypeId of an NrRlc subclass, e.g. NrRlcUm or NrRlcUmDualpi2
+     */
+    void SetUmRlcType(TypeId type);
+
+    /**
+     *
+     * \return the RLC type used for the bearers mapped to RLC UM
+     */
+    TypeId GetUmRlcType() const;
+
     /**
      * \brief Associate this RRC entity with a particular CSG information.
      * \param csgId the intended Closed Subscriber Group identity
@@ -1576,6 +1589,11 @@ class NrGnbRrc : public Object
      * used for each type of EPS bearer.
      */
     NrEpsBearerToRlcMapping_t m_epsBearerToRlcMapping;
+    /**
+     * The `UmRlcType` attribute. The RLC type used for the EPS bearers mapped
+     * to RLC UM by the `EpsBearerToRlcMapping` attribute.
+     */
+    TypeId m_umRlcType;
     /**
      * The `SystemInformationPeriodicity` attribute. The interval for sending
      * system information.
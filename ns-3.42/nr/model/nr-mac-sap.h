@@ -62,6 +62,14 @@ class NrMacSapProvider
         uint16_t retxQueueHolDelay; /**<  the Head Of Line delay of the retransmission queue */
         uint16_t
             statusPduSize; /**< the current size of the pending STATUS RLC  PDU message in bytes */
+        /// the part of txQueueSize held by the L4S queue of a DualQ AQM, zero without one
+        uint32_t l4sTxQueueSize{0};
+        /// the Head Of Line delay of the L4S queue of a DualQ AQM
+        uint16_t l4sTxQueueHolDelay{0};
+        /// the rest of txQueueSize, held by the other queues of a DualQ AQM, zero without one
+        uint32_t classicTxQueueSize{0};
+        /// the Head Of Line delay of the other queues of a DualQ AQM
+        uint16_t classicTxQueueHolDelay{0};
     };
 
     /**
@@ -0,0 +1,97 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nr-mac-scheduler-l4s-policy.h"
+
+#include "ns3/log.h"
+
+#include <algorithm>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("NrMacSchedulerL4sPolicy");
+
+NS_OBJECT_ENSURE_REGISTERED(NrMacSchedulerL4sPolicy);
+
+TypeId
+NrMacSchedulerL4sPolicy::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::NrMacSchedulerL4sPolicy")
+            .SetParent<Object>()
+            .SetGroupName("Nr")
+            .AddConstructor<NrMacSchedulerL4sPolicy>()
+            .AddAttribute("DelayBudget",
+                          "Delay budget of the L4S packets",
+                          TimeValue(MilliSeconds(5)),
+                          MakeTimeAccessor(&NrMacSchedulerL4sPolicy::m_delayBudget),
+                          MakeTimeChecker(MilliSeconds(1)));
+    return tid;
+}
+
+NrMacSchedulerL4sPolicy::NrMacSchedulerL4sPolicy()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+NrMacSchedulerL4sPolicy::~NrMacSchedulerL4sPolicy()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+void
+NrMacSchedulerL4sPolicy::ReportBufferStatus(
+    const NrMacSapProvider::ReportBufferStatusParameters& params)
+{
+    NS_LOG_FUNCTION(this << params.rnti << +params.lcid << params.l4sTxQueueSize
+                         << params.l4sTxQueueHolDelay);
+    m_reports[{params.rnti, params.lcid}] = params;
+}
+
+void
+NrMacSchedulerL4sPolicy::RemoveUe(uint16_t rnti)
+{
+    NS_LOG_FUNCTION(this << rnti);
+    m_reports.erase(m_reports.lower_bound({rnti, 0}), m_reports.upper_bound({rnti, 0xff}));
+}
+
+void
+NrMacSchedulerL4sPolicy::RemoveLc(uint16_t rnti, uint8_t lcid)
+{
+    NS_LOG_FUNCTION(this << rnti << +lcid);
+    m_reports.erase({rnti, lcid});
+}
+
+double
+NrMacSchedulerL4sPolicy::GetWeight(
+    const NrMacSapProvider::ReportBufferStatusParameters& params) const
+{
+    if (params.l4sTxQueueSize == 0)
+    {
+        return 0;
+    }
+    // The HOL delay is reported in ms
+    return 1 + params.l4sTxQueueHolDelay * 1e-3 / m_delayBudget.GetSeconds();
+}
+
+double
+NrMacSchedulerL4sPolicy::GetUeWeight(uint16_t rnti) const
+{
+    double weight = 0;
+    for (auto it = m_reports.lower_bound({rnti, 0}); it != m_reports.upper_bound({rnti, 0xff});
+         ++it)
+    {
+        weight = std::max(weight, GetWeight(it->second));
+    }
+    return weight;
+}
+
+bool
+NrMacSchedulerL4sPolicy::CompareUes(uint16_t lhs, uint16_t rhs) const
+{
+    return GetUeWeight(lhs) > GetUeWeight(rhs);
+}
+
+} // namespace ns3
@@ -0,0 +1,103 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef NR_MAC_SCHEDULER_L4S_POLICY_H
+#define NR_MAC_SCHEDULER_L4S_POLICY_H
+
+#include "nr-mac-sap.h"
+
+#include <ns3/nstime.h>
+#include <ns3/object.h>
+
+#include <map>
+#include <utility>
+
+namespace ns3
+{
+
+/**
+ * \ingroup scheduler
+ * \brief Orders the UEs of a round-robin scheduler by the delay of their L4S backlog
+ *
+ * The policy keeps the last per-class buffer status report of each logical
+ * channel, see NrMacSapProvider::ReportBufferStatusParameters, and gives
+ * each UE a weight from it. A UE without L4S backlog weighs 0. A UE with
+ * L4S backlog weighs 1 plus the L4S Head Of Line delay over DelayBudget,
+ * taking the largest over its logical channels. The weight so reaches 2
+ * when the oldest L4S packet has used up its budget.
+ *
+ * A scheduler sorting its UEs with CompareUes serves the UEs with L4S
+ * backlog first, the most urgent one first, and keeps its own (e.g.,
+ * round-robin) order among UEs of equal weight when the sort is stable.
+ * Low-latency bearers are therefore no longer scheduled behind UEs with
+ * only Classic backlog.
+ *
+ * The policy is aggregated to the NrGnbMac, e.g.
+ * gnbMac->AggregateObject(CreateObject<NrMacSchedulerL4sPolicy>()).
+ * The MAC then feeds it every buffer status report and forgets the logical
+ * channels and UEs it releases, and a scheduler finds it with
+ * GetObject<NrMacSchedulerL4sPolicy>() on the MAC.
+ */
+class NrMacSchedulerL4sPolicy : public Object
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+
+    NrMacSchedulerL4sPolicy();
+    ~NrMacSchedulerL4sPolicy() override;
+
+    /**
+     * \brief Store a buffer status report
+     * \param params the report, as sent by the RLC
+     */
+    void ReportBufferStatus(const NrMacSapProvider::ReportBufferStatusParameters& params);
+
+    /**
+     * \brief Forget the reports of a UE
+     * \param rnti the RNTI of the UE
+     */
+    void RemoveUe(uint16_t rnti);
+
+    /**
+     * \brief Forget the report of a logical channel
+     * \param rnti the RNTI of the UE
+     * \param lcid the LCID of the logical channel
+     */
+    void RemoveLc(uint16_t rnti, uint8_t lcid);
+
+    /**
+     * \param params a buffer status report
+     * \returns the weight of the logical channel of the report
+     */
+    double GetWeight(const NrMacSapProvider::ReportBufferStatusParameters& params) const;
+
+    /**
+     * \param rnti the RNTI of the UE
+     * \returns the weight of the UE, 0 if it has no report
+     */
+    double GetUeWeight(uint16_t rnti) const;
+
+    /**
+     * \brief Strict weak ordering of the UEs, for a stable sort
+     * \param lhs the RNTI of the first UE
+     * \param rhs the RNTI of the second UE
+     * \returns true if the first UE weighs more than the second one
+     */
+    bool CompareUes(uint16_t lhs, uint16_t rhs) const;
+
+  private:
+    Time m_delayBudget; //!< Delay budget of the L4S packets
+
+    /// Last report of each logical channel, by RNTI and LCID
+    std::map<std::pair<uint16_t, uint8_t>, NrMacSapProvider::ReportBufferStatusParameters>
+        m_reports;
+};
+
+} // namespace ns3
+
+#endif // NR_MAC_SCHEDULER_L4S_POLICY_H
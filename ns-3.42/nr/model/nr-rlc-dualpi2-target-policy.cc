@@ -0,0 +1,139 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nr-rlc-dualpi2-target-policy.h"
+
+#include "ns3/abort.h"
+#include "ns3/double.h"
+#include "ns3/enum.h"
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("NrRlcDualpi2TargetPolicy");
+
+NS_OBJECT_ENSURE_REGISTERED(NrRlcDualpi2TargetPolicy);
+
+/// Spectral efficiency of CQI 0 to 15, 3GPP TS 38.214 Table 5.2.2.1-2
+static const double g_cqiEfficiency64Qam[16] = {0.0,
+                                                0.1523,
+                                                0.2344,
+                                                0.3770,
+                                                0.6016,
+                                                0.8770,
+                                                1.1758,
+                                                1.4766,
+                                                1.9141,
+                                                2.4063,
+                                                2.7305,
+                                                3.3223,
+                                                3.9023,
+                                                4.5234,
+                                                5.1152,
+                                                5.5547};
+
+/// Spectral efficiency of CQI 0 to 15, 3GPP TS 38.214 Table 5.2.2.1-3
+static const double g_cqiEfficiency256Qam[16] = {0.0,
+                                                 0.1523,
+                                                 0.3770,
+                                                 0.8770,
+                                                 1.4766,
+                                                 1.9141,
+                                                 2.4063,
+                                                 2.7305,
+                                                 3.3223,
+                                                 3.9023,
+                                                 4.5234,
+                                                 5.1152,
+                                                 5.5547,
+                                                 6.2266,
+                                                 6.9141,
+                                                 7.4063};
+
+TypeId
+NrRlcDualpi2TargetPolicy::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::NrRlcDualpi2TargetPolicy")
+            .SetParent<Object>()
+            .SetGroupName("Nr")
+            .AddConstructor<NrRlcDualpi2TargetPolicy>()
+            .AddAttribute("CqiTable",
+                          "CQI table used by the UEs",
+                          EnumValue(CQI_TABLE_64QAM),
+                          MakeEnumAccessor<CqiTable>(&NrRlcDualpi2TargetPolicy::m_table),
+                          MakeEnumChecker(CQI_TABLE_64QAM,
+                                          "CQI_TABLE_64QAM",
+                                          CQI_TABLE_256QAM,
+                                          "CQI_TABLE_256QAM"))
+            .AddAttribute("ReferenceCqi",
+                          "CQI at which the configured DualQ targets apply",
+                          UintegerValue(15),
+                          MakeUintegerAccessor(&NrRlcDualpi2TargetPolicy::m_referenceCqi),
+                          MakeUintegerChecker<uint8_t>(1, 15))
+            .AddAttribute("ResourceBlocks",
+                          "Number of resource blocks of a slot",
+                          UintegerValue(106),
+                          MakeUintegerAccessor(&NrRlcDualpi2TargetPolicy::m_resourceBlocks),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("DataSymbols",
+                          "Number of OFDM symbols of a slot carrying data",
+                          UintegerValue(12),
+                          MakeUintegerAccessor(&NrRlcDualpi2TargetPolicy::m_dataSymbols),
+                          MakeUintegerChecker<uint32_t>(1, 14))
+            .AddAttribute("MinScale",
+                          "Lower bound of the scale of the targets",
+                          DoubleValue(0.25),
+                          MakeDoubleAccessor(&NrRlcDualpi2TargetPolicy::m_minScale),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("MaxScale",
+                          "Upper bound of the scale of the targets",
+                          DoubleValue(8),
+                          MakeDoubleAccessor(&NrRlcDualpi2TargetPolicy::m_maxScale),
+                          MakeDoubleChecker<double>(0));
+    return tid;
+}
+
+NrRlcDualpi2TargetPolicy::NrRlcDualpi2TargetPolicy()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+NrRlcDualpi2TargetPolicy::~NrRlcDualpi2TargetPolicy()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+double
+NrRlcDualpi2TargetPolicy::GetSpectralEfficiency(uint8_t cqi, CqiTable table)
+{
+    NS_ABORT_MSG_IF(cqi > 15, "Invalid CQI " << +cqi);
+    return (table == CQI_TABLE_256QAM) ? g_cqiEfficiency256Qam[cqi] : g_cqiEfficiency64Qam[cqi];
+}
+
+uint32_t
+NrRlcDualpi2TargetPolicy::GetSlotCapacity(uint8_t cqi) const
+{
+    // 12 subcarriers per resource block
+    double resourceElements = 12.0 * m_resourceBlocks * m_dataSymbols;
+    return static_cast<uint32_t>(GetSpectralEfficiency(cqi, m_table) * resourceElements / 8);
+}
+
+double
+NrRlcDualpi2TargetPolicy::GetTargetScale(uint8_t cqi) const
+{
+    uint32_t capacity = GetSlotCapacity(cqi);
+    double scale = capacity ? static_cast<double>(GetSlotCapacity(m_referenceCqi)) / capacity
+                            : m_maxScale;
+    scale = std::max(scale, m_minScale);
+    scale = std::min(scale, m_maxScale);
+    NS_LOG_LOGIC("CQI " << +cqi << ": " << capacity << " bytes per slot, target scale " << scale);
+    return scale;
+}
+
+} // namespace ns3
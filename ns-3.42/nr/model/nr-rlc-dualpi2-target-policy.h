@@ -0,0 +1,83 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef NR_RLC_DUALPI2_TARGET_POLICY_H
+#define NR_RLC_DUALPI2_TARGET_POLICY_H
+
+#include <ns3/object.h>
+
+#include <cstdint>
+
+namespace ns3
+{
+
+/**
+ * \ingroup nr
+ * \brief Maps the CQI of a UE to the scale of the DualQ targets of its RLC
+ *
+ * NrRlcUmDualpi2 passes each new CQI to its policy, and hands the scale it
+ * returns to DualQCoupledPiSquareQueueDisc::SetTargetScale, which
+ * multiplies the delay targets and divides the PI gains by it.
+ *
+ * The expected capacity of a slot is the spectral efficiency of the CQI
+ * (3GPP TS 38.214 Table 5.2.2.1-2, or Table 5.2.2.1-3 with 256QAM) over
+ * ResourceBlocks resource blocks of DataSymbols OFDM symbols. This policy
+ * keeps a constant byte-time target: the scale is the capacity at
+ * ReferenceCqi divided by the capacity at the reported CQI, so that the
+ * configured targets hold at ReferenceCqi and the backlog they allow stays
+ * the same in bytes as the link slows down. It is clamped to
+ * [MinScale, MaxScale]; CQI 0 (out of range) gives MaxScale.
+ *
+ * Subclasses can override GetTargetScale to implement another policy.
+ */
+class NrRlcDualpi2TargetPolicy : public Object
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+
+    NrRlcDualpi2TargetPolicy();
+    ~NrRlcDualpi2TargetPolicy() override;
+
+    /// CQI tables of 3GPP TS 38.214
+    enum CqiTable
+    {
+        CQI_TABLE_64QAM,  ///< Table 5.2.2.1-2
+        CQI_TABLE_256QAM, ///< Table 5.2.2.1-3
+    };
+
+    /**
+     * \param cqi the wideband CQI reported by the UE
+     * \returns the scale of the DualQ targets
+     */
+    virtual double GetTargetScale(uint8_t cqi) const;
+
+    /**
+     * \param cqi the wideband CQI
+     * \returns the expected number of bytes a slot carries at that CQI
+     */
+    uint32_t GetSlotCapacity(uint8_t cqi) const;
+
+    /**
+     * \param cqi the CQI (0 to 15)
+     * \param table the CQI table
+     * \returns the spectral efficiency of the CQI (bits per resource element)
+     */
+    static double GetSpectralEfficiency(uint8_t cqi, CqiTable table);
+
+  private:
+    CqiTable m_table;          ///< CQI table in use
+    uint8_t m_referenceCqi;    ///< CQI at which the configured targets apply
+    uint32_t m_resourceBlocks; ///< Resource blocks per slot
+    uint32_t m_dataSymbols;    ///< OFDM symbols carrying data per slot
+    double m_minScale;         ///< Lower bound of the scale
+    double m_maxScale;         ///< Upper bound of the scale
+};
+
+} // namespace ns3
+
+#endif // NR_RLC_DUALPI2_TARGET_POLICY_H
@@ -0,0 +1,162 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nr-rlc-metrics-reader.h"
+
+#include "ns3/abort.h"
+#include "ns3/log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("NrRlcMetricsReader");
+
+NrRlcMetricsReader::NrRlcMetricsReader()
+    : m_map(nullptr),
+      m_mapSize(0),
+      m_nRecords(0)
+{
+}
+
+NrRlcMetricsReader::~NrRlcMetricsReader()
+{
+    Close();
+}
+
+bool
+NrRlcMetricsReader::Open(const std::string& fileName)
+{
+    NS_LOG_FUNCTION(this << fileName);
+    Close();
+
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        NS_LOG_WARN("Cannot open " << fileName);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < NrRlcMetricsRing::HEADER_SIZE)
+    {
+        NS_LOG_WARN(fileName << " is too short to be an RLC metrics file");
+        close(fd);
+        return false;
+    }
+    m_mapSize = st.st_size;
+    void* map = mmap(nullptr, m_mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        NS_LOG_WARN("Cannot map " << fileName);
+        m_mapSize = 0;
+        return false;
+    }
+    m_map = static_cast<const uint8_t*>(map);
+
+    uint32_t version;
+    uint32_t nColumns;
+    std::memcpy(&version, m_map + 8, sizeof(version));
+    std::memcpy(&nColumns, m_map + 12, sizeof(nColumns));
+    if (std::memcmp(m_map, NrRlcMetricsRing::MAGIC, sizeof(NrRlcMetricsRing::MAGIC)) != 0 ||
+        version != NrRlcMetricsRing::VERSION || nColumns != NrRlcMetricsRing::N_COLUMNS)
+    {
+        NS_LOG_WARN(fileName << " is not a version " << NrRlcMetricsRing::VERSION
+                             << " RLC metrics file");
+        Close();
+        return false;
+    }
+
+    uint64_t offset = NrRlcMetricsRing::HEADER_SIZE;
+    while (offset + NrRlcMetricsRing::BLOCK_HEADER_SIZE <= m_mapSize)
+    {
+        Block block;
+        std::memcpy(&block.nRecords, m_map + offset, sizeof(block.nRecords));
+        uint64_t blockSize = NrRlcMetricsRing::GetBlockSize(block.nRecords);
+        if (offset + blockSize > m_mapSize)
+        {
+            NS_LOG_WARN(fileName << " ends with a truncated block");
+            break;
+        }
+
+        // Columns are laid out by decreasing width, so they are all aligned
+        const uint8_t* column = m_map + offset + NrRlcMetricsRing::BLOCK_HEADER_SIZE;
+        uint32_t n = block.nRecords;
+        block.timeNs = reinterpret_cast<const int64_t*>(column);
+        block.holDelayNs = block.timeNs + n;
+        block.queueBytes = reinterpret_cast<const uint32_t*>(block.holDelayNs + n);
+        block.macGrantBytes = block.queueBytes + n;
+        block.marks = block.macGrantBytes + n;
+        block.drops = block.marks + n;
+        block.rnti = reinterpret_cast<const uint16_t*>(block.drops + n);
+        block.lcid = reinterpret_cast<const uint8_t*>(block.rnti + n);
+
+        m_blocks.push_back(block);
+        m_first.push_back(m_nRecords);
+        m_nRecords += n;
+        offset += blockSize;
+    }
+    return true;
+}
+
+void
+NrRlcMetricsReader::Close()
+{
+    if (m_map)
+    {
+        munmap(const_cast<uint8_t*>(m_map), m_mapSize);
+    }
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_blocks.clear();
+    m_first.clear();
+    m_nRecords = 0;
+}
+
+uint32_t
+NrRlcMetricsReader::GetNBlocks() const
+{
+    return m_blocks.size();
+}
+
+const NrRlcMetricsReader::Block&
+NrRlcMetricsReader::GetBlock(uint32_t i) const
+{
+    NS_ABORT_MSG_IF(i >= m_blocks.size(), "Block " << i << " out of range");
+    return m_blocks[i];
+}
+
+uint64_t
+NrRlcMetricsReader::GetNRecords() const
+{
+    return m_nRecords;
+}
+
+NrRlcMetricsRecord
+NrRlcMetricsReader::GetRecord(uint64_t i) const
+{
+    NS_ABORT_MSG_IF(i >= m_nRecords, "Record " << i << " out of range");
+    auto it = std::upper_bound(m_first.begin(), m_first.end(), i) - 1;
+    const Block& block = m_blocks[it - m_first.begin()];
+    uint64_t j = i - *it;
+
+    NrRlcMetricsRecord record;
+    record.timeNs = block.timeNs[j];
+    record.holDelayNs = block.holDelayNs[j];
+    record.queueBytes = block.queueBytes[j];
+    record.macGrantBytes = block.macGrantBytes[j];
+    record.marks = block.marks[j];
+    record.drops = block.drops[j];
+    record.rnti = block.rnti[j];
+    record.lcid = block.lcid[j];
+    return record;
+}
+
+} // namespace ns3
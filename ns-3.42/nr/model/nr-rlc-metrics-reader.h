@@ -0,0 +1,90 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef NR_RLC_METRICS_READER_H
+#define NR_RLC_METRICS_READER_H
+
+#include "nr-rlc-metrics.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \ingroup nr
+ * \brief Reader of the files written by NrRlcMetricsRing
+ *
+ * The file is memory-mapped and the columns of each block are exposed in
+ * place, without copying.
+ */
+class NrRlcMetricsReader
+{
+  public:
+    /// Columns of one block of the file
+    struct Block
+    {
+        uint32_t nRecords{0};                   ///< Number of records in the block
+        const int64_t* timeNs{nullptr};         ///< Simulation time column (ns)
+        const int64_t* holDelayNs{nullptr};     ///< Head-of-line delay column (ns)
+        const uint32_t* queueBytes{nullptr};    ///< TX queue size column (bytes)
+        const uint32_t* macGrantBytes{nullptr}; ///< MAC opportunity column (bytes)
+        const uint32_t* marks{nullptr};         ///< Cumulative marks column
+        const uint32_t* drops{nullptr};         ///< Cumulative drops column
+        const uint16_t* rnti{nullptr};          ///< RNTI column
+        const uint8_t* lcid{nullptr};           ///< LCID column
+    };
+
+    NrRlcMetricsReader();
+    ~NrRlcMetricsReader();
+
+    NrRlcMetricsReader(const NrRlcMetricsReader&) = delete;
+    NrRlcMetricsReader& operator=(const NrRlcMetricsReader&) = delete;
+
+    /**
+     * \brief Map a metrics file and index its blocks
+     *
+     * \param fileName the file
+     * \returns false if the file cannot be mapped or is not a metrics file
+     */
+    bool Open(const std::string& fileName);
+
+    /// Unmap the file
+    void Close();
+
+    /**
+     * \returns the number of blocks in the file
+     */
+    uint32_t GetNBlocks() const;
+
+    /**
+     * \param i index of the block
+     * \returns the columns of the block
+     */
+    const Block& GetBlock(uint32_t i) const;
+
+    /**
+     * \returns the number of records in the file
+     */
+    uint64_t GetNRecords() const;
+
+    /**
+     * \param i index of the record in the file
+     * \returns the record, gathered from the columns of its block
+     */
+    NrRlcMetricsRecord GetRecord(uint64_t i) const;
+
+  private:
+    const uint8_t* m_map;          ///< Start of the mapping, nullptr if closed
+    uint64_t m_mapSize;            ///< Size of the mapping
+    std::vector<Block> m_blocks;   ///< Index of the blocks
+    std::vector<uint64_t> m_first; ///< Index of the first record of each block
+    uint64_t m_nRecords;           ///< Number of records in the file
+};
+
+} // namespace ns3
+
+#endif // NR_RLC_METRICS_READER_H
@@ -0,0 +1,389 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nr-rlc-metrics.h"
+
+#include "nr-rlc.h"
+
+#include "ns3/abort.h"
+#include "ns3/boolean.h"
+#include "ns3/global-value.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("NrRlcMetrics");
+
+NS_OBJECT_ENSURE_REGISTERED(NrRlcMetricsSampler);
+
+/**
+ * \ingroup nr
+ * \brief Name of the file the RLC metrics are drained to
+ */
+static GlobalValue g_nrRlcMetricsFile("NrRlcMetricsFile",
+                                      "File the RLC entities write their metric samples to",
+                                      StringValue("nr-rlc-metrics.bin"),
+                                      MakeStringChecker());
+
+const char NrRlcMetricsRing::MAGIC[8] = {'N', 'R', 'R', 'L', 'C', 'M', 'E', 'T'};
+
+namespace
+{
+
+/**
+ * Copy one field of the records [from, from + n) of the ring into a
+ * contiguous column.
+ *
+ * \param dst destination of the column
+ * \param records the ring
+ * \param from index of the first record
+ * \param n number of records
+ * \param field the field to copy
+ * \returns the first byte after the column
+ */
+template <typename T>
+uint8_t*
+WriteColumn(uint8_t* dst,
+            const std::vector<NrRlcMetricsRecord>& records,
+            uint64_t from,
+            uint32_t n,
+            T NrRlcMetricsRecord::*field)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const NrRlcMetricsRecord& record = records[(from + i) & (NrRlcMetricsRing::CAPACITY - 1)];
+        std::memcpy(dst, &(record.*field), sizeof(T));
+        dst += sizeof(T);
+    }
+    return dst;
+}
+
+/**
+ * \returns the sampler of the current simulation, or nullptr
+ */
+Ptr<NrRlcMetricsSampler>&
+GetSamplerInstance()
+{
+    static Ptr<NrRlcMetricsSampler> sampler;
+    return sampler;
+}
+
+} // namespace
+
+NrRlcMetricsRing::NrRlcMetricsRing()
+    : m_records(CAPACITY),
+      m_head(0),
+      m_tail(0),
+      m_fd(-1),
+      m_fileSize(0),
+      m_destroyScheduled(false)
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "The ring capacity must be a power of two");
+}
+
+NrRlcMetricsRing::~NrRlcMetricsRing()
+{
+    // Records pushed after Simulator::Destroy
+    Flush();
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+uint64_t
+NrRlcMetricsRing::GetBlockSize(uint32_t nRecords)
+{
+    const uint64_t recordSize = 2 * sizeof(int64_t) + 4 * sizeof(uint32_t) + sizeof(uint16_t) +
+                                sizeof(uint8_t);
+    uint64_t size = BLOCK_HEADER_SIZE + nRecords * recordSize;
+    return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+void
+NrRlcMetricsRing::Open()
+{
+    StringValue fileName;
+    g_nrRlcMetricsFile.GetValue(fileName);
+    NS_LOG_FUNCTION(this << fileName.Get());
+
+    m_fd = open(fileName.Get().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    NS_ABORT_MSG_IF(m_fd < 0, "Cannot open RLC metrics file " << fileName.Get());
+
+    uint8_t header[HEADER_SIZE];
+    uint32_t version = VERSION;
+    uint32_t nColumns = N_COLUMNS;
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    std::memcpy(header + 8, &version, sizeof(version));
+    std::memcpy(header + 12, &nColumns, sizeof(nColumns));
+    NS_ABORT_MSG_IF(write(m_fd, header, HEADER_SIZE) != static_cast<ssize_t>(HEADER_SIZE),
+                    "Cannot write the RLC metrics file header");
+    m_fileSize = HEADER_SIZE;
+}
+
+void
+NrRlcMetricsRing::Push(const NrRlcMetricsRecord& record)
+{
+    if (!m_destroyScheduled)
+    {
+        Simulator::ScheduleDestroy(&NrRlcMetricsRing::FlushOnDestroy, this);
+        m_destroyScheduled = true;
+    }
+
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == CAPACITY)
+    {
+        Flush();
+    }
+    m_records[head & (CAPACITY - 1)] = record;
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+void
+NrRlcMetricsRing::FlushOnDestroy()
+{
+    m_destroyScheduled = false;
+    Flush();
+}
+
+void
+NrRlcMetricsRing::Flush()
+{
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    if (head == tail)
+    {
+        return;
+    }
+    if (m_fd < 0)
+    {
+        Open();
+    }
+
+    auto n = static_cast<uint32_t>(head - tail);
+    uint64_t blockSize = GetBlockSize(n);
+    NS_ABORT_MSG_IF(ftruncate(m_fd, m_fileSize + blockSize) != 0,
+                    "Cannot grow the RLC metrics file");
+
+    // mmap offsets must be page aligned
+    uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t mapOffset = m_fileSize & ~(pageSize - 1);
+    uint64_t mapSize = m_fileSize - mapOffset + blockSize;
+    void* map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, mapOffset);
+    NS_ABORT_MSG_IF(map == MAP_FAILED, "Cannot map the RLC metrics file");
+
+    uint8_t* block = static_cast<uint8_t*>(map) + (m_fileSize - mapOffset);
+    uint32_t blockHeader[2] = {n, 0};
+    std::memcpy(block, blockHeader, BLOCK_HEADER_SIZE);
+
+    uint8_t* dst = block + BLOCK_HEADER_SIZE;
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::timeNs);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::holDelayNs);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::queueBytes);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::macGrantBytes);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::marks);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::drops);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::rnti);
+    dst = WriteColumn(dst, m_records, tail, n, &NrRlcMetricsRecord::lcid);
+    std::memset(dst, 0, block + blockSize - dst);
+
+    munmap(map, mapSize);
+    m_fileSize += blockSize;
+    m_tail.store(head, std::memory_order_release);
+}
+
+uint64_t
+NrRlcMetricsRing::GetNRecords() const
+{
+    return m_head.load(std::memory_order_acquire);
+}
+
+////////////////////////////////////////
+
+TypeId
+NrRlcMetricsSampler::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::NrRlcMetricsSampler")
+            .SetParent<Object>()
+            .SetGroupName("Nr")
+            .AddConstructor<NrRlcMetricsSampler>()
+            .AddAttribute("SamplingPeriod",
+                          "Interval between two rounds of sampling of the RLC entities",
+                          TimeValue(MilliSeconds(5)),
+                          MakeTimeAccessor(&NrRlcMetricsSampler::m_period),
+                          MakeTimeChecker(NanoSeconds(1)))
+            .AddAttribute("SkipIdle",
+                          "Do not sample the entities whose TX queue stays empty",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&NrRlcMetricsSampler::m_skipIdle),
+                          MakeBooleanChecker())
+            .AddAttribute("DelayDelta",
+                          "Only sample an entity when its head-of-line delay moved by at least "
+                          "this much since its last sample (0 disables the check)",
+                          TimeValue(Seconds(0)),
+                          MakeTimeAccessor(&NrRlcMetricsSampler::m_delayDelta),
+                          MakeTimeChecker(Seconds(0)))
+            .AddAttribute("BacklogDelta",
+                          "Only sample an entity when its queue size moved by at least "
+                          "this many bytes since its last sample (0 disables the check)",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&NrRlcMetricsSampler::m_backlogDelta),
+                          MakeUintegerChecker<uint32_t>());
+    return tid;
+}
+
+NrRlcMetricsSampler::NrRlcMetricsSampler()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+NrRlcMetricsSampler::~NrRlcMetricsSampler()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+Ptr<NrRlcMetricsSampler>
+NrRlcMetricsSampler::Get()
+{
+    Ptr<NrRlcMetricsSampler>& sampler = GetSamplerInstance();
+    if (!sampler)
+    {
+        sampler = CreateObject<NrRlcMetricsSampler>();
+        Simulator::ScheduleDestroy(&NrRlcMetricsSampler::DestroyInstance);
+    }
+    return sampler;
+}
+
+void
+NrRlcMetricsSampler::DestroyInstance()
+{
+    Ptr<NrRlcMetricsSampler>& sampler = GetSamplerInstance();
+    if (sampler)
+    {
+        sampler->Dispose();
+        sampler = nullptr;
+    }
+}
+
+void
+NrRlcMetricsSampler::DoDispose()
+{
+    NS_LOG_FUNCTION(this);
+    m_sampleEvent.Cancel();
+    m_entries.clear();
+    m_index.clear();
+    Object::DoDispose();
+}
+
+void
+NrRlcMetricsSampler::Register(NrRlc* rlc)
+{
+    NS_LOG_FUNCTION(this << rlc);
+    if (m_index.count(rlc))
+    {
+        return;
+    }
+    m_index[rlc] = m_entries.size();
+    m_entries.push_back({rlc, NrRlcMetricsRecord(), false});
+
+    if (!m_sampleEvent.IsPending())
+    {
+        m_sampleEvent = Simulator::ScheduleNow(&NrRlcMetricsSampler::Sample, this);
+    }
+}
+
+void
+NrRlcMetricsSampler::Unregister(NrRlc* rlc)
+{
+    NS_LOG_FUNCTION(this << rlc);
+    auto it = m_index.find(rlc);
+    if (it == m_index.end())
+    {
+        return;
+    }
+
+    // Move the last entry into the hole
+    std::size_t pos = it->second;
+    m_index.erase(it);
+    if (pos != m_entries.size() - 1)
+    {
+        m_entries[pos] = m_entries.back();
+        m_index[m_entries[pos].rlc] = pos;
+    }
+    m_entries.pop_back();
+
+    if (m_entries.empty())
+    {
+        m_sampleEvent.Cancel();
+    }
+}
+
+uint32_t
+NrRlcMetricsSampler::GetNEntities() const
+{
+    return m_entries.size();
+}
+
+void
+NrRlcMetricsSampler::Sample()
+{
+    NS_LOG_FUNCTION(this << m_entries.size());
+
+    int64_t now = Simulator::Now().GetNanoSeconds();
+    int64_t delayDelta = m_delayDelta.GetNanoSeconds();
+    NrRlcMetricsRing* ring = NrRlcMetricsRing::Get();
+
+    for (auto& entry : m_entries)
+    {
+        NrRlcMetricsRecord record;
+        if (!entry.rlc->GetMetrics(record))
+        {
+            continue;
+        }
+
+        if (entry.sampled)
+        {
+            const NrRlcMetricsRecord& last = entry.last;
+            bool idle = record.txQueueSdus == 0 && last.txQueueSdus == 0 &&
+                        record.marks == last.marks && record.drops == last.drops;
+            if (m_skipIdle && idle)
+            {
+                continue;
+            }
+            if (delayDelta > 0 || m_backlogDelta > 0)
+            {
+                bool delayMoved =
+                    delayDelta > 0 && std::llabs(record.holDelayNs - last.holDelayNs) >= delayDelta;
+                bool backlogMoved =
+                    m_backlogDelta > 0 &&
+                    std::llabs(static_cast<int64_t>(record.queueBytes) - last.queueBytes) >=
+                        m_backlogDelta;
+                if (!delayMoved && !backlogMoved)
+                {
+                    continue;
+                }
+            }
+        }
+
+        record.timeNs = now;
+        ring->Push(record);
+        entry.last = record;
+        entry.sampled = true;
+    }
+
+    m_sampleEvent = Simulator::Schedule(m_period, &NrRlcMetricsSampler::Sample, this);
+}
+
+} // namespace ns3
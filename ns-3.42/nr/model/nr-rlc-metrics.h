@@ -0,0 +1,196 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef NR_RLC_METRICS_H
+#define NR_RLC_METRICS_H
+
+#include <ns3/event-id.h>
+#include <ns3/nstime.h>
+#include <ns3/object.h>
+#include <ns3/singleton.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+class NrRlc;
+
+/**
+ * \ingroup nr
+ * \brief One sample of the state of an RLC entity
+ *
+ * Marks and drops are cumulative counters, the other fields are the values
+ * at the time of the sample. txQueueSdus is only used by the sampler and
+ * is not written to the file.
+ */
+struct NrRlcMetricsRecord
+{
+    int64_t timeNs{0};         ///< Simulation time of the sample (ns)
+    int64_t holDelayNs{0};     ///< Head-of-line delay of the TX queue (ns)
+    uint32_t queueBytes{0};    ///< TX queue size at the last MAC opportunity (bytes)
+    uint32_t macGrantBytes{0}; ///< Size of the last MAC opportunity (bytes)
+    uint32_t marks{0};         ///< ECN CE marks applied so far
+    uint32_t drops{0};         ///< Packets dropped so far
+    uint16_t rnti{0};          ///< RNTI of the UE
+    uint8_t lcid{0};           ///< LCID of the bearer
+    uint32_t txQueueSdus{0};   ///< SDUs (or SDU remainders) in the TX queue
+};
+
+/**
+ * \ingroup nr
+ * \brief Process-wide ring of RLC metric samples
+ *
+ * The RLC entities push fixed-size binary records into a single ring; when
+ * the ring is full, and when the simulation is destroyed, the pending records
+ * are drained to one file (set with the "NrRlcMetricsFile" global value) by
+ * memory-mapping its tail.
+ *
+ * The file starts with a 16 byte header (the magic "NRRLCMET", a uint32_t
+ * version and a uint32_t number of columns) followed by blocks. Each block
+ * has a uint32_t record count and a uint32_t padding word, followed by one
+ * contiguous array per column in the order timeNs, holDelayNs, queueBytes,
+ * macGrantBytes, marks, drops, rnti, lcid, padded to a multiple of 8 bytes.
+ * All values are in host byte order. NrRlcMetricsReader reads it back.
+ *
+ * The ring is lock-free for one producer and one consumer: the write index
+ * is published with release semantics after the record is stored, so the
+ * drain never sees a partially written record.
+ */
+class NrRlcMetricsRing : public Singleton<NrRlcMetricsRing>
+{
+  public:
+    static const uint32_t CAPACITY = 8192;       ///< Number of records in the ring (power of two)
+    static const uint32_t VERSION = 1;           ///< Version of the file format
+    static const uint32_t N_COLUMNS = 8;         ///< Number of columns in a block
+    static const uint32_t HEADER_SIZE = 16;      ///< Size of the file header (bytes)
+    static const uint32_t BLOCK_HEADER_SIZE = 8; ///< Size of a block header (bytes)
+    static const char MAGIC[8];                  ///< Magic at the start of the file
+
+    NrRlcMetricsRing();
+    ~NrRlcMetricsRing() override;
+
+    /**
+     * \brief Append a record to the ring, draining it first if it is full
+     *
+     * \param record the sample
+     */
+    void Push(const NrRlcMetricsRecord& record);
+
+    /// Drain the pending records to the file
+    void Flush();
+
+    /**
+     * \returns the number of records pushed so far
+     */
+    uint64_t GetNRecords() const;
+
+    /**
+     * \param nRecords the number of records in a block
+     * \returns the size of a block on disk, including its header (bytes)
+     */
+    static uint64_t GetBlockSize(uint32_t nRecords);
+
+  private:
+    /// Create the file and write its header
+    void Open();
+    /// Flush scheduled at Simulator::Destroy
+    void FlushOnDestroy();
+
+    std::vector<NrRlcMetricsRecord> m_records; ///< The ring
+    std::atomic<uint64_t> m_head;              ///< Next slot to write
+    std::atomic<uint64_t> m_tail;              ///< Next slot to drain
+    int m_fd;                                  ///< Descriptor of the file, -1 if not open
+    uint64_t m_fileSize;                       ///< Bytes written to the file
+    bool m_destroyScheduled;                   ///< Whether a flush at Simulator::Destroy is scheduled
+};
+
+/**
+ * \ingroup nr
+ * \brief Periodic sampler of the RLC entities
+ *
+ * The gNB RLC entities register here, and a single event walks all of them
+ * once per sampling period, pushing their samples into the
+ * NrRlcMetricsRing. The event only runs while there are registered
+ * entities, and is cancelled when the sampler is disposed at
+ * Simulator::Destroy.
+ *
+ * An entity is idle when its TX queue held no SDU at the previous sample
+ * and still holds none, and no packet was marked or dropped in between;
+ * with SkipIdle set (it is not by default), idle entities are not sampled. With DelayDelta or BacklogDelta set,
+ * an entity is only sampled when its head-of-line delay or its queue size
+ * moved by at least that much since its last sample.
+ */
+class NrRlcMetricsSampler : public Object
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+
+    NrRlcMetricsSampler();
+    ~NrRlcMetricsSampler() override;
+
+    /**
+     * \brief Get the sampler of the current simulation, creating it if needed
+     *
+     * \returns the sampler
+     */
+    static Ptr<NrRlcMetricsSampler> Get();
+
+    /**
+     * \brief Start sampling an RLC entity
+     *
+     * \param rlc the entity; it must unregister before being destroyed
+     */
+    void Register(NrRlc* rlc);
+
+    /**
+     * \brief Stop sampling an RLC entity
+     *
+     * \param rlc the entity
+     */
+    void Unregister(NrRlc* rlc);
+
+    /**
+     * \returns the number of registered entities
+     */
+    uint32_t GetNEntities() const;
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    /// Sample all the registered entities and schedule the next round
+    void Sample();
+
+    /// Dispose the sampler of the current simulation
+    static void DestroyInstance();
+
+    /// A registered entity
+    struct Entry
+    {
+        NrRlc* rlc;              ///< The entity
+        NrRlcMetricsRecord last; ///< Its last sample
+        bool sampled;            ///< Whether it was sampled yet
+    };
+
+    std::vector<Entry> m_entries;                    ///< Registered entities
+    std::unordered_map<NrRlc*, std::size_t> m_index; ///< Position of each entity in m_entries
+    EventId m_sampleEvent;                           ///< Next round of sampling
+    Time m_period;                                   ///< Sampling period
+    bool m_skipIdle;                                 ///< Skip the idle entities
+    Time m_delayDelta;                               ///< Minimum change of HoL delay to sample
+    uint32_t m_backlogDelta;                         ///< Minimum change of queue size to sample
+};
+
+} // namespace ns3
+
+#endif // NR_RLC_METRICS_H
@@ -0,0 +1,74 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef NR_RLC_SEGMENT_VIEW_H
+#define NR_RLC_SEGMENT_VIEW_H
+
+#include <ns3/packet.h>
+
+namespace ns3
+{
+
+/**
+ * \ingroup nr
+ * \brief A segment of an RLC SDU, referring to the SDU instead of holding a copy of its bytes
+ *
+ * The transmit buffers keep the whole SDUs and the offset of their first
+ * byte not yet sent, and the data field of a PDU is built out of views.
+ * The bytes of a segment are only materialized, by Materialize, when the
+ * PDU is serialized for the MAC; an SDU taken whole is not copied at all.
+ */
+struct NrRlcSegmentView
+{
+    /**
+     * \brief Constructor
+     * \param sdu the whole SDU
+     * \param offset the first byte of the segment in the SDU
+     * \param length the number of bytes of the segment
+     */
+    NrRlcSegmentView(const Ptr<Packet>& sdu, uint32_t offset, uint32_t length)
+        : m_sdu(sdu),
+          m_offset(offset),
+          m_length(length)
+    {
+    }
+
+    /**
+     * \returns true if the segment holds the first byte of the SDU
+     */
+    bool StartsSdu() const
+    {
+        return m_offset == 0;
+    }
+
+    /**
+     * \returns true if the segment holds the last byte of the SDU
+     */
+    bool EndsSdu() const
+    {
+        return m_offset + m_length == m_sdu->GetSize();
+    }
+
+    /**
+     * \returns the bytes of the segment: the SDU itself if the segment
+     *          covers it whole, a fragment of it otherwise. Copy the
+     *          result before modifying it.
+     */
+    Ptr<Packet> Materialize() const
+    {
+        if (StartsSdu() && EndsSdu())
+        {
+            return m_sdu;
+        }
+        return m_sdu->CreateFragment(m_offset, m_length);
+    }
+
+    Ptr<Packet> m_sdu;  ///< The whole SDU
+    uint32_t m_offset;  ///< First byte of the segment in the SDU
+    uint32_t m_length;  ///< Number of bytes of the segment
+};
+
+} // namespace ns3
+
+#endif // NR_RLC_SEGMENT_VIEW_H
@@ -8,14 +8,16 @@
 
 #include "nr-pdcp-header.h"
 #include "nr-rlc-header.h"
-#include "nr-rlc-sdu-status-tag.h"
 #include "nr-rlc-tag.h"
 
 #include "ns3/ipv4-header.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/log.h"
 #include "ns3/object.h"
+#include "ns3/pointer.h"
 #include "ns3/simulator.h"
+#include "ns3/tag.h"
+#include "ns3/uinteger.h"
 
 namespace ns3
 {
@@ -24,6 +26,73 @@ NS_LOG_COMPONENT_DEFINE("NrRlcUmDualpi2");
 
 NS_OBJECT_ENSURE_REGISTERED(NrRlcUmDualpi2);
 
+/**
+ * \ingroup nr
+ * Tag carrying the sojourn predicted for an L4S SDU when it was enqueued,
+ * and whether the SDU was marked then
+ */
+class NrRlcPredictedSojournTag : public Tag
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+    TypeId GetInstanceTypeId() const override;
+    uint32_t GetSerializedSize() const override;
+    void Serialize(TagBuffer i) const override;
+    void Deserialize(TagBuffer i) override;
+    void Print(std::ostream& os) const override;
+
+    Time m_predicted;     ///< predicted sojourn
+    bool m_marked{false}; ///< whether the SDU was marked at enqueue
+};
+
+NS_OBJECT_ENSURE_REGISTERED(NrRlcPredictedSojournTag);
+
+TypeId
+NrRlcPredictedSojournTag::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::NrRlcPredictedSojournTag")
+                            .SetParent<Tag>()
+                            .SetGroupName("Nr")
+                            .AddConstructor<NrRlcPredictedSojournTag>();
+    return tid;
+}
+
+TypeId
+NrRlcPredictedSojournTag::GetInstanceTypeId() const
+{
+    return GetTypeId();
+}
+
+uint32_t
+NrRlcPredictedSojournTag::GetSerializedSize() const
+{
+    return 9;
+}
+
+void
+NrRlcPredictedSojournTag::Serialize(TagBuffer i) const
+{
+    i.WriteU64(m_predicted.GetTimeStep());
+    i.WriteU8(m_marked);
+}
+
+void
+NrRlcPredictedSojournTag::Deserialize(TagBuffer i)
+{
+    m_predicted = TimeStep(i.ReadU64());
+    m_marked = i.ReadU8();
+}
+
+void
+NrRlcPredictedSojournTag::Print(std::ostream& os) const
+{
+    os << "predicted=" << m_predicted << " marked=" << m_marked;
+}
+
 NrRlcUmDualpi2::NrRlcUmDualpi2()
     : m_maxAqmSizeBytes(10 * 1024),
       m_sequenceNumber(0),
@@ -34,25 +103,21 @@ NrRlcUmDualpi2::NrRlcUmDualpi2()
       m_expectedSeqNumber(0),
       m_macOpportuntyCurrTime(Time(0)),
       m_macOpportuntyOldTime(Time(0)),
-      m_aqmDrops(0)
+      m_aqmDrops(0),
+      m_lowerEffortClass(false),
+      m_targetCqi(0xff),
+      m_grantWindowBytes(0),
+      m_grantSeen(false),
+      m_predictiveMarks(0),
+      m_remarkedSdus(0)
 {
     NS_LOG_FUNCTION(this);
-    aqm = CreateObject<DualQCoupledPiSquareQueueDisc>();
-    aqm->Initialize();
     m_reassemblingState = WAITING_S0_FULL;
-
-    std::string rlc_ref = std::to_string(reinterpret_cast<uintptr_t>(this));
-    std::string filename = "dualpi2-metrics-" + rlc_ref + ".log";
-    outfile.open(filename, std::ios::app); // Open in append mode to avoid overwriting
-    ExportQueueDelay(outfile);
 }
 
 NrRlcUmDualpi2::~NrRlcUmDualpi2()
 {
     NS_LOG_FUNCTION(this);
-
-    ExportQueueDelay(outfile);
-    outfile.close();
 }
 
 TypeId
@@ -86,7 +151,46 @@ NrRlcUmDualpi2::GetTypeId()
                           "timer value, otherwise it will be used this value.",
                           UintegerValue(0),
                           MakeUintegerAccessor(&NrRlcUmDualpi2::m_discardTimerMs),
-                          MakeUintegerChecker<uint32_t>());
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("LowerEffortClass",
+                          "Add a scavenger class to a DualQ AQM, for the packets with the LE "
+                          "(RFC 8622) or CS1 DSCP: 100 ms delay target, coupling factor 2, "
+                          "served before the L4S and Classic packets only once it waited 100 ms "
+                          "longer. Applies to the AQMs created by AqmType afterwards.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&NrRlcUmDualpi2::m_lowerEffortClass),
+                          MakeBooleanChecker())
+            .AddAttribute("AqmType",
+                          "The QueueDisc holding the RLC SDUs, with its attributes, e.g. "
+                          "\"ns3::PieQueueDisc[UseEcn=true|MaxSize=100p]\". Any QueueDisc "
+                          "that needs no classes can be used.",
+                          ObjectFactoryValue(ObjectFactory("ns3::DualQCoupledPiSquareQueueDisc")),
+                          MakeObjectFactoryAccessor(&NrRlcUmDualpi2::SetAqmType),
+                          MakeObjectFactoryChecker())
+            .AddAttribute("TargetPolicy",
+                          "Scales the delay targets of a DualQ AQM to the CQI reported by the "
+                          "UE. The targets are left as configured if null.",
+                          PointerValue(),
+                          MakePointerAccessor(&NrRlcUmDualpi2::m_targetPolicy),
+                          MakePointerChecker<NrRlcDualpi2TargetPolicy>())
+            .AddAttribute("PredictiveMarking",
+                          "Mark an L4S SDU at enqueue if the L4S backlog ahead of it, drained "
+                          "at the rate of the recent TX opportunities, would hold it longer than "
+                          "the L4S marking threshold of the DualQ AQM",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&NrRlcUmDualpi2::m_predictiveMarking),
+                          MakeBooleanChecker())
+            .AddAttribute("GrantWindow",
+                          "Length of the window of TX opportunities the drain rate is "
+                          "estimated on, for PredictiveMarking",
+                          TimeValue(MilliSeconds(10)),
+                          MakeTimeAccessor(&NrRlcUmDualpi2::m_grantWindow),
+                          MakeTimeChecker(MicroSeconds(1)))
+            .AddTraceSource("PredictedSojourn",
+                            "Sojourn of an L4S SDU predicted at enqueue, and the time it "
+                            "actually waited in the AQM, for PredictiveMarking",
+                            MakeTraceSourceAccessor(&NrRlcUmDualpi2::m_predictedSojournTrace),
+                            "ns3::NrRlcUmDualpi2::SojournTracedCallback");
     return tid;
 }
 
@@ -97,6 +201,8 @@ NrRlcUmDualpi2::DoDispose()
     m_reorderingTimer.Cancel();
     m_rbsTimer.Cancel();
 
+    m_targetPolicy = nullptr;
+
     NrRlc::DoDispose();
 }
 
@@ -123,7 +229,7 @@ NrRlcUmDualpi2::DoTransmitPdcpPdu(Ptr<Packet> p)
 {
     NS_LOG_FUNCTION(this << m_rnti << (uint32_t)m_lcid << p->GetSize());
     bool discarded = false;
-    if (aqm->GetQueueSizeBytes() + p->GetSize() <= m_maxAqmSizeBytes)
+    if (GetAqmBytes() + p->GetSize() <= m_maxAqmSizeBytes)
     {
         if (m_enablePdcpDiscarding)
         {
@@ -131,8 +237,9 @@ NrRlcUmDualpi2::DoTransmitPdcpPdu(Ptr<Packet> p)
             uint32_t discardTimerMs =
                 (m_discardTimerMs > 0) ? m_discardTimerMs : m_packetDelayBudgetMs;
 
-            if (aqm->GetQueueSize() > 0)
-                headOfLineDelayInMs = (Simulator::Now() - aqm->GetQueueDelay()).GetMilliSeconds();
+            if (GetAqmPackets() > 0)
+                headOfLineDelayInMs =
+                    (Simulator::Now() - GetAqmHeadArrivalTime()).GetMilliSeconds();
 
             NS_LOG_DEBUG("head of line delay in MS:" << headOfLineDelayInMs);
             if (headOfLineDelayInMs > discardTimerMs)
@@ -149,31 +256,56 @@ NrRlcUmDualpi2::DoTransmitPdcpPdu(Ptr<Packet> p)
         if (!discarded)
         {
             /** Store PDCP PDU */
-            NS_LOG_INFO("Adding RLC SDU to aqm after adding NrRlcSduStatusTag: FULL_SDU");
-
-            NrRlcSduStatusTag aqmTag;
-            aqmTag.SetStatus(NrRlcSduStatusTag::FULL_SDU);
-            p->AddPacketTag(aqmTag);
+            NS_LOG_INFO("Adding RLC SDU to aqm");
 
-            // enqueue the packet to the AQM
+            // enqueue the packet to the AQM; the IPv4 header to be ECN
+            // marked sits right after the PDCP header
             Ptr<QueueDiscItem> item;
+            NrPdcpHeader pdcpHeader;
+            bool predictiveMark = false;
 
             if (isL4S(p))
             {
                 NS_LOG_INFO("RLC Dualpi2 received a L4S packet");
-                item = Create<DualQueueL4SQueueDiscItem>(p, dest, 0);
+                Ptr<DualQueueL4SQueueDiscItem> l4sItem =
+                    Create<DualQueueL4SQueueDiscItem>(p, dest, 0);
+                l4sItem->SetIpv4HeaderOffset(pdcpHeader.GetSerializedSize());
+                item = l4sItem;
+
+                // Mark now rather than when the SDU reaches the head, one
+                // sojourn later, if the grants will not drain it in time
+                NrRlcPredictedSojournTag sojournTag;
+                if (m_predictiveMarking && m_dualq && PredictSojourn(sojournTag.m_predicted))
+                {
+                    if (sojournTag.m_predicted > m_dualq->GetL4SThreshold() && l4sItem->Mark())
+                    {
+                        NS_LOG_LOGIC("L4S SDU marked at enqueue, predicted sojourn "
+                                     << sojournTag.m_predicted);
+                        predictiveMark = true;
+                    }
+                    sojournTag.m_marked = predictiveMark;
+                    p->AddPacketTag(sojournTag);
+                }
             }
 
             else
             {
                 NS_LOG_INFO("RLC Dualpi2 received a Classic packet");
-                item = Create<DualQueueClassicQueueDiscItem>(p, dest, 0);
+                Ptr<DualQueueClassicQueueDiscItem> classicItem =
+                    Create<DualQueueClassicQueueDiscItem>(p, dest, 0);
+                classicItem->SetIpv4HeaderOffset(pdcpHeader.GetSerializedSize());
+                item = classicItem;
             }
 
-            aqm->Enqueue(item);
+            // A mark is only counted if the SDU is actually queued; a later
+            // mark of the DualQ on the same SDU is discounted in AqmMark
+            if (aqm->Enqueue(item) && predictiveMark)
+            {
+                ++m_predictiveMarks;
+            }
 
-            NS_LOG_LOGIC("packets in the AQM buffer  = " << aqm->GetQueueSize());
-            NS_LOG_LOGIC("AQM size in bytes          = " << aqm->GetQueueSizeBytes());
+            NS_LOG_LOGIC("packets in the AQM buffer  = " << GetAqmPackets());
+            NS_LOG_LOGIC("AQM size in bytes          = " << GetAqmBytes());
         }
     }
     else
@@ -181,7 +313,7 @@ NrRlcUmDualpi2::DoTransmitPdcpPdu(Ptr<Packet> p)
         // Discard full RLC SDU
         NS_LOG_INFO("AQM buffer is full. RLC SDU discarded");
         NS_LOG_LOGIC("MaxTxBufferSize  = " << m_maxAqmSizeBytes);
-        NS_LOG_LOGIC("aqmBufferSize    = " << aqm->GetQueueSizeBytes());
+        NS_LOG_LOGIC("aqmBufferSize    = " << GetAqmBytes());
         NS_LOG_LOGIC("packet size      = " << p->GetSize());
         m_txDropTrace(p);
         ++m_aqmDrops;
@@ -208,7 +340,8 @@ NrRlcUmDualpi2::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOp
     m_macOpportuntyOldTime = m_macOpportuntyCurrTime; // last time sending packets to mac
     m_macOpportuntyCurrTime = Simulator::Now();       // current time sending packets to mac
     m_lastMacOpportunity = txOpParams.bytes;
-    m_queueSizeWhenMacOpportunity = aqm->GetQueueSizeBytes();
+    m_queueSizeWhenMacOpportunity = GetAqmBytes();
+    RecordGrant(txOpParams.bytes);
                 
     if (txOpParams.bytes <= 2)
     {
@@ -217,127 +350,113 @@ NrRlcUmDualpi2::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOp
         return;
     }
 
-    bool l4s;
-    Ptr<Packet> p = Create<Packet>();
     NrRlcHeader aqmRlcHeader;
-    Time aqmFirstSegmentTime;
     Ptr<Packet> aqmFirstSegment;
     uint32_t aqmNextSegmentSize = txOpParams.bytes - 2;
     uint32_t aqmNextSegmentId = 1;
     uint32_t aqmDataFieldAddedSize = 0;
-    std::vector<Ptr<Packet>> aqmDataField;
-    
-    if (aqm->GetQueueSize() == 0)
+    uint32_t aqmBurstIdx = 0;
+
+    if (GetAqmPackets() == 0)
     {
         NS_LOG_LOGIC("No data pending in the AQM, skipping...");
         return;
     }
-    
-    NS_LOG_LOGIC("SDUs in the AQM  = " << aqm->GetQueueSize());
 
-    Ptr<QueueDiscItem> aqmItem = aqm->Dequeue();
+    NS_LOG_LOGIC("SDUs in the AQM  = " << GetAqmPackets());
+
+    // Pull all the SDUs of this TX opportunity at once, into the scratch
+    // vector of this entity
+    DequeueAqmBurst(aqmNextSegmentSize, m_aqmBurst);
+    if (m_aqmBurst.empty())
+    {
+        // The AQM dropped what it dequeued: nothing to send this time, but
+        // the MAC must learn the new buffer size
+        NS_LOG_LOGIC("AQM returned no SDU");
+        DoReportBufferStatus();
+        if (GetAqmPackets() > 0)
+        {
+            m_rbsTimer.Cancel();
+            m_rbsTimer =
+                Simulator::Schedule(MilliSeconds(10), &NrRlcUmDualpi2::ExpireRbsTimer, this);
+        }
+        return;
+    }
+
+    // The tag is removed before any segmentation, so that each SDU is
+    // traced once, when its first byte leaves
+    NrRlcPredictedSojournTag sojournTag;
+    for (const auto& item : m_aqmBurst)
+    {
+        if (item->GetPacket()->RemovePacketTag(sojournTag))
+        {
+            // Only the DualQ predicts, so its arrival time is used
+            m_predictedSojournTrace(sojournTag.m_predicted,
+                                    Simulator::Now() - m_dualq->GetArrivalTime(item));
+        }
+    }
+
+    Ptr<QueueDiscItem> aqmItem = m_aqmBurst[aqmBurstIdx++];
 
-    l4s = aqmItem->IsL4S();
+    // The SDUs are not copied: the data field refers to them, see
+    // NrRlcSegmentView, and the remainder of a segmented SDU is the same
+    // item with a segment offset
     aqmFirstSegment = aqmItem->GetPacket();
-    aqmFirstSegmentTime = aqmItem->GetTimeStamp();
+    uint32_t aqmFirstOffset = GetAqmSegmentOffset(aqmItem);
+    uint32_t aqmFirstSize = aqmItem->GetSize();
 
     NS_LOG_LOGIC("First SDU buffer  = " << aqmFirstSegment);
-    NS_LOG_LOGIC("First SDU size    = " << aqmFirstSegment->GetSize());
+    NS_LOG_LOGIC("First SDU size    = " << aqmFirstSize);
     NS_LOG_LOGIC("Next segment size = " << aqmNextSegmentSize);
     NS_LOG_LOGIC("Remove SDU from AQM");
-    NS_LOG_LOGIC("AQM buffer size      = " << aqm->GetQueueSizeBytes());
+    NS_LOG_LOGIC("AQM buffer size      = " << GetAqmBytes());
 
-    while (aqmFirstSegment && (aqmFirstSegment->GetSize() > 0) && (aqmNextSegmentSize > 0))
+    while (aqmFirstSegment && (aqmFirstSize > 0) && (aqmNextSegmentSize > 0))
     {
         NS_LOG_LOGIC("WHILE ( aqmFirstSegment && aqmFirstSegment->GetSize > 0 && "
                      "aqmNextSegmentSize > 0 )");
-        NS_LOG_LOGIC("    aqmFirstSegment size  = " << aqmFirstSegment->GetSize());
+        NS_LOG_LOGIC("    aqmFirstSegment size  = " << aqmFirstSize);
         NS_LOG_LOGIC("    aqmNextSegmentSize = " << aqmNextSegmentSize);
-        if ((aqmFirstSegment->GetSize() > aqmNextSegmentSize) ||
+        if ((aqmFirstSize > aqmNextSegmentSize) ||
             // Segment larger than 2047 octets can only be mapped to the end of the Data field
-            (aqmFirstSegment->GetSize() > 2047))
+            (aqmFirstSize > 2047))
         {
             // Take the minimum size, due to the 2047-bytes 3GPP exception
             // This exception is due to the length of the LI field (just 11 bits)
-            uint32_t aqmCurrSegmentSize = std::min(aqmFirstSegment->GetSize(), aqmNextSegmentSize);
+            uint32_t aqmCurrSegmentSize = std::min(aqmFirstSize, aqmNextSegmentSize);
 
             NS_LOG_LOGIC("    IF ( aqmFirstSegment > aqmNextSegmentSize ||");
             NS_LOG_LOGIC("         aqmFirstSegment > 2047 )");
 
             // Segment aqmFirstSegment and
             // Give back the remaining segment to the transmission buffer
-            Ptr<Packet> aqmNewSegment = aqmFirstSegment->CreateFragment(0, aqmCurrSegmentSize);
-            NS_LOG_LOGIC("    aqmNewSegment size   = " << aqmNewSegment->GetSize());
-
-            // Status tag of the new and remaining segments
-            // Note: This is the only place where a PDU is segmented and
+            // Note: This is the only place where an SDU is segmented and
             // therefore its status can change
-            NrRlcSduStatusTag aqmOldTag;
-            NrRlcSduStatusTag aqmNewTag;
-            aqmFirstSegment->RemovePacketTag(aqmOldTag);
-            aqmNewSegment->RemovePacketTag(aqmNewTag);
-
-            if (aqmOldTag.GetStatus() == NrRlcSduStatusTag::FULL_SDU)
-            {
-                aqmNewTag.SetStatus(NrRlcSduStatusTag::FIRST_SEGMENT);
-                aqmOldTag.SetStatus(NrRlcSduStatusTag::LAST_SEGMENT);
-            }
-            else if (aqmOldTag.GetStatus() == NrRlcSduStatusTag::LAST_SEGMENT)
-            {
-                aqmNewTag.SetStatus(NrRlcSduStatusTag::MIDDLE_SEGMENT);
-            }
+            m_pduDataField.emplace_back(aqmFirstSegment, aqmFirstOffset, aqmCurrSegmentSize);
+            NS_LOG_LOGIC("    aqmNewSegment size   = " << aqmCurrSegmentSize);
 
-            // Give back the remaining segment to the transmission buffer
-            aqmFirstSegment->RemoveAtStart(aqmCurrSegmentSize);
+            aqmFirstSize -= aqmCurrSegmentSize;
+            NS_LOG_LOGIC("    firstSegment size (after segmentation) = " << aqmFirstSize);
 
-            NS_LOG_LOGIC(
-                "    firstSegment size (after RemoveAtStart) = " << aqmFirstSegment->GetSize());
-
-            if (aqmFirstSegment->GetSize() > 0)
+            if (aqmFirstSize > 0)
             {
-                aqmFirstSegment->AddPacketTag(aqmOldTag);
-
-                uint32_t itemSize = 0;
-                Ptr<QueueDiscItem> item;
-
-                if (l4s)
-                    item = Create<DualQueueL4SQueueDiscItem>(aqmFirstSegment, dest, 0);
-                else
-                    item = Create<DualQueueClassicQueueDiscItem>(aqmFirstSegment, dest, 0);
-
-                itemSize = item->GetSize();
-
-                aqm->Requeue(item);
+                // The item now holds the remainder; it keeps the class and
+                // arrival time of the original SDU, and is never ECN marked
+                SetAqmSegmentOffset(aqmItem, aqmFirstOffset + aqmCurrSegmentSize);
+                RequeueAqmHead(aqmItem);
 
                 NS_LOG_LOGIC("    AQM: Give back the remaining segment");
-                NS_LOG_LOGIC("    AQM size = " << aqm->GetQueueSize());
-                NS_LOG_LOGIC("    Front buffer size = " << itemSize);
-                NS_LOG_LOGIC("    aqmBufferSize = " << aqm->GetQueueSizeBytes());
-            }
-            else
-            {
-                // Whole segment was taken, so adjust tag
-                if (aqmNewTag.GetStatus() == NrRlcSduStatusTag::FIRST_SEGMENT)
-                {
-                    aqmNewTag.SetStatus(NrRlcSduStatusTag::FULL_SDU);
-                }
-                else if (aqmNewTag.GetStatus() == NrRlcSduStatusTag::MIDDLE_SEGMENT)
-                {
-                    aqmNewTag.SetStatus(NrRlcSduStatusTag::LAST_SEGMENT);
-                }
+                NS_LOG_LOGIC("    AQM size = " << GetAqmPackets());
+                NS_LOG_LOGIC("    Front buffer size = " << aqmItem->GetSize());
+                NS_LOG_LOGIC("    aqmBufferSize = " << GetAqmBytes());
             }
 
             // Segment is completely taken or
             // the remaining segment is given back to the transmission buffer
             aqmFirstSegment = nullptr;
 
-            // Put status tag once it has been adjusted
-            aqmNewSegment->AddPacketTag(aqmNewTag);
-
             // Add Segment to Data field
-            aqmDataFieldAddedSize = aqmNewSegment->GetSize();
-            aqmDataField.push_back(aqmNewSegment);
-            aqmNewSegment = nullptr;
+            aqmDataFieldAddedSize = aqmCurrSegmentSize;
 
             // ExtensionBit (Next_Segment - 1) = 0
             aqmRlcHeader.PushExtensionBit(NrRlcHeader::DATA_FIELD_FOLLOWS);
@@ -351,13 +470,13 @@ NrRlcUmDualpi2::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOp
             // (NO more segments) → exit
             // break;
         }
-        else if ((aqmNextSegmentSize - aqmFirstSegment->GetSize() <= 2) || aqm->GetQueueSize() == 0)
+        else if ((aqmNextSegmentSize - aqmFirstSize <= 2) || aqmBurstIdx == m_aqmBurst.size())
         {
             NS_LOG_LOGIC("    IF aqmNextSegmentSize - aqmFirstSegment->GetSize () <= 2 || "
-                         "aqm->GetQueueSize() == 0");
+                         "no more SDUs in the burst");
             // Add txBuffer.FirstBuffer to DataField
-            aqmDataFieldAddedSize = aqmFirstSegment->GetSize();
-            aqmDataField.push_back(aqmFirstSegment);
+            aqmDataFieldAddedSize = aqmFirstSize;
+            m_pduDataField.emplace_back(aqmFirstSegment, aqmFirstOffset, aqmFirstSize);
             aqmFirstSegment = nullptr;
 
             // ExtensionBit (Next_Segment - 1) = 0
@@ -367,7 +486,7 @@ NrRlcUmDualpi2::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOp
             aqmNextSegmentSize -= aqmDataFieldAddedSize;
             aqmNextSegmentId++;
 
-            NS_LOG_LOGIC("        SDUs in AQM buffer  = " << aqm->GetQueueSize());
+            NS_LOG_LOGIC("        SDUs in AQM buffer  = " << GetAqmPackets());
             NS_LOG_LOGIC("        Next segment size   = " << aqmNextSegmentSize);
 
             // nextSegmentSize <= 2 (only if txBuffer is not empty)
@@ -375,85 +494,59 @@ NrRlcUmDualpi2::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOp
             // (NO more segments) → exit
             // break;
         }
-        else // (aqmFirstSegment->GetSize () < aqmNextSegmentSize) && (aqm->GetQueueSize() > 0)
+        else // (aqmFirstSegment->GetSize () < aqmNextSegmentSize) && more SDUs in the burst
         {
-            NS_LOG_LOGIC("    IF aqmFirstSegment < NextSegmentSize && aqm->GetQueueSize() > 0");
+            NS_LOG_LOGIC("    IF aqmFirstSegment < NextSegmentSize && more SDUs in the burst");
 
             // Add txBuffer.FirstBuffer to DataField
-            aqmDataFieldAddedSize = aqmFirstSegment->GetSize();
-            aqmDataField.push_back(aqmFirstSegment);
+            aqmDataFieldAddedSize = aqmFirstSize;
+            m_pduDataField.emplace_back(aqmFirstSegment, aqmFirstOffset, aqmFirstSize);
 
             // LengthIndicator (Next_Segment) = txBuffer.FirstBuffer.length()
-            aqmRlcHeader.PushLengthIndicator(aqmFirstSegment->GetSize());
+            aqmRlcHeader.PushLengthIndicator(aqmFirstSize);
 
             aqmNextSegmentSize -= ((aqmNextSegmentId % 2) ? (2) : (1)) + aqmDataFieldAddedSize;
             aqmNextSegmentId++;
 
             // (more segments)
-            Ptr<QueueDiscItem> aqmItem = aqm->Dequeue();
+            aqmItem = m_aqmBurst[aqmBurstIdx++];
 
             aqmRlcHeader.PushExtensionBit(NrRlcHeader::E_LI_FIELDS_FOLLOWS);
             aqmFirstSegment = aqmItem->GetPacket();
-            aqmFirstSegmentTime = aqmItem->GetTimeStamp();
+            aqmFirstOffset = GetAqmSegmentOffset(aqmItem);
+            aqmFirstSize = aqmItem->GetSize();
 
-            NS_LOG_LOGIC("        SDUs in AQM  = " << aqm->GetQueueSize());
+            NS_LOG_LOGIC("        SDUs left in burst = " << m_aqmBurst.size() - aqmBurstIdx);
             NS_LOG_LOGIC("        Next segment size = " << aqmNextSegmentSize);
-            NS_LOG_LOGIC("        Remove SDU from AQM");
+            NS_LOG_LOGIC("        Take next SDU from burst");
         }
     }
+    m_aqmBurst.clear();
 
     // Build RLC header
     aqmRlcHeader.SetSequenceNumber(m_sequenceNumber++);
 
-    // Build RLC PDU with DataField and Header
-    auto it = aqmDataField.begin();
-
+    // Framing info of the data field: whether it starts with the first
+    // byte of an SDU and ends with the last byte of an SDU
     uint8_t aqmFramingInfo = 0;
+    aqmFramingInfo |= m_pduDataField.front().StartsSdu() ? NrRlcHeader::FIRST_BYTE
+                                                          : NrRlcHeader::NO_FIRST_BYTE;
+    aqmFramingInfo |=
+        m_pduDataField.back().EndsSdu() ? NrRlcHeader::LAST_BYTE : NrRlcHeader::NO_LAST_BYTE;
+    aqmRlcHeader.SetFramingInfo(aqmFramingInfo);
 
-    // FIRST SEGMENT
-    NrRlcSduStatusTag aqmTag;
-    NS_ASSERT_MSG((*it)->PeekPacketTag(aqmTag), "NrRlcSduStatusTag is missing");
-    (*it)->PeekPacketTag(aqmTag);
-    if ((aqmTag.GetStatus() == NrRlcSduStatusTag::FULL_SDU) ||
-        (aqmTag.GetStatus() == NrRlcSduStatusTag::FIRST_SEGMENT))
-    {
-        aqmFramingInfo |= NrRlcHeader::FIRST_BYTE;
-    }
-    else
-    {
-        aqmFramingInfo |= NrRlcHeader::NO_FIRST_BYTE;
-    }
-
-    while (it < aqmDataField.end())
+    // Build RLC PDU with DataField and Header: the bytes of the segments
+    // are only materialized here. The PDU is built on a copy, as a whole
+    // SDU is materialized as itself and the upper layers may still hold it.
+    // ns-3 packets cannot be composed in one allocation: each AddAtEnd may
+    // still grow the buffer of the PDU
+    Ptr<Packet> p = m_pduDataField.front().Materialize()->Copy();
+    for (std::size_t i = 1; i < m_pduDataField.size(); i++)
     {
-        NS_LOG_LOGIC("Adding SDU/segment to packet, length = " << (*it)->GetSize());
-
-        NS_ASSERT_MSG((*it)->PeekPacketTag(aqmTag), "NrRlcSduStatusTag is missing");
-        (*it)->RemovePacketTag(aqmTag);
-        if (p->GetSize() > 0)
-        {
-            p->AddAtEnd(*it);
-        }
-        else
-        {
-            p = (*it);
-        }
-        it++;
+        NS_LOG_LOGIC("Adding SDU/segment to packet, length = " << m_pduDataField[i].m_length);
+        p->AddAtEnd(m_pduDataField[i].Materialize());
     }
-
-    // LAST SEGMENT (Note: There could be only one and be the first one)
-    it--;
-    if ((aqmTag.GetStatus() == NrRlcSduStatusTag::FULL_SDU) ||
-        (aqmTag.GetStatus() == NrRlcSduStatusTag::LAST_SEGMENT))
-    {
-        aqmFramingInfo |= NrRlcHeader::LAST_BYTE;
-    }
-    else
-    {
-        aqmFramingInfo |= NrRlcHeader::NO_LAST_BYTE;
-    }
-
-    aqmRlcHeader.SetFramingInfo(aqmFramingInfo);
+    m_pduDataField.clear();
 
     NS_LOG_LOGIC("RLC Dualpi2 header: " << aqmRlcHeader);
     p->AddHeader(aqmRlcHeader);
@@ -475,7 +568,7 @@ NrRlcUmDualpi2::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOp
     NS_LOG_INFO("Forward RLC Dualpi2 PDU to MAC Layer");
     m_macSapProvider->TransmitPdu(params);
 
-    if (aqm->GetQueueSize() > 0)
+    if (GetAqmPackets() > 0)
     {
         m_rbsTimer.Cancel();
         m_rbsTimer = Simulator::Schedule(MilliSeconds(10), &NrRlcUmDualpi2::ExpireRbsTimer, this);
@@ -1220,13 +1313,21 @@ NrRlcUmDualpi2::DoReportBufferStatus()
     Time holDelay(0);
     uint32_t queueSize = 0;
 
-    int aqmCurrSize = aqm->GetQueueSizeBytes();
-    if (aqm->GetQueueSize() > 0)
+    uint32_t aqmPackets = GetAqmPackets();
+    if (aqmPackets > 0)
     {
-        holDelay = Simulator::Now() - aqm->GetQueueDelay();
+        holDelay = Simulator::Now() - GetAqmHeadArrivalTime();
 
-        queueSize =
-            aqmCurrSize + 2 * aqm->GetQueueSize(); // Data in the aqm + estimated headers size
+        // Size of the PDU that drains the AQM: the 2-byte fixed header, the
+        // SDUs and 12 bits of E and LI fields for every SDU but the last one
+        if (m_dualq)
+        {
+            queueSize = m_dualq->GetBurstBytes(12, 2);
+        }
+        else
+        {
+            queueSize = 2 + GetAqmBytes() + (12 * (aqmPackets - 1) + 7) / 8;
+        }
     }
 
     NrMacSapProvider::ReportBufferStatusParameters r;
@@ -1238,10 +1339,299 @@ NrRlcUmDualpi2::DoReportBufferStatus()
     r.retxQueueHolDelay = 0;
     r.statusPduSize = 0;
 
-    NS_LOG_LOGIC("Send ReportBufferStatus = " << r.txQueueSize << ", " << r.txQueueHolDelay);
+    if (m_dualq && queueSize > 0)
+    {
+        // The classes added by AddClass are reported with the Classic one
+        Time now = Simulator::Now();
+        bool classicBacklog = false;
+        for (uint32_t q = 0; q < m_dualq->GetNClasses(); q++)
+        {
+            DualQCoupledPiSquareQueueDisc::Backlog backlog = m_dualq->GetClassBacklog(q);
+            if (backlog.packets == 0)
+            {
+                continue;
+            }
+            uint16_t delay = (now - m_dualq->GetClassHeadArrival(q)).GetMilliSeconds();
+            if (q == 1)
+            {
+                // The L4S SDUs and 12 bits of E and LI fields for each of
+                // them, as all the SDUs of the PDU draining the AQM but one
+                // carry them
+                r.l4sTxQueueSize = backlog.bytes + (12 * backlog.packets + 7) / 8;
+                r.l4sTxQueueHolDelay = delay;
+            }
+            else
+            {
+                classicBacklog = true;
+                r.classicTxQueueHolDelay = std::max(r.classicTxQueueHolDelay, delay);
+            }
+        }
+        // The Classic part is the rest of the PDU (its SDUs, E and LI fields,
+        // and the fixed header), so that the parts add up to txQueueSize
+        if (!classicBacklog)
+        {
+            r.l4sTxQueueSize = queueSize;
+        }
+        r.classicTxQueueSize = queueSize - r.l4sTxQueueSize;
+    }
+
+    NS_LOG_LOGIC("Send ReportBufferStatus = " << r.txQueueSize << ", " << r.txQueueHolDelay
+                                              << " (L4S " << r.l4sTxQueueSize << ", "
+                                              << r.l4sTxQueueHolDelay << ")");
     m_macSapProvider->ReportBufferStatus(r);
 }
 
+void
+NrRlcUmDualpi2::SetAqmType(ObjectFactory factory)
+{
+    NS_LOG_FUNCTION(this << factory);
+    if (aqm)
+    {
+        aqm->Dispose();
+    }
+    m_aqmHeadSegment = nullptr;
+    aqm = factory.Create<QueueDisc>();
+    m_dualq = DynamicCast<DualQCoupledPiSquareQueueDisc>(aqm);
+    if (m_dualq)
+    {
+        // SDUs larger than the LI field can only end a PDU
+        m_dualq->SetAttribute("MaxInteriorSize", UintegerValue(2047));
+        m_dualq->TraceConnectWithoutContext("EnqueueMark",
+                                            MakeCallback(&NrRlcUmDualpi2::AqmMark, this));
+        m_dualq->TraceConnectWithoutContext("DequeueMark",
+                                            MakeCallback(&NrRlcUmDualpi2::AqmMark, this));
+    }
+    if (m_dualq && m_lowerEffortClass)
+    {
+        m_dualq->AddClass(MilliSeconds(100), 2, MilliSeconds(100));
+        m_dualq->SetClassifier(
+            MakeCallback(&DualQCoupledPiSquareQueueDisc::ClassifyLowerEffort));
+    }
+    aqm->Initialize();
+    m_targetCqi = 0xff;
+}
+
+void
+NrRlcUmDualpi2::ExpireGrants(Time now)
+{
+    while (!m_grants.empty() && m_grants.front().first <= now - m_grantWindow)
+    {
+        m_grantWindowBytes -= m_grants.front().second;
+        m_grants.pop_front();
+    }
+}
+
+void
+NrRlcUmDualpi2::RecordGrant(uint32_t bytes)
+{
+    NS_LOG_FUNCTION(this << bytes);
+    if (!m_predictiveMarking)
+    {
+        return;
+    }
+    Time now = Simulator::Now();
+    ExpireGrants(now);
+    if (!m_grantSeen)
+    {
+        m_grantSeen = true;
+        m_firstGrantTime = now;
+    }
+    m_grants.emplace_back(now, bytes);
+    m_grantWindowBytes += bytes;
+}
+
+bool
+NrRlcUmDualpi2::PredictSojourn(Time& sojourn)
+{
+    NS_LOG_FUNCTION(this);
+    if (!m_grantSeen)
+    {
+        return false;
+    }
+    Time now = Simulator::Now();
+    ExpireGrants(now);
+    // Until a whole window has passed, the rate is taken over the time
+    // since the first grant
+    Time span = now - m_firstGrantTime;
+    if (span > m_grantWindow)
+    {
+        span = m_grantWindow;
+    }
+    if (span.IsZero())
+    {
+        return false;
+    }
+    uint32_t backlog = m_dualq->GetL4SBacklog().bytes;
+    if (backlog == 0)
+    {
+        sojourn = Time(0);
+    }
+    else if (m_grantWindowBytes == 0)
+    {
+        // No grant in the window: the backlog is not drained at all
+        sojourn = Time::Max();
+    }
+    else
+    {
+        sojourn = TimeStep(static_cast<int64_t>(static_cast<double>(backlog) *
+                                                span.GetTimeStep() / m_grantWindowBytes));
+    }
+    NS_LOG_LOGIC("L4S backlog " << backlog << " bytes, " << m_grantWindowBytes
+                                << " bytes granted in " << span << ": sojourn " << sojourn);
+    return true;
+}
+
+void
+NrRlcUmDualpi2::AqmMark(Ptr<const QueueDiscItem> item, Time /* sojourn */)
+{
+    NrRlcPredictedSojournTag sojournTag;
+    if (item->GetPacket()->PeekPacketTag(sojournTag) && sojournTag.m_marked)
+    {
+        ++m_remarkedSdus;
+    }
+}
+
+void
+NrRlcUmDualpi2::DoSetCqi(uint8_t cqi)
+{
+    NS_LOG_FUNCTION(this << (uint32_t)cqi);
+    NrRlc::DoSetCqi(cqi);
+    if (!m_targetPolicy || !m_dualq || cqi == m_targetCqi)
+    {
+        return;
+    }
+    m_dualq->SetTargetScale(m_targetPolicy->GetTargetScale(cqi));
+    m_targetCqi = cqi;
+}
+
+uint32_t
+NrRlcUmDualpi2::GetAqmPackets() const
+{
+    if (m_dualq)
+    {
+        uint32_t packets = 0;
+        for (uint32_t q = 0; q < m_dualq->GetNClasses(); q++)
+        {
+            packets += m_dualq->GetClassBacklog(q).packets;
+        }
+        return packets;
+    }
+    return aqm->GetNPackets() + (m_aqmHeadSegment ? 1 : 0);
+}
+
+uint32_t
+NrRlcUmDualpi2::GetAqmBytes() const
+{
+    if (m_dualq)
+    {
+        return m_dualq->GetQueueSizeBytes();
+    }
+    return aqm->GetNBytes() + (m_aqmHeadSegment ? m_aqmHeadSegment->GetSize() : 0);
+}
+
+Time
+NrRlcUmDualpi2::GetAqmHeadArrivalTime()
+{
+    if (m_dualq)
+    {
+        return m_dualq->GetQueueDelay();
+    }
+    if (m_aqmHeadSegment)
+    {
+        return m_aqmHeadSegment->GetTimeStamp();
+    }
+    // QueueDisc::Peek would dequeue the head item, and thus take its drop or
+    // mark decision, ahead of time: only the internal queues are looked at
+    bool found = false;
+    Time arrival(0);
+    for (std::size_t i = 0; i < aqm->GetNInternalQueues(); i++)
+    {
+        Ptr<const QueueDiscItem> item = aqm->GetInternalQueue(i)->Peek();
+        if (item && (!found || item->GetTimeStamp() < arrival))
+        {
+            found = true;
+            arrival = item->GetTimeStamp();
+        }
+    }
+    if (!found && aqm->GetNPackets() > 0)
+    {
+        // The items are held by queue disc classes (e.g., FqCoDel): the
+        // head of line delay is unknown and reported as zero
+        return Simulator::Now();
+    }
+    return arrival;
+}
+
+Ptr<QueueDiscItem>
+NrRlcUmDualpi2::DequeueAqmBurst(uint32_t byteBudget, std::vector<Ptr<QueueDiscItem>>& out)
+{
+    // Every SDU followed by another one costs 12 bits (E and LI fields), and
+    // an SDU larger than 2047 octets can only be mapped to the end of the Data field
+    if (m_dualq)
+    {
+        return m_dualq->DequeueBurst(byteBudget, out, 12, 2047);
+    }
+
+    // Same filling rule as DualQCoupledPiSquareQueueDisc::DequeueBurst, one Dequeue at a time
+    uint32_t liBits = 0;
+    uint32_t usedBytes = 0;
+    Ptr<QueueDiscItem> item = m_aqmHeadSegment ? m_aqmHeadSegment : aqm->Dequeue();
+    m_aqmHeadSegment = nullptr;
+    while (item)
+    {
+        out.push_back(item);
+        uint32_t size = item->GetSize();
+        uint32_t available = byteBudget - usedBytes - (liBits + 7) / 8;
+        usedBytes += size;
+        if (size > available)
+        {
+            return item;
+        }
+        if (size > 2047 || available - size <= 2)
+        {
+            break;
+        }
+        liBits += 12;
+        item = aqm->Dequeue();
+    }
+    return nullptr;
+}
+
+uint32_t
+NrRlcUmDualpi2::GetAqmSegmentOffset(Ptr<QueueDiscItem> item)
+{
+    if (item->IsL4S())
+    {
+        return DynamicCast<DualQueueL4SQueueDiscItem>(item)->GetSegmentOffset();
+    }
+    return DynamicCast<DualQueueClassicQueueDiscItem>(item)->GetSegmentOffset();
+}
+
+void
+NrRlcUmDualpi2::SetAqmSegmentOffset(Ptr<QueueDiscItem> item, uint32_t offset)
+{
+    if (item->IsL4S())
+    {
+        DynamicCast<DualQueueL4SQueueDiscItem>(item)->SetSegmentOffset(offset);
+    }
+    else
+    {
+        DynamicCast<DualQueueClassicQueueDiscItem>(item)->SetSegmentOffset(offset);
+    }
+}
+
+void
+NrRlcUmDualpi2::RequeueAqmHead(Ptr<QueueDiscItem> item)
+{
+    if (m_dualq)
+    {
+        m_dualq->RequeueHead(item);
+        return;
+    }
+    NS_ASSERT_MSG(!m_aqmHeadSegment, "There is already a segment waiting for transmission");
+    m_aqmHeadSegment = item;
+}
+
 void
 NrRlcUmDualpi2::ExpireReorderingTimer()
 {
@@ -1287,40 +1677,53 @@ NrRlcUmDualpi2::ExpireRbsTimer()
 {
     NS_LOG_LOGIC("RBS Timer expires");
 
-    if (aqm->GetQueueSize() > 0)
+    if (GetAqmPackets() > 0)
     {
         DoReportBufferStatus();
         m_rbsTimer = Simulator::Schedule(MilliSeconds(10), &NrRlcUmDualpi2::ExpireRbsTimer, this);
     }
 }
 
-void
-NrRlcUmDualpi2::ExportQueueDelay(std::ofstream& outfile) // Pass by reference
+bool
+NrRlcUmDualpi2::GetMetrics(NrRlcMetricsRecord& record)
 {
-    NS_LOG_INFO("Exporting current queue delay to file");
+    if (!aqm)
+    {
+        return false;
+    }
 
-    Time qdelay = aqm->GetQueueDelay();
-    if(!qdelay.IsZero())
-        qdelay = Simulator::Now() - aqm->GetQueueDelay();
-    
-    uint32_t aqmMarks = aqm->GetStats().unforcedClassicMark + aqm->GetStats().unforcedL4SMark;
-    uint32_t totalDrops = m_aqmDrops + aqm->GetStats().unforcedClassicDrop + aqm->GetStats().forcedDrop;
-
-    outfile << "RLC Stats\n"
-            << "MAC credits: " << m_lastMacOpportunity << " bytes\n"
-            << "Queue size: " << m_queueSizeWhenMacOpportunity << " bytes\n"
-            << "Queue delay: " << qdelay.GetMilliSeconds() << " ms\n"
-            << "MAC delay: "
-            << (m_macOpportuntyCurrTime - m_macOpportuntyOldTime).GetMilliSeconds() << " ms\n"
-            << "Drops: " << totalDrops << " pkts\n"
-            << "Marks: " << aqmMarks << " pkts\n"
-            << std::endl;
-    
-    // Schedule the next call to ExportQueueDelay
-    Simulator::Schedule(MilliSeconds(5),
-                        &NrRlcUmDualpi2::ExportQueueDelay,
-                        this,
-                        std::ref(outfile));
+    Time qdelay(0);
+    if (GetAqmPackets() > 0)
+    {
+        qdelay = Simulator::Now() - GetAqmHeadArrivalTime();
+    }
+
+    uint32_t aqmMarks;
+    uint32_t totalDrops;
+    if (m_dualq)
+    {
+        DualQCoupledPiSquareQueueDisc::Stats stats = m_dualq->GetStats();
+        aqmMarks = stats.unforcedClassicMark + stats.unforcedL4SMark + stats.unforcedOtherMark +
+                   m_predictiveMarks - m_remarkedSdus;
+        totalDrops = m_aqmDrops + stats.unforcedClassicDrop + stats.unforcedL4SDrop +
+                     stats.unforcedOtherDrop + stats.forcedDrop;
+    }
+    else
+    {
+        const QueueDisc::Stats& stats = aqm->GetStats();
+        aqmMarks = stats.nTotalMarkedPackets;
+        totalDrops = m_aqmDrops + stats.nTotalDroppedPackets;
+    }
+
+    record.holDelayNs = qdelay.GetNanoSeconds();
+    record.queueBytes = m_queueSizeWhenMacOpportunity;
+    record.macGrantBytes = m_lastMacOpportunity;
+    record.marks = aqmMarks;
+    record.drops = totalDrops;
+    record.txQueueSdus = GetAqmPackets();
+    record.rnti = m_rnti;
+    record.lcid = m_lcid;
+    return true;
 }
 
 } // namespace ns3
\ No newline at end of file
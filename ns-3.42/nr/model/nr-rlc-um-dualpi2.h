@@ -7,14 +7,18 @@
 #ifndef NR_RLC_UM_DUALPI2_H
 #define NR_RLC_UM_DUALPI2_H
 
+#include "nr-rlc-dualpi2-target-policy.h"
+#include "nr-rlc-segment-view.h"
 #include "nr-rlc-sequence-number.h"
 #include "nr-rlc.h"
 
 #include <ns3/event-id.h>
 #include <ns3/dual-q-coupled-pi-square-queue-disc.h>
+#include <ns3/object-factory.h>
 
 #include <deque>
 #include <map>
+#include <vector>
 
 namespace ns3
 {
@@ -50,7 +54,15 @@ class NrRlcUmDualpi2 : public NrRlc
     void DoNotifyHarqDeliveryFailure() override;
     void DoReceivePdu(NrMacSapUser::ReceivePduParameters rxPduParams) override;
     static bool isL4S(ns3::Ptr<ns3::Packet> packet); ///< check if the packet is of L4S traffic
-    void ExportQueueDelay(std::ofstream &outfile); ///< exports queue delay stats to file
+    bool GetMetrics(NrRlcMetricsRecord& record) override;
+
+    /**
+     * TracedCallback signature for the sojourn of the L4S SDUs
+     *
+     * \param [in] predicted the sojourn predicted at enqueue
+     * \param [in] actual the time the SDU waited in the AQM
+     */
+    typedef void (*SojournTracedCallback)(Time predicted, Time actual);
 
   private:
     /// Expire reordering timer
@@ -87,6 +99,107 @@ class NrRlcUmDualpi2 : public NrRlc
     /// Report buffer status
     void DoReportBufferStatus();
 
+    /**
+     * Remove the TX opportunities older than GrantWindow from the window
+     *
+     * \param now the current time
+     */
+    void ExpireGrants(Time now);
+
+    /**
+     * Add a TX opportunity to the window of the grant rate estimator
+     *
+     * \param bytes the size of the TX opportunity
+     */
+    void RecordGrant(uint32_t bytes);
+
+    /**
+     * Predict the sojourn of an L4S SDU enqueued now, as the L4S backlog
+     * ahead of it divided by the rate of the grants in the last GrantWindow
+     *
+     * \param [out] sojourn the predicted sojourn
+     * \returns false if no grant was received yet, so there is no estimate
+     */
+    bool PredictSojourn(Time& sojourn);
+
+    /**
+     * Count the marks of the DualQ on SDUs already marked at enqueue, which
+     * are counted once in the metrics
+     *
+     * \param item the marked item
+     * \param sojourn the sojourn the DualQ decided on
+     */
+    void AqmMark(Ptr<const QueueDiscItem> item, Time sojourn);
+
+    /**
+     * Store the CQI and, if a target policy is set, rescale the targets of
+     * the DualQ to it
+     *
+     * \param cqi the CQI reported by the UE
+     */
+    void DoSetCqi(uint8_t cqi) override;
+
+    /**
+     * Replace the AQM with a new instance of the given QueueDisc type
+     *
+     * \param factory the factory of the AQM, including its attributes
+     */
+    void SetAqmType(ObjectFactory factory);
+
+    /**
+     * \returns the number of SDUs (and SDU segments) held by the AQM
+     */
+    uint32_t GetAqmPackets() const;
+
+    /**
+     * \returns the number of bytes held by the AQM
+     */
+    uint32_t GetAqmBytes() const;
+
+    /**
+     * Get the arrival time of the head of line SDU, without running the drop
+     * and mark decisions of the AQM. Only the internal queues of an AQM other
+     * than the DualQ are looked at: if the AQM keeps its items elsewhere, the
+     * current time is returned, i.e., a zero head of line delay.
+     *
+     * \returns the arrival time of the head of line SDU, zero if the AQM is empty
+     */
+    Time GetAqmHeadArrivalTime();
+
+    /**
+     * Dequeue the SDUs of a TX opportunity from the AQM, see
+     * DualQCoupledPiSquareQueueDisc::DequeueBurst. No SDU is appended if
+     * the AQM drops the items it dequeues first (e.g., CoDel or PIE deciding
+     * at dequeue), even though it still holds some: there is then nothing to
+     * send in this TX opportunity.
+     *
+     * \param byteBudget the bytes available for SDUs and LI fields
+     * \param out the vector the SDUs are appended to
+     * \returns the last SDU if it has to be segmented, null otherwise
+     */
+    Ptr<QueueDiscItem> DequeueAqmBurst(uint32_t byteBudget, std::vector<Ptr<QueueDiscItem>>& out);
+
+    /**
+     * Give the remainder of a segmented SDU back to the AQM
+     *
+     * \param item the item holding the remainder
+     */
+    void RequeueAqmHead(Ptr<QueueDiscItem> item);
+
+    /**
+     * \param item an item created by DoTransmitPdcpPdu
+     * \returns the number of bytes of its SDU already sent
+     */
+    static uint32_t GetAqmSegmentOffset(Ptr<QueueDiscItem> item);
+
+    /**
+     * Turn an item created by DoTransmitPdcpPdu into the remainder of its SDU
+     *
+     * \param item the item
+     * \param offset the number of bytes of its SDU already sent
+     */
+    static void SetAqmSegmentOffset(Ptr<QueueDiscItem> item, uint32_t offset);
+
   private:
     uint32_t m_maxAqmSizeBytes; ///< maximum transmit buffer status
 
@@ -146,9 +259,28 @@ class NrRlcUmDualpi2 : public NrRlc
      * DualPi2 variables and functions
      */
     Address dest;                             ///< destination address
-    std::ofstream outfile;                    ///< destination filename to store queue delay logs
-    Ptr<DualQCoupledPiSquareQueueDisc> aqm;   ///< Dual Queue Coupled PI Square queue disc
+    Ptr<QueueDisc> aqm;                       ///< AQM holding the RLC SDUs
+    Ptr<DualQCoupledPiSquareQueueDisc> m_dualq; ///< The AQM, if it is a DualQ Coupled PI Square
+    Ptr<QueueDiscItem> m_aqmHeadSegment;      ///< Remainder of a segmented SDU, for AQMs other than the DualQ
+    std::vector<Ptr<QueueDiscItem>> m_aqmBurst; ///< SDUs of the TX opportunity, reused across PDUs
+    std::vector<NrRlcSegmentView> m_pduDataField; ///< Data field of the PDU being built, reused across PDUs
     uint32_t m_aqmDrops;                      ///< AQM drops
+    Ptr<NrRlcDualpi2TargetPolicy> m_targetPolicy; ///< Maps the CQI to the scale of the DualQ targets
+    bool m_lowerEffortClass;                  ///< Add a scavenger class to the DualQ
+    uint8_t m_targetCqi;                      ///< CQI the DualQ targets are scaled to, 0xff if none
+
+    /**
+     * Predictive marking of the L4S SDUs at enqueue
+     */
+    bool m_predictiveMarking;                          ///< Whether predictive marking is enabled
+    Time m_grantWindow;                                ///< Length of the grant rate window
+    std::deque<std::pair<Time, uint32_t>> m_grants;    ///< TX opportunities within the window
+    uint64_t m_grantWindowBytes;                       ///< Bytes of the TX opportunities in the window
+    Time m_firstGrantTime;                             ///< Time of the first TX opportunity
+    bool m_grantSeen;                                  ///< Whether a TX opportunity was received
+    uint32_t m_predictiveMarks;                        ///< L4S SDUs marked at enqueue
+    uint32_t m_remarkedSdus;                           ///< Of those, SDUs marked again by the DualQ
+    TracedCallback<Time, Time> m_predictedSojournTrace; ///< Predicted versus actual L4S sojourn
 };
 
 } // namespace ns3
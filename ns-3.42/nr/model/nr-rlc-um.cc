@@ -7,9 +7,9 @@
 #include "nr-rlc-um.h"
 
 #include "nr-rlc-header.h"
-#include "nr-rlc-sdu-status-tag.h"
 #include "nr-rlc-tag.h"
 
+#include "ns3/enum.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 
@@ -23,6 +23,10 @@ NS_OBJECT_ENSURE_REGISTERED(NrRlcUm);
 NrRlcUm::NrRlcUm()
     : m_maxTxBufferSize(10 * 1024),
       m_txBufferSize(0),
+      m_txStorage(TX_BUFFER_DEQUE),
+      m_txRingHead(0),
+      m_txRingCount(0),
+      m_txHeadRemainder(nullptr, Time(0)),
       m_sequenceNumber(0),
       m_vrUr(0),
       m_vrUx(0),
@@ -37,19 +41,11 @@ NrRlcUm::NrRlcUm()
 {
     NS_LOG_FUNCTION(this);
     m_reassemblingState = WAITING_S0_FULL;
-
-    std::string rlc_ref = std::to_string(reinterpret_cast<uintptr_t>(this));
-    std::string filename = "txbuffer-metrics-" + rlc_ref + ".log";
-    outfile.open(filename);
-    ExportQueueDelay(outfile);
 }
 
 NrRlcUm::~NrRlcUm()
 {
     NS_LOG_FUNCTION(this);
-
-    ExportQueueDelay(outfile);
-    outfile.close();
 }
 
 TypeId
@@ -65,6 +61,15 @@ NrRlcUm::GetTypeId()
                           UintegerValue(10 * 1024),
                           MakeUintegerAccessor(&NrRlcUm::m_maxTxBufferSize),
                           MakeUintegerChecker<uint32_t>())
+            .AddAttribute("TxBufferStorage",
+                          "Storage engine of the transmission buffer: a deque, or a ring "
+                          "with a slot for the remainder of a segmented SDU",
+                          EnumValue(NrRlcUm::TX_BUFFER_DEQUE),
+                          MakeEnumAccessor<TxBufferStorage>(&NrRlcUm::m_txStorage),
+                          MakeEnumChecker(NrRlcUm::TX_BUFFER_DEQUE,
+                                          "TX_BUFFER_DEQUE",
+                                          NrRlcUm::TX_BUFFER_RING,
+                                          "TX_BUFFER_RING"))
             .AddAttribute("ReorderingTimer",
                           "Value of the t-Reordering timer (See section 7.3 of 3GPP TS 36.322)",
                           TimeValue(MilliSeconds(100)),
@@ -115,10 +120,10 @@ NrRlcUm::DoTransmitPdcpPdu(Ptr<Packet> p)
             uint32_t discardTimerMs =
                 (m_discardTimerMs > 0) ? m_discardTimerMs : m_packetDelayBudgetMs;
 
-            if (!m_txBuffer.empty())
+            if (!IsTxBufferEmpty())
             {
                 headOfLineDelayInMs =
-                    (Simulator::Now() - m_txBuffer.begin()->m_waitingSince).GetMilliSeconds();
+                    (Simulator::Now() - GetTxFront().m_waitingSince).GetMilliSeconds();
             }
             NS_LOG_DEBUG("head of line delay in MS:" << headOfLineDelayInMs);
             if (headOfLineDelayInMs > discardTimerMs)
@@ -135,13 +140,10 @@ NrRlcUm::DoTransmitPdcpPdu(Ptr<Packet> p)
         if (!discarded)
         {
             /** Store PDCP PDU */
-            NrRlcSduStatusTag tag;
-            tag.SetStatus(NrRlcSduStatusTag::FULL_SDU);
-            p->AddPacketTag(tag);
-            NS_LOG_INFO("Adding RLC SDU to Tx Buffer after adding NrRlcSduStatusTag: FULL_SDU");
-            m_txBuffer.emplace_back(p, Simulator::Now());
+            NS_LOG_INFO("Adding RLC SDU to Tx Buffer");
+            PushTxBack(p, Simulator::Now());
             m_txBufferSize += p->GetSize();
-            NS_LOG_LOGIC("NumOfBuffers = " << m_txBuffer.size());
+            NS_LOG_LOGIC("NumOfBuffers = " << GetTxBufferSdus());
             NS_LOG_LOGIC("txBufferSize = " << m_txBufferSize);
         }
     }
@@ -187,113 +189,79 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
         return;
     }
 
-    Ptr<Packet> packet = Create<Packet>();
     NrRlcHeader rlcHeader;
 
     // Build Data field
     uint32_t nextSegmentSize = txOpParams.bytes - 2;
     uint32_t nextSegmentId = 1;
     uint32_t dataFieldAddedSize = 0;
-    std::vector<Ptr<Packet>> dataField;
 
     // Remove the first packet from the transmission buffer.
     // If only a segment of the packet is taken, then the remaining is given back later
-    if (m_txBuffer.empty())
+    if (IsTxBufferEmpty())
     {
         NS_LOG_LOGIC("No data pending");
         return;
     }
 
-    Ptr<Packet> firstSegment = m_txBuffer.begin()->m_pdu->Copy();
-    Time firstSegmentTime = m_txBuffer.begin()->m_waitingSince;
+    NS_LOG_LOGIC("SDUs in TxBuffer  = " << GetTxBufferSdus());
+
+    // The SDUs are not copied: the data field refers to them, see NrRlcSegmentView
+    TxPdu first = PopTxFront();
+    Ptr<Packet> firstSdu = first.m_pdu;
+    uint32_t firstOffset = first.m_offset;
+    uint32_t firstSize = first.GetRemainingSize();
+    Time firstSegmentTime = first.m_waitingSince;
 
-    NS_LOG_LOGIC("SDUs in TxBuffer  = " << m_txBuffer.size());
-    NS_LOG_LOGIC("First SDU buffer  = " << firstSegment);
-    NS_LOG_LOGIC("First SDU size    = " << firstSegment->GetSize());
+    NS_LOG_LOGIC("First SDU buffer  = " << firstSdu);
+    NS_LOG_LOGIC("First SDU size    = " << firstSize);
     NS_LOG_LOGIC("Next segment size = " << nextSegmentSize);
     NS_LOG_LOGIC("Remove SDU from TxBuffer");
-    m_txBufferSize -= firstSegment->GetSize();
+    m_txBufferSize -= firstSize;
     NS_LOG_LOGIC("txBufferSize      = " << m_txBufferSize);
-    m_txBuffer.erase(m_txBuffer.begin());
 
-    while (firstSegment && (firstSegment->GetSize() > 0) && (nextSegmentSize > 0))
+    while (firstSdu && (firstSize > 0) && (nextSegmentSize > 0))
     {
         NS_LOG_LOGIC("WHILE ( firstSegment && firstSegment->GetSize > 0 && nextSegmentSize > 0 )");
-        NS_LOG_LOGIC("    firstSegment size = " << firstSegment->GetSize());
+        NS_LOG_LOGIC("    firstSegment size = " << firstSize);
         NS_LOG_LOGIC("    nextSegmentSize   = " << nextSegmentSize);
-        if ((firstSegment->GetSize() > nextSegmentSize) ||
+        if ((firstSize > nextSegmentSize) ||
             // Segment larger than 2047 octets can only be mapped to the end of the Data field
-            (firstSegment->GetSize() > 2047))
+            (firstSize > 2047))
         {
             // Take the minimum size, due to the 2047-bytes 3GPP exception
             // This exception is due to the length of the LI field (just 11 bits)
-            uint32_t currSegmentSize = std::min(firstSegment->GetSize(), nextSegmentSize);
+            uint32_t currSegmentSize = std::min(firstSize, nextSegmentSize);
 
             NS_LOG_LOGIC("    IF ( firstSegment > nextSegmentSize ||");
             NS_LOG_LOGIC("         firstSegment > 2047 )");
 
             // Segment txBuffer.FirstBuffer and
             // Give back the remaining segment to the transmission buffer
-            Ptr<Packet> newSegment = firstSegment->CreateFragment(0, currSegmentSize);
-            NS_LOG_LOGIC("    newSegment size   = " << newSegment->GetSize());
-
-            // Status tag of the new and remaining segments
             // Note: This is the only place where a PDU is segmented and
             // therefore its status can change
-            NrRlcSduStatusTag oldTag;
-            NrRlcSduStatusTag newTag;
-            firstSegment->RemovePacketTag(oldTag);
-            newSegment->RemovePacketTag(newTag);
-            if (oldTag.GetStatus() == NrRlcSduStatusTag::FULL_SDU)
-            {
-                newTag.SetStatus(NrRlcSduStatusTag::FIRST_SEGMENT);
-                oldTag.SetStatus(NrRlcSduStatusTag::LAST_SEGMENT);
-            }
-            else if (oldTag.GetStatus() == NrRlcSduStatusTag::LAST_SEGMENT)
-            {
-                newTag.SetStatus(NrRlcSduStatusTag::MIDDLE_SEGMENT);
-                // oldTag.SetStatus (NrRlcSduStatusTag::LAST_SEGMENT);
-            }
+            m_dataField.emplace_back(firstSdu, firstOffset, currSegmentSize);
+            NS_LOG_LOGIC("    newSegment size   = " << currSegmentSize);
 
             // Give back the remaining segment to the transmission buffer
-            firstSegment->RemoveAtStart(currSegmentSize);
-            NS_LOG_LOGIC(
-                "    firstSegment size (after RemoveAtStart) = " << firstSegment->GetSize());
-            if (firstSegment->GetSize() > 0)
+            firstSize -= currSegmentSize;
+            NS_LOG_LOGIC("    firstSegment size (after segmentation) = " << firstSize);
+            if (firstSize > 0)
             {
-                firstSegment->AddPacketTag(oldTag);
-
-                m_txBuffer.insert(m_txBuffer.begin(), TxPdu(firstSegment, firstSegmentTime));
-                m_txBufferSize += m_txBuffer.begin()->m_pdu->GetSize();
+                PushTxRemainder(firstSdu, firstSegmentTime, firstOffset + currSegmentSize);
+                m_txBufferSize += firstSize;
 
                 NS_LOG_LOGIC("    TX buffer: Give back the remaining segment");
-                NS_LOG_LOGIC("    TX buffers = " << m_txBuffer.size());
-                NS_LOG_LOGIC("    Front buffer size = " << m_txBuffer.begin()->m_pdu->GetSize());
+                NS_LOG_LOGIC("    TX buffers = " << GetTxBufferSdus());
+                NS_LOG_LOGIC("    Front buffer size = " << GetTxFront().GetRemainingSize());
                 NS_LOG_LOGIC("    txBufferSize = " << m_txBufferSize);
             }
-            else
-            {
-                // Whole segment was taken, so adjust tag
-                if (newTag.GetStatus() == NrRlcSduStatusTag::FIRST_SEGMENT)
-                {
-                    newTag.SetStatus(NrRlcSduStatusTag::FULL_SDU);
-                }
-                else if (newTag.GetStatus() == NrRlcSduStatusTag::MIDDLE_SEGMENT)
-                {
-                    newTag.SetStatus(NrRlcSduStatusTag::LAST_SEGMENT);
-                }
-            }
             // Segment is completely taken or
             // the remaining segment is given back to the transmission buffer
-            firstSegment = nullptr;
-
-            // Put status tag once it has been adjusted
-            newSegment->AddPacketTag(newTag);
+            firstSdu = nullptr;
 
             // Add Segment to Data field
-            dataFieldAddedSize = newSegment->GetSize();
-            dataField.push_back(newSegment);
-            newSegment = nullptr;
+            dataFieldAddedSize = currSegmentSize;
 
             // ExtensionBit (Next_Segment - 1) = 0
             rlcHeader.PushExtensionBit(NrRlcHeader::DATA_FIELD_FOLLOWS);
@@ -308,14 +276,14 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
             // (NO more segments) → exit
             // break;
         }
-        else if ((nextSegmentSize - firstSegment->GetSize() <= 2) || m_txBuffer.empty())
+        else if ((nextSegmentSize - firstSize <= 2) || IsTxBufferEmpty())
         {
             NS_LOG_LOGIC(
                 "    IF nextSegmentSize - firstSegment->GetSize () <= 2 || txBuffer.size == 0");
             // Add txBuffer.FirstBuffer to DataField
-            dataFieldAddedSize = firstSegment->GetSize();
-            dataField.push_back(firstSegment);
-            firstSegment = nullptr;
+            dataFieldAddedSize = firstSize;
+            m_dataField.emplace_back(firstSdu, firstOffset, firstSize);
+            firstSdu = nullptr;
 
             // ExtensionBit (Next_Segment - 1) = 0
             rlcHeader.PushExtensionBit(NrRlcHeader::DATA_FIELD_FOLLOWS);
@@ -324,12 +292,11 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
             nextSegmentSize -= dataFieldAddedSize;
             nextSegmentId++;
 
-            NS_LOG_LOGIC("        SDUs in TxBuffer  = " << m_txBuffer.size());
-            if (!m_txBuffer.empty())
+            NS_LOG_LOGIC("        SDUs in TxBuffer  = " << GetTxBufferSdus());
+            if (!IsTxBufferEmpty())
             {
-                NS_LOG_LOGIC("        First SDU buffer  = " << m_txBuffer.begin()->m_pdu);
-                NS_LOG_LOGIC(
-                    "        First SDU size    = " << m_txBuffer.begin()->m_pdu->GetSize());
+                NS_LOG_LOGIC("        First SDU buffer  = " << GetTxFront().m_pdu);
+                NS_LOG_LOGIC("        First SDU size    = " << GetTxFront().GetRemainingSize());
             }
             NS_LOG_LOGIC("        Next segment size = " << nextSegmentSize);
 
@@ -342,33 +309,34 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
         {
             NS_LOG_LOGIC("    IF firstSegment < NextSegmentSize && txBuffer.size > 0");
             // Add txBuffer.FirstBuffer to DataField
-            dataFieldAddedSize = firstSegment->GetSize();
-            dataField.push_back(firstSegment);
+            dataFieldAddedSize = firstSize;
+            m_dataField.emplace_back(firstSdu, firstOffset, firstSize);
 
             // ExtensionBit (Next_Segment - 1) = 1
             rlcHeader.PushExtensionBit(NrRlcHeader::E_LI_FIELDS_FOLLOWS);
 
             // LengthIndicator (Next_Segment)  = txBuffer.FirstBuffer.length()
-            rlcHeader.PushLengthIndicator(firstSegment->GetSize());
+            rlcHeader.PushLengthIndicator(firstSize);
 
             nextSegmentSize -= ((nextSegmentId % 2) ? (2) : (1)) + dataFieldAddedSize;
             nextSegmentId++;
 
-            NS_LOG_LOGIC("        SDUs in TxBuffer  = " << m_txBuffer.size());
-            if (!m_txBuffer.empty())
+            NS_LOG_LOGIC("        SDUs in TxBuffer  = " << GetTxBufferSdus());
+            if (!IsTxBufferEmpty())
             {
-                NS_LOG_LOGIC("        First SDU buffer  = " << m_txBuffer.begin()->m_pdu);
-                NS_LOG_LOGIC(
-                    "        First SDU size    = " << m_txBuffer.begin()->m_pdu->GetSize());
+                NS_LOG_LOGIC("        First SDU buffer  = " << GetTxFront().m_pdu);
+                NS_LOG_LOGIC("        First SDU size    = " << GetTxFront().GetRemainingSize());
             }
             NS_LOG_LOGIC("        Next segment size = " << nextSegmentSize);
             NS_LOG_LOGIC("        Remove SDU from TxBuffer");
 
             // (more segments)
-            firstSegment = m_txBuffer.begin()->m_pdu->Copy();
-            firstSegmentTime = m_txBuffer.begin()->m_waitingSince;
-            m_txBufferSize -= firstSegment->GetSize();
-            m_txBuffer.pop_front();
+            first = PopTxFront();
+            firstSdu = first.m_pdu;
+            firstOffset = first.m_offset;
+            firstSize = first.GetRemainingSize();
+            firstSegmentTime = first.m_waitingSince;
+            m_txBufferSize -= firstSize;
             NS_LOG_LOGIC("        txBufferSize = " << m_txBufferSize);
         }
     }
@@ -376,17 +344,10 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
     // Build RLC header
     rlcHeader.SetSequenceNumber(m_sequenceNumber++);
 
-    // Build RLC PDU with DataField and Header
-    auto it = dataField.begin();
-
     uint8_t framingInfo = 0;
 
     // FIRST SEGMENT
-    NrRlcSduStatusTag tag;
-    NS_ASSERT_MSG((*it)->PeekPacketTag(tag), "NrRlcSduStatusTag is missing");
-    (*it)->PeekPacketTag(tag);
-    if ((tag.GetStatus() == NrRlcSduStatusTag::FULL_SDU) ||
-        (tag.GetStatus() == NrRlcSduStatusTag::FIRST_SEGMENT))
+    if (m_dataField.front().StartsSdu())
     {
         framingInfo |= NrRlcHeader::FIRST_BYTE;
     }
@@ -395,27 +356,8 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
         framingInfo |= NrRlcHeader::NO_FIRST_BYTE;
     }
 
-    while (it < dataField.end())
-    {
-        NS_LOG_LOGIC("Adding SDU/segment to packet, length = " << (*it)->GetSize());
-
-        NS_ASSERT_MSG((*it)->PeekPacketTag(tag), "NrRlcSduStatusTag is missing");
-        (*it)->RemovePacketTag(tag);
-        if (packet->GetSize() > 0)
-        {
-            packet->AddAtEnd(*it);
-        }
-        else
-        {
-            packet = (*it);
-        }
-        it++;
-    }
-
     // LAST SEGMENT (Note: There could be only one and be the first one)
-    it--;
-    if ((tag.GetStatus() == NrRlcSduStatusTag::FULL_SDU) ||
-        (tag.GetStatus() == NrRlcSduStatusTag::LAST_SEGMENT))
+    if (m_dataField.back().EndsSdu())
     {
         framingInfo |= NrRlcHeader::LAST_BYTE;
     }
@@ -426,6 +368,18 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
 
     rlcHeader.SetFramingInfo(framingInfo);
 
+    // Build RLC PDU with DataField and Header: the bytes of the segments
+    // are only materialized here
+    // The PDU is built on a copy: a whole SDU is materialized as itself,
+    // and the upper layers may still hold it
+    Ptr<Packet> packet = m_dataField.front().Materialize()->Copy();
+    for (std::size_t i = 1; i < m_dataField.size(); i++)
+    {
+        NS_LOG_LOGIC("Adding SDU/segment to packet, length = " << m_dataField[i].m_length);
+        packet->AddAtEnd(m_dataField[i].Materialize());
+    }
+    m_dataField.clear();
+
     NS_LOG_LOGIC("RLC header: " << rlcHeader);
     packet->AddHeader(rlcHeader);
 
@@ -446,7 +400,7 @@ NrRlcUm::DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams)
     NS_LOG_INFO("Forward RLC PDU to MAC Layer");
     m_macSapProvider->TransmitPdu(params);
 
-    if (!m_txBuffer.empty())
+    if (!IsTxBufferEmpty())
     {
         m_rbsTimer.Cancel();
         m_rbsTimer = Simulator::Schedule(MilliSeconds(10), &NrRlcUm::ExpireRbsTimer, this);
@@ -1189,12 +1143,12 @@ NrRlcUm::DoReportBufferStatus()
     Time holDelay(0);
     uint32_t queueSize = 0;
 
-    if (!m_txBuffer.empty())
+    if (!IsTxBufferEmpty())
     {
-        holDelay = Simulator::Now() - m_txBuffer.front().m_waitingSince;
+        holDelay = Simulator::Now() - GetTxFront().m_waitingSince;
 
         queueSize =
-            m_txBufferSize + 2 * m_txBuffer.size(); // Data in tx queue + estimated headers size
+            m_txBufferSize + 2 * GetTxBufferSdus(); // Data in tx queue + estimated headers size
     }
 
     NrMacSapProvider::ReportBufferStatusParameters r;
@@ -1210,6 +1164,111 @@ NrRlcUm::DoReportBufferStatus()
     m_macSapProvider->ReportBufferStatus(r);
 }
 
+bool
+NrRlcUm::IsTxBufferEmpty() const
+{
+    if (m_txStorage == TX_BUFFER_RING)
+    {
+        return !m_txHeadRemainder.m_pdu && m_txRingCount == 0;
+    }
+    return m_txBuffer.empty();
+}
+
+uint32_t
+NrRlcUm::GetTxBufferSdus() const
+{
+    if (m_txStorage == TX_BUFFER_RING)
+    {
+        return m_txRingCount + (m_txHeadRemainder.m_pdu ? 1 : 0);
+    }
+    return m_txBuffer.size();
+}
+
+const NrRlcUm::TxPdu&
+NrRlcUm::GetTxFront() const
+{
+    NS_ASSERT(!IsTxBufferEmpty());
+    if (m_txStorage == TX_BUFFER_RING)
+    {
+        return m_txHeadRemainder.m_pdu ? m_txHeadRemainder : m_txRing[m_txRingHead];
+    }
+    return m_txBuffer.front();
+}
+
+NrRlcUm::TxPdu
+NrRlcUm::PopTxFront()
+{
+    NS_ASSERT(!IsTxBufferEmpty());
+    if (m_txStorage == TX_BUFFER_RING)
+    {
+        if (m_txHeadRemainder.m_pdu)
+        {
+            TxPdu front = m_txHeadRemainder;
+            m_txHeadRemainder.m_pdu = nullptr;
+            return front;
+        }
+        TxPdu front = m_txRing[m_txRingHead];
+        // Release the SDU now rather than when its slot is reused
+        m_txRing[m_txRingHead].m_pdu = nullptr;
+        m_txRingHead = (m_txRingHead + 1) & (m_txRing.size() - 1);
+        m_txRingCount--;
+        return front;
+    }
+    TxPdu front = m_txBuffer.front();
+    m_txBuffer.pop_front();
+    return front;
+}
+
+void
+NrRlcUm::PushTxBack(const Ptr<Packet>& sdu, const Time& time)
+{
+    if (m_txStorage == TX_BUFFER_RING)
+    {
+        if (m_txRingCount == m_txRing.size())
+        {
+            GrowTxRing();
+        }
+        TxPdu& slot = m_txRing[(m_txRingHead + m_txRingCount) & (m_txRing.size() - 1)];
+        slot.m_pdu = sdu;
+        slot.m_waitingSince = time;
+        slot.m_offset = 0;
+        m_txRingCount++;
+        return;
+    }
+    m_txBuffer.emplace_back(sdu, time);
+}
+
+void
+NrRlcUm::PushTxRemainder(const Ptr<Packet>& sdu, const Time& time, uint32_t offset)
+{
+    if (m_txStorage == TX_BUFFER_RING)
+    {
+        // Only the SDU popped last can be segmented, so the slot is free
+        NS_ASSERT(!m_txHeadRemainder.m_pdu);
+        m_txHeadRemainder.m_pdu = sdu;
+        m_txHeadRemainder.m_waitingSince = time;
+        m_txHeadRemainder.m_offset = offset;
+        return;
+    }
+    m_txBuffer.emplace_front(sdu, time);
+    m_txBuffer.front().m_offset = offset;
+}
+
+void
+NrRlcUm::GrowTxRing()
+{
+    // The ring starts with 64 slots, and is bounded by MaxTxBufferSize as
+    // each SDU takes at least one byte of it
+    uint32_t size = m_txRing.size();
+    std::vector<TxPdu> ring(size > 0 ? 2 * size : 64, TxPdu(nullptr, Time(0)));
+    for (uint32_t i = 0; i < m_txRingCount; i++)
+    {
+        ring[i] = m_txRing[(m_txRingHead + i) & (size - 1)];
+    }
+    m_txRing.swap(ring);
+    m_txRingHead = 0;
+}
+
 void
 NrRlcUm::ExpireReorderingTimer()
 {
@@ -1254,38 +1313,27 @@ NrRlcUm::ExpireRbsTimer()
 {
     NS_LOG_LOGIC("RBS Timer expires");
 
-    if (!m_txBuffer.empty())
+    if (!IsTxBufferEmpty())
     {
         DoReportBufferStatus();
         m_rbsTimer = Simulator::Schedule(MilliSeconds(10), &NrRlcUm::ExpireRbsTimer, this);
     }
 }
 
-void
-NrRlcUm::ExportQueueDelay(std::ofstream& outfile)
+bool
+NrRlcUm::GetMetrics(NrRlcMetricsRecord& record)
 {
-    if (m_gnbAssociated)
+    if (!IsTxBufferEmpty())
     {
-        NS_LOG_INFO("Exporting current queue delay to file");
-
-        uint64_t headOfLineDelayInMs;
-        if (m_txBuffer.empty())
-            headOfLineDelayInMs = 0;
-        else
-            headOfLineDelayInMs =
-                (Simulator::Now() - m_txBuffer.begin()->m_waitingSince).GetMilliSeconds();
-
-        outfile << "RLC Stats\n"
-                << "MAC credits: " << m_lastMacOpportunity << " bytes\n"
-                << "Queue size: " << m_queueSizeWhenMacOpportunity << " bytes\n"
-                << "Queue delay: " << headOfLineDelayInMs << " ms\n"
-                << "MAC delay: "
-                << (m_macOpportuntyCurrTime - m_macOpportuntyOldTime).GetMilliSeconds() << " ms\n"
-                << "Drops: " << m_drops << " pkts\n"
-                << std::endl;
+        record.holDelayNs = (Simulator::Now() - GetTxFront().m_waitingSince).GetNanoSeconds();
     }
-    // Schedule the next call to ExportQueueDelay
-    Simulator::Schedule(MilliSeconds(5), &NrRlcUm::ExportQueueDelay, this, std::ref(outfile));
+    record.queueBytes = m_queueSizeWhenMacOpportunity;
+    record.macGrantBytes = m_lastMacOpportunity;
+    record.drops = m_drops;
+    record.txQueueSdus = GetTxBufferSdus();
+    record.rnti = m_rnti;
+    record.lcid = m_lcid;
+    return true;
 }
 
 } // namespace ns3
@@ -7,6 +7,7 @@
 #ifndef NR_RLC_UM_H
 #define NR_RLC_UM_H
 
+#include "nr-rlc-segment-view.h"
 #include "nr-rlc-sequence-number.h"
 #include "nr-rlc.h"
 
@@ -14,7 +15,7 @@
 
 #include <deque>
 #include <map>
-#include <fstream>
+#include <vector>
 
 namespace ns3
 {
@@ -25,6 +26,15 @@ namespace ns3
 class NrRlcUm : public NrRlc
 {
   public:
+    /**
+     * \brief Storage engine of the transmission buffer
+     */
+    enum TxBufferStorage
+    {
+        TX_BUFFER_DEQUE, //!< std::deque of SDUs, the remainder of a segmented SDU pushed at front
+        TX_BUFFER_RING,  //!< Power-of-two ring of SDUs plus a slot for the head remainder
+    };
+
     NrRlcUm();
     ~NrRlcUm() override;
     /**
@@ -49,7 +59,7 @@ class NrRlcUm : public NrRlc
     void DoNotifyTxOpportunity(NrMacSapUser::TxOpportunityParameters txOpParams) override;
     void DoNotifyHarqDeliveryFailure() override;
     void DoReceivePdu(NrMacSapUser::ReceivePduParameters rxPduParams) override;
-    void ExportQueueDelay(std::ofstream &outfile); ///< exports queue delay stats to file
+    bool GetMetrics(NrRlcMetricsRecord& record) override;
 
   private:
     /// Expire reordering timer
@@ -102,17 +112,73 @@ class NrRlcUm : public NrRlc
          */
         TxPdu(const Ptr<Packet>& pdu, const Time& time)
             : m_pdu(pdu),
-              m_waitingSince(time)
+              m_waitingSince(time),
+              m_offset(0)
         {
         }
 
         TxPdu() = delete;
 
-        Ptr<Packet> m_pdu;   ///< PDU
+        /**
+         * \returns the number of bytes of the PDU not yet sent
+         */
+        uint32_t GetRemainingSize() const
+        {
+            return m_pdu->GetSize() - m_offset;
+        }
+
+        Ptr<Packet> m_pdu;   ///< PDU, kept whole while it is segmented
         Time m_waitingSince; ///< Layer arrival time
+        uint32_t m_offset;   ///< First byte of the PDU not yet sent
     };
 
-    std::deque<TxPdu> m_txBuffer;               ///< Transmission buffer
+    /**
+     * \returns true if the transmission buffer holds no SDU
+     */
+    bool IsTxBufferEmpty() const;
+
+    /**
+     * \returns the number of SDUs (or remainders of SDUs) in the transmission buffer
+     */
+    uint32_t GetTxBufferSdus() const;
+
+    /**
+     * \returns the first SDU of the transmission buffer, which must not be empty
+     */
+    const TxPdu& GetTxFront() const;
+
+    /**
+     * \brief Remove the first SDU of the transmission buffer, which must not be empty
+     * \returns the removed SDU
+     */
+    TxPdu PopTxFront();
+
+    /**
+     * \brief Append an SDU to the transmission buffer
+     * \param sdu the SDU
+     * \param time the arrival time of the SDU
+     */
+    void PushTxBack(const Ptr<Packet>& sdu, const Time& time);
+
+    /**
+     * \brief Give back the remainder of a segmented SDU to the head of the transmission buffer
+     * \param sdu the whole SDU
+     * \param time the arrival time of the SDU
+     * \param offset the first byte of the SDU not yet sent
+     */
+    void PushTxRemainder(const Ptr<Packet>& sdu, const Time& time, uint32_t offset);
+
+    /// Double the capacity of the transmission ring (TX_BUFFER_RING)
+    void GrowTxRing();
+
+    TxBufferStorage m_txStorage;  ///< Storage engine of the transmission buffer
+    std::deque<TxPdu> m_txBuffer; ///< Transmission buffer (TX_BUFFER_DEQUE)
+    std::vector<TxPdu> m_txRing;  ///< Transmission ring, capacity a power of two (TX_BUFFER_RING)
+    uint32_t m_txRingHead;        ///< Index of the first SDU of the ring
+    uint32_t m_txRingCount;       ///< Number of SDUs in the ring
+    TxPdu m_txHeadRemainder;      ///< Remainder of a segmented SDU, served first (null if none)
+
+    std::vector<NrRlcSegmentView> m_dataField;  ///< Data field of the PDU being built
     std::map<uint16_t, Ptr<Packet>> m_rxBuffer; ///< Reception buffer
     std::vector<Ptr<Packet>> m_reasBuffer;      ///< Reassembling buffer
 
@@ -165,7 +231,6 @@ class NrRlcUm : public NrRlc
     Time m_macOpportuntyOldTime; // Variable to compute delay between MAC requests for packets transmission
     uint32_t m_lastMacOpportunity; ///< Last MAC opportunity in bytes
     uint32_t m_queueSizeWhenMacOpportunity; ///< Queue size when MAC opportunity was received
-    std::ofstream outfile;          ///< destination filename to store queue delay logs
     uint32_t m_drops;            ///< AQM drops
 };
 
@@ -120,6 +120,12 @@ void
 NrRlc::DoDispose()
 {
     NS_LOG_FUNCTION(this);
+    if (m_gnbAssociated)
+    {
+        m_metricsSampler->Unregister(this);
+        m_metricsSampler = nullptr;
+        m_gnbAssociated = 0;
+    }
     delete (m_rlcSapProvider);
     delete (m_macSapUser);
 }
@@ -182,7 +188,19 @@ NrRlc::GetNrMacSapUser()
 
 void
 NrRlc::SetGnbAssociation(){
+    if (m_gnbAssociated)
+    {
+        return;
+    }
     m_gnbAssociated = 1;
+    m_metricsSampler = NrRlcMetricsSampler::Get();
+    m_metricsSampler->Register(this);
+}
+
+bool
+NrRlc::GetMetrics(NrRlcMetricsRecord& /* record */)
+{
+    return false;
 }
 
 ////////////////////////////////////////
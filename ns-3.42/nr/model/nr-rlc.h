@@ -8,6 +8,7 @@
 #define NR_RLC_H
 
 #include "nr-mac-sap.h"
+#include "nr-rlc-metrics.h"
 #include "nr-rlc-sap.h"
 
 #include "ns3/nstime.h"
@@ -98,6 +99,17 @@ class NrRlc : public Object // SimpleRefCount<NrRlc>
 
     void SetGnbAssociation();     ///< sets the gNB association to diferentiate from rlc um in ue
 
+    /**
+     * \brief Fill a metrics sample, called by the NrRlcMetricsSampler
+     *
+     * The sampler sets the time of the sample. The default implementation
+     * has nothing to report.
+     *
+     * \param record the sample to fill
+     * \returns false if the entity has nothing to report
+     */
+    virtual bool GetMetrics(NrRlcMetricsRecord& record);
+
     /**
      * TracedCallback signature for NotifyTxOpportunity events.
      *
@@ -158,7 +170,7 @@ class NrRlc : public Object // SimpleRefCount<NrRlc>
     /**
      * \param cqi
      */
-    void DoSetCqi(uint8_t lcId);
+    virtual void DoSetCqi(uint8_t lcId);
 
     NrMacSapUser* m_macSapUser;         ///< MAC SAP user
     NrMacSapProvider* m_macSapProvider; ///< MAC SAP provider
@@ -183,7 +195,8 @@ class NrRlc : public Object // SimpleRefCount<NrRlc>
      */
     TracedCallback<Ptr<const Packet>> m_txDropTrace;
 
-    bool m_gnbAssociated = 0;
+    bool m_gnbAssociated = 0;                  ///< Whether this entity is registered with the sampler
+    Ptr<NrRlcMetricsSampler> m_metricsSampler; ///< Sampler this entity is registered with
 };
 
 /**
@@ -586,6 +586,24 @@ class QueueDisc : public Object
      */
     void Drop (Ptr<const QueueDiscItem> item, const char* reason);
 
+    /**
+     * \brief Perform the actions required when the queue disc is notified of
+     *        a packet enqueue
+     * \param item item that was enqueued
+     * Subclasses that store packets without internal queues must call this
+     * method for every packet they enqueue.
+     */
+    void PacketEnqueued(Ptr<const QueueDiscItem> item);
+
+    /**
+     * \brief Perform the actions required when the queue disc is notified of
+     *        a packet dequeue
+     * \param item item that was dequeued
+     * Subclasses that store packets without internal queues must call this
+     * method for every packet they dequeue.
+     */
+    void PacketDequeued(Ptr<const QueueDiscItem> item);
+
   private:
     /**
      * This function actually enqueues a packet into the queue disc.
@@ -677,20 +695,6 @@ class QueueDisc : public Object
      */
     bool Transmit(Ptr<QueueDiscItem> item);
 
-    /**
-     * \brief Perform the actions required when the queue disc is notified of
-     *        a packet enqueue
-     * \param item item that was enqueued
-     */
-    void PacketEnqueued(Ptr<const QueueDiscItem> item);
-
-    /**
-     * \brief Perform the actions required when the queue disc is notified of
-     *        a packet dequeue
-     * \param item item that was dequeued
-     */
-    void PacketDequeued(Ptr<const QueueDiscItem> item);
-
     /// Default quota (as in /proc/sys/net/core/dev_weight)
     static const uint32_t DEFAULT_QUOTA = 64;
 
@@ -0,0 +1,134 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "ns3/nr-mac-scheduler-l4s-policy.h"
+#include "ns3/nstime.h"
+#include "ns3/test.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Checks the weights given by NrMacSchedulerL4sPolicy and the order
+ * of the UEs it gives
+ */
+class NrMacSchedulerL4sPolicyTestCase : public TestCase
+{
+  public:
+    NrMacSchedulerL4sPolicyTestCase();
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Give the policy a buffer status report
+     * \param policy the policy
+     * \param rnti the RNTI of the UE
+     * \param lcid the LCID of the logical channel
+     * \param l4sSize the size of the L4S backlog
+     * \param l4sHolDelay the HOL delay of the L4S backlog, in ms
+     */
+    void Report(Ptr<NrMacSchedulerL4sPolicy> policy,
+                uint16_t rnti,
+                uint8_t lcid,
+                uint32_t l4sSize,
+                uint16_t l4sHolDelay);
+};
+
+NrMacSchedulerL4sPolicyTestCase::NrMacSchedulerL4sPolicyTestCase()
+    : TestCase("Check the UE weights and order of the L4S scheduling policy")
+{
+}
+
+void
+NrMacSchedulerL4sPolicyTestCase::Report(Ptr<NrMacSchedulerL4sPolicy> policy,
+                                        uint16_t rnti,
+                                        uint8_t lcid,
+                                        uint32_t l4sSize,
+                                        uint16_t l4sHolDelay)
+{
+    NrMacSapProvider::ReportBufferStatusParameters params;
+    params.rnti = rnti;
+    params.lcid = lcid;
+    params.txQueueSize = l4sSize + 1000;
+    params.txQueueHolDelay = 20;
+    params.l4sTxQueueSize = l4sSize;
+    params.l4sTxQueueHolDelay = l4sHolDelay;
+    params.classicTxQueueSize = 1000;
+    params.classicTxQueueHolDelay = 20;
+    policy->ReportBufferStatus(params);
+}
+
+void
+NrMacSchedulerL4sPolicyTestCase::DoRun()
+{
+    Ptr<NrMacSchedulerL4sPolicy> policy = CreateObject<NrMacSchedulerL4sPolicy>();
+    policy->SetAttribute("DelayBudget", TimeValue(MilliSeconds(5)));
+
+    NS_TEST_EXPECT_MSG_EQ(policy->GetUeWeight(1), 0, "A UE without report should weigh 0");
+
+    // UE 1: Classic backlog only. UE 2: L4S backlog that used up its budget.
+    // UE 3: fresh L4S backlog on one logical channel, older on another one
+    Report(policy, 1, 3, 0, 0);
+    Report(policy, 2, 3, 500, 5);
+    Report(policy, 3, 3, 500, 0);
+    Report(policy, 3, 4, 500, 1);
+
+    NS_TEST_EXPECT_MSG_EQ(policy->GetUeWeight(1), 0, "A UE without L4S backlog should weigh 0");
+    NS_TEST_EXPECT_MSG_EQ_TOL(policy->GetUeWeight(2),
+                              2,
+                              1e-9,
+                              "An L4S backlog that used up its budget should weigh 2");
+    NS_TEST_EXPECT_MSG_EQ_TOL(policy->GetUeWeight(3),
+                              1.2,
+                              1e-9,
+                              "A UE should weigh as its most urgent logical channel");
+
+    NS_TEST_EXPECT_MSG_EQ(policy->CompareUes(2, 3), true, "UE 2 should come before UE 3");
+    NS_TEST_EXPECT_MSG_EQ(policy->CompareUes(3, 2), false, "UE 3 should come after UE 2");
+    NS_TEST_EXPECT_MSG_EQ(policy->CompareUes(3, 1), true, "UE 3 should come before UE 1");
+    NS_TEST_EXPECT_MSG_EQ(policy->CompareUes(1, 1), false, "The order should be strict");
+
+    // A stable sort keeps the round-robin order of the UEs of equal weight
+    Report(policy, 4, 3, 0, 0);
+    std::vector<uint16_t> ues{4, 1, 3, 2};
+    std::stable_sort(ues.begin(), ues.end(), [policy](uint16_t lhs, uint16_t rhs) {
+        return policy->CompareUes(lhs, rhs);
+    });
+    NS_TEST_EXPECT_MSG_EQ((ues == std::vector<uint16_t>{2, 3, 4, 1}),
+                          true,
+                          "The UEs should be ordered by L4S urgency, then in their former order");
+
+    policy->RemoveLc(3, 4);
+    NS_TEST_EXPECT_MSG_EQ_TOL(policy->GetUeWeight(3),
+                              1,
+                              1e-9,
+                              "A released logical channel should no longer count");
+    policy->RemoveUe(2);
+    NS_TEST_EXPECT_MSG_EQ(policy->GetUeWeight(2), 0, "A released UE should weigh 0");
+    NS_TEST_EXPECT_MSG_EQ_TOL(policy->GetUeWeight(3), 1, 1e-9, "Other UEs should be kept");
+}
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Test suite of the L4S scheduling policy
+ */
+class NrMacSchedulerL4sPolicyTestSuite : public TestSuite
+{
+  public:
+    NrMacSchedulerL4sPolicyTestSuite();
+};
+
+NrMacSchedulerL4sPolicyTestSuite::NrMacSchedulerL4sPolicyTestSuite()
+    : TestSuite("nr-mac-scheduler-l4s-policy", Type::UNIT)
+{
+    AddTestCase(new NrMacSchedulerL4sPolicyTestCase(), Duration::QUICK);
+}
+
+static NrMacSchedulerL4sPolicyTestSuite g_nrMacSchedulerL4sPolicyTestSuite; ///< the test suite
@@ -0,0 +1,420 @@
+// Copyright (c) 2011 Centre Tecnologic de Telecomunicacions de Catalunya (CTTC)
+//
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "ns3/boolean.h"
+#include "ns3/drop-tail-queue.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/nr-mac-sap.h"
+#include "ns3/nr-pdcp-header.h"
+#include "ns3/nr-rlc-sap.h"
+#include "ns3/nr-rlc-um-dualpi2.h"
+#include "ns3/nr-rlc-um.h"
+#include "ns3/object-factory.h"
+#include "ns3/packet.h"
+#include "ns3/queue-disc.h"
+#include "ns3/simulator.h"
+#include "ns3/test.h"
+
+using namespace ns3;
+
+/**
+ * \ingroup nr-test
+ *
+ * MAC that counts the PDUs and keeps the last buffer status report
+ */
+class NrRlcUmDualpi2TestMacSapProvider : public NrMacSapProvider
+{
+  public:
+    void TransmitPdu(TransmitPduParameters params) override
+    {
+        m_pdus++;
+    }
+
+    void ReportBufferStatus(ReportBufferStatusParameters params) override
+    {
+        m_report = params;
+    }
+
+    uint32_t m_pdus{0};                    ///< Number of PDUs received
+    ReportBufferStatusParameters m_report; ///< Last buffer status report
+};
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Checks that SDUs held only by the LowerEffort class of a DualQ AQM
+ * are reported to the MAC, have a head of line delay, and are sent
+ */
+class NrRlcUmDualpi2LowerEffortTestCase : public TestCase
+{
+  public:
+    NrRlcUmDualpi2LowerEffortTestCase();
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Give the RLC an SDU with the LE DSCP
+     * \param size the size of the IPv4 payload
+     */
+    void SendLowerEffortSdu(uint32_t size);
+
+    /// Check the head of line delay and give the RLC a TX opportunity
+    void CheckAndTransmit();
+
+    Ptr<NrRlcUmDualpi2> m_rlc;               ///< The RLC entity under test
+    NrRlcUmDualpi2TestMacSapProvider m_mac; ///< The MAC stub
+};
+
+NrRlcUmDualpi2LowerEffortTestCase::NrRlcUmDualpi2LowerEffortTestCase()
+    : TestCase("Check that an RLC holding only LowerEffort SDUs reports and sends them")
+{
+}
+
+void
+NrRlcUmDualpi2LowerEffortTestCase::SendLowerEffortSdu(uint32_t size)
+{
+    Ptr<Packet> p = Create<Packet>(size);
+    Ipv4Header ipHeader;
+    ipHeader.SetPayloadSize(size);
+    ipHeader.SetTos(1 << 2); // DSCP LE (RFC 8622), Not-ECT
+    p->AddHeader(ipHeader);
+    NrPdcpHeader pdcpHeader;
+    pdcpHeader.SetEct(0);
+    p->AddHeader(pdcpHeader);
+
+    NrRlcSapProvider::TransmitPdcpPduParameters params;
+    params.pdcpPdu = p;
+    params.rnti = 1;
+    params.lcid = 3;
+    m_rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+}
+
+void
+NrRlcUmDualpi2LowerEffortTestCase::CheckAndTransmit()
+{
+    NrRlcMetricsRecord record;
+    m_rlc->GetMetrics(record);
+    NS_TEST_EXPECT_MSG_EQ(record.holDelayNs,
+                          MilliSeconds(5).GetNanoSeconds(),
+                          "The LowerEffort SDUs should have waited 5 ms");
+
+    NrMacSapUser::TxOpportunityParameters txOp(m_mac.m_report.txQueueSize, 0, 0, 0, 1, 3);
+    m_rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+    NS_TEST_EXPECT_MSG_EQ(m_mac.m_pdus, 1, "The LowerEffort SDUs should have been sent");
+
+    m_rlc->GetMetrics(record);
+    NS_TEST_EXPECT_MSG_EQ(record.holDelayNs, 0, "The AQM should be empty");
+    m_rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+    NS_TEST_EXPECT_MSG_EQ(m_mac.m_pdus, 1, "There should be nothing left to send");
+}
+
+void
+NrRlcUmDualpi2LowerEffortTestCase::DoRun()
+{
+    m_rlc = CreateObject<NrRlcUmDualpi2>();
+    m_rlc->SetAttribute("LowerEffortClass", BooleanValue(true));
+    // LowerEffortClass applies to the AQMs created afterwards
+    m_rlc->SetAttribute("AqmType",
+                        ObjectFactoryValue(ObjectFactory("ns3::DualQCoupledPiSquareQueueDisc")));
+    m_rlc->SetRnti(1);
+    m_rlc->SetLcId(3);
+    m_rlc->SetNrMacSapProvider(&m_mac);
+
+    SendLowerEffortSdu(100);
+    SendLowerEffortSdu(200);
+    SendLowerEffortSdu(300);
+
+    NS_TEST_EXPECT_MSG_GT(m_mac.m_report.txQueueSize, 600, "The SDUs should be reported");
+    NS_TEST_EXPECT_MSG_EQ(m_mac.m_report.l4sTxQueueSize, 0, "No SDU is L4S");
+    NS_TEST_EXPECT_MSG_EQ(m_mac.m_report.classicTxQueueSize,
+                          m_mac.m_report.txQueueSize,
+                          "The LowerEffort SDUs should be reported with the Classic ones");
+
+    Simulator::Schedule(MilliSeconds(5), &NrRlcUmDualpi2LowerEffortTestCase::CheckAndTransmit, this);
+    Simulator::Run();
+
+    m_rlc->Dispose();
+    m_rlc = nullptr;
+    Simulator::Destroy();
+}
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Checks that the L4S and Classic parts of a buffer status report
+ * add up to its total
+ */
+class NrRlcUmDualpi2BufferStatusTestCase : public TestCase
+{
+  public:
+    NrRlcUmDualpi2BufferStatusTestCase();
+
+  private:
+    void DoRun() override;
+};
+
+NrRlcUmDualpi2BufferStatusTestCase::NrRlcUmDualpi2BufferStatusTestCase()
+    : TestCase("Check that the per-class parts of the buffer status add up to the total")
+{
+}
+
+void
+NrRlcUmDualpi2BufferStatusTestCase::DoRun()
+{
+    NrRlcUmDualpi2TestMacSapProvider mac;
+    Ptr<NrRlcUmDualpi2> rlc = CreateObject<NrRlcUmDualpi2>();
+    rlc->SetRnti(1);
+    rlc->SetLcId(3);
+    rlc->SetNrMacSapProvider(&mac);
+
+    NrRlcSapProvider::TransmitPdcpPduParameters params;
+    params.rnti = 1;
+    params.lcid = 3;
+    NrPdcpHeader pdcpHeader;
+    uint32_t sduSize = 100 + pdcpHeader.GetSerializedSize();
+    for (uint8_t ect : {1, 0, 1, 0, 0})
+    {
+        Ptr<Packet> p = Create<Packet>(100);
+        pdcpHeader.SetEct(ect);
+        p->AddHeader(pdcpHeader);
+        params.pdcpPdu = p;
+        rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+
+        NS_TEST_EXPECT_MSG_EQ(mac.m_report.l4sTxQueueSize + mac.m_report.classicTxQueueSize,
+                              mac.m_report.txQueueSize,
+                              "The parts should add up to the total");
+    }
+    // 2-byte fixed header, 5 SDUs and 12 bits of E and LI fields for 4 of them
+    NS_TEST_EXPECT_MSG_EQ(mac.m_report.txQueueSize, 2 + 5 * sduSize + 6, "Wrong total");
+    NS_TEST_EXPECT_MSG_EQ(mac.m_report.l4sTxQueueSize,
+                          2 * sduSize + 3,
+                          "The L4S part should be its SDUs and their E and LI fields");
+
+    rlc->Dispose();
+    Simulator::Destroy();
+}
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Checks that sending an SDU whole in a PDU leaves the SDU given by
+ * the PDCP unchanged, with NrRlcUm and NrRlcUmDualpi2
+ */
+class NrRlcUmSduIntactTestCase : public TestCase
+{
+  public:
+    NrRlcUmSduIntactTestCase();
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Send two SDUs in one PDU and check them
+     * \param rlc the RLC entity under test
+     */
+    void RunSduIntactTest(Ptr<NrRlc> rlc);
+};
+
+NrRlcUmSduIntactTestCase::NrRlcUmSduIntactTestCase()
+    : TestCase("Check that the RLC does not modify the SDUs it sends whole")
+{
+}
+
+void
+NrRlcUmSduIntactTestCase::RunSduIntactTest(Ptr<NrRlc> rlc)
+{
+    NrRlcUmDualpi2TestMacSapProvider mac;
+    rlc->SetRnti(1);
+    rlc->SetLcId(3);
+    rlc->SetNrMacSapProvider(&mac);
+
+    NrPdcpHeader pdcpHeader;
+    NrRlcSapProvider::TransmitPdcpPduParameters params;
+    params.rnti = 1;
+    params.lcid = 3;
+    Ptr<Packet> sdus[2];
+    for (auto& sdu : sdus)
+    {
+        sdu = Create<Packet>(100);
+        sdu->AddHeader(pdcpHeader);
+        params.pdcpPdu = sdu;
+        rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+    }
+    uint32_t sduSize = sdus[0]->GetSize();
+
+    // 2-byte fixed header, 12 bits of E and LI fields and both SDUs
+    NrMacSapUser::TxOpportunityParameters txOp(2 + 2 + 2 * sduSize, 0, 0, 0, 1, 3);
+    rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+    NS_TEST_EXPECT_MSG_EQ(mac.m_pdus, 1, "Both SDUs should have been sent in one PDU");
+    NS_TEST_EXPECT_MSG_EQ(sdus[0]->GetSize(), sduSize, "The first SDU should be unchanged");
+    NS_TEST_EXPECT_MSG_EQ(sdus[1]->GetSize(), sduSize, "The second SDU should be unchanged");
+
+    rlc->Dispose();
+    Simulator::Destroy();
+}
+
+void
+NrRlcUmSduIntactTestCase::DoRun()
+{
+    RunSduIntactTest(CreateObject<NrRlcUm>());
+    RunSduIntactTest(CreateObject<NrRlcUmDualpi2>());
+}
+
+/**
+ * \ingroup nr-test
+ *
+ * FIFO queue disc that drops the item it dequeues first, as an AQM deciding
+ * at dequeue (e.g., CoDel or PIE) may do
+ */
+class NrRlcUmDualpi2TestDropQueueDisc : public QueueDisc
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId();
+
+  private:
+    bool DoEnqueue(Ptr<QueueDiscItem> item) override;
+    Ptr<QueueDiscItem> DoDequeue() override;
+    bool CheckConfig() override;
+    void InitializeParams() override;
+
+    bool m_dropped{false}; ///< Whether the first dequeued item was dropped
+};
+
+NS_OBJECT_ENSURE_REGISTERED(NrRlcUmDualpi2TestDropQueueDisc);
+
+TypeId
+NrRlcUmDualpi2TestDropQueueDisc::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::NrRlcUmDualpi2TestDropQueueDisc")
+                            .SetParent<QueueDisc>()
+                            .SetGroupName("Test")
+                            .AddConstructor<NrRlcUmDualpi2TestDropQueueDisc>();
+    return tid;
+}
+
+bool
+NrRlcUmDualpi2TestDropQueueDisc::DoEnqueue(Ptr<QueueDiscItem> item)
+{
+    return GetInternalQueue(0)->Enqueue(item);
+}
+
+Ptr<QueueDiscItem>
+NrRlcUmDualpi2TestDropQueueDisc::DoDequeue()
+{
+    Ptr<QueueDiscItem> item = GetInternalQueue(0)->Dequeue();
+    if (item && !m_dropped)
+    {
+        m_dropped = true;
+        DropAfterDequeue(item, "Test drop at dequeue");
+        return nullptr;
+    }
+    return item;
+}
+
+bool
+NrRlcUmDualpi2TestDropQueueDisc::CheckConfig()
+{
+    if (GetNInternalQueues() == 0)
+    {
+        AddInternalQueue(CreateObject<DropTailQueue<QueueDiscItem>>());
+    }
+    return GetNInternalQueues() == 1;
+}
+
+void
+NrRlcUmDualpi2TestDropQueueDisc::InitializeParams()
+{
+}
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Checks that a TX opportunity in which the AQM drops what it
+ * dequeues sends nothing, and that the remaining SDUs are sent afterwards
+ */
+class NrRlcUmDualpi2DropAtDequeueTestCase : public TestCase
+{
+  public:
+    NrRlcUmDualpi2DropAtDequeueTestCase();
+
+  private:
+    void DoRun() override;
+};
+
+NrRlcUmDualpi2DropAtDequeueTestCase::NrRlcUmDualpi2DropAtDequeueTestCase()
+    : TestCase("Check that the RLC sends nothing when its AQM drops at dequeue")
+{
+}
+
+void
+NrRlcUmDualpi2DropAtDequeueTestCase::DoRun()
+{
+    NrRlcUmDualpi2TestMacSapProvider mac;
+    Ptr<NrRlcUmDualpi2> rlc = CreateObject<NrRlcUmDualpi2>();
+    rlc->SetAttribute("AqmType",
+                      ObjectFactoryValue(ObjectFactory("ns3::NrRlcUmDualpi2TestDropQueueDisc")));
+    rlc->SetRnti(1);
+    rlc->SetLcId(3);
+    rlc->SetNrMacSapProvider(&mac);
+
+    NrPdcpHeader pdcpHeader;
+    NrRlcSapProvider::TransmitPdcpPduParameters params;
+    params.rnti = 1;
+    params.lcid = 3;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        Ptr<Packet> p = Create<Packet>(100);
+        p->AddHeader(pdcpHeader);
+        params.pdcpPdu = p;
+        rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+    }
+    uint32_t sduSize = 100 + pdcpHeader.GetSerializedSize();
+    // 2-byte fixed header, both SDUs and 12 bits of E and LI fields
+    NS_TEST_EXPECT_MSG_EQ(mac.m_report.txQueueSize, 2 + 2 * sduSize + 2, "Wrong report");
+
+    NrMacSapUser::TxOpportunityParameters txOp(1000, 0, 0, 0, 1, 3);
+    rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+    NS_TEST_EXPECT_MSG_EQ(mac.m_pdus, 0, "Nothing should be sent when the AQM drops");
+    NS_TEST_EXPECT_MSG_EQ(mac.m_report.txQueueSize,
+                          2 + sduSize,
+                          "The MAC should learn that one SDU is left");
+
+    rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+    NS_TEST_EXPECT_MSG_EQ(mac.m_pdus, 1, "The SDU left should be sent");
+
+    NrRlcMetricsRecord record;
+    rlc->GetMetrics(record);
+    NS_TEST_EXPECT_MSG_EQ(record.drops, 1, "The AQM drop should be counted");
+    NS_TEST_EXPECT_MSG_EQ(record.txQueueSdus, 0, "The AQM should be empty");
+
+    rlc->Dispose();
+    Simulator::Destroy();
+}
+
+/**
+ * \ingroup nr-test
+ *
+ * \brief Test suite of the RLC UM entity with an AQM
+ */
+class NrRlcUmDualpi2TestSuite : public TestSuite
+{
+  public:
+    NrRlcUmDualpi2TestSuite();
+};
+
+NrRlcUmDualpi2TestSuite::NrRlcUmDualpi2TestSuite()
+    : TestSuite("nr-rlc-um-dualpi2", Type::UNIT)
+{
+    AddTestCase(new NrRlcUmDualpi2LowerEffortTestCase(), Duration::QUICK);
+    AddTestCase(new NrRlcUmDualpi2BufferStatusTestCase(), Duration::QUICK);
+    AddTestCase(new NrRlcUmSduIntactTestCase(), Duration::QUICK);
+    AddTestCase(new NrRlcUmDualpi2DropAtDequeueTestCase(), Duration::QUICK);
+}
+
+static NrRlcUmDualpi2TestSuite g_nrRlcUmDualpi2TestSuite; ///< the test suite
@@ -0,0 +1,88 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <chrono>
+#include <iomanip>
+
+/** -------------- Dequeue micro-benchmark --------------
+ *
+ * Fills a DualQCoupledPiSquareQueueDisc with N packets (half L4S, half
+ * Classic) and measures the wall-clock cost of draining it: with the
+ * arrival time kept in a packet tag, with it kept in the item, and with
+ * the built-in ring buffer storage.
+ *
+ * ./ns3 run "dualpi2-dequeue-bench --runs=5"
+ */
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("DualPi2DequeueBench");
+
+double
+RunOnce(uint32_t nPackets, bool useTag, std::string storage, uint32_t pktSize)
+{
+    Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateObject<DualQCoupledPiSquareQueueDisc>();
+    queue->SetAttribute("QueueLimit", UintegerValue(nPackets));
+    queue->SetAttribute("UseTimestampTag", BooleanValue(useTag));
+    queue->SetAttribute("Storage", StringValue(storage));
+    queue->Initialize();
+
+    Address dest;
+    for (uint32_t i = 0; i < nPackets; i++)
+    {
+        Ptr<QueueDiscItem> item;
+        if (i % 2)
+            item = Create<DualQueueL4SQueueDiscItem>(Create<Packet>(pktSize), dest, 0);
+        else
+            item = Create<DualQueueClassicQueueDiscItem>(Create<Packet>(pktSize), dest, 0);
+        queue->Enqueue(item);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t dequeued = 0;
+    while (queue->Dequeue())
+    {
+        dequeued++;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    NS_ABORT_MSG_IF(dequeued != nPackets, "Lost packets while draining the queue");
+    queue->Dispose();
+
+    return std::chrono::duration<double, std::nano>(stop - start).count() / nPackets;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t runs = 3;
+    uint32_t pktSize = 1000;
+
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("runs", "Number of repetitions per configuration", runs);
+    cmd.AddValue("pktSize", "Packet size in bytes", pktSize);
+    cmd.Parse(argc, argv);
+
+    std::cout << std::setw(10) << "packets" << std::setw(16) << "tag ns/pkt" << std::setw(16)
+              << "item ns/pkt" << std::setw(16) << "ring ns/pkt" << std::endl;
+
+    for (uint32_t nPackets : {1000, 10000, 100000})
+    {
+        double tagCost = 0;
+        double itemCost = 0;
+        double ringCost = 0;
+        for (uint32_t r = 0; r < runs; r++)
+        {
+            tagCost += RunOnce(nPackets, true, "STORAGE_INTERNAL_QUEUES", pktSize);
+            itemCost += RunOnce(nPackets, false, "STORAGE_INTERNAL_QUEUES", pktSize);
+            ringCost += RunOnce(nPackets, false, "STORAGE_RING_BUFFER", pktSize);
+        }
+        std::cout << std::setw(10) << nPackets << std::setw(16) << tagCost / runs
+                  << std::setw(16) << itemCost / runs << std::setw(16) << ringCost / runs
+                  << std::endl;
+    }
+
+    Simulator::Destroy();
+    return 0;
+}
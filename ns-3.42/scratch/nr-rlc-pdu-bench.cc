@@ -0,0 +1,130 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/nr-mac-sap.h"
+#include "ns3/nr-pdcp-header.h"
+#include "ns3/nr-rlc-sap.h"
+#include "ns3/nr-rlc-um-dualpi2.h"
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+/** -------------- RLC PDU assembly micro-benchmark --------------
+ *
+ * Feeds an NrRlcUmDualpi2 entity with SDUs and gives it TX opportunities
+ * sized to carry exactly sdusPerPdu of them in one PDU, and measures the
+ * number of TX opportunities served per second of wall-clock time, with
+ * 1, 10 and 50 SDUs per PDU. Only NotifyTxOpportunity is timed.
+ *
+ * ./ns3 run "nr-rlc-pdu-bench --runs=5"
+ */
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("NrRlcPduBench");
+
+/**
+ * MAC that swallows the PDUs and the buffer status reports
+ */
+class BenchMacSapProvider : public NrMacSapProvider
+{
+  public:
+    void TransmitPdu(TransmitPduParameters params) override
+    {
+        m_pdus++;
+    }
+
+    void ReportBufferStatus(ReportBufferStatusParameters params) override
+    {
+    }
+
+    uint64_t m_pdus{0}; ///< Number of PDUs received
+};
+
+double
+RunOnce(uint32_t sdusPerPdu, uint32_t nOpportunities, uint32_t sduSize)
+{
+    BenchMacSapProvider mac;
+    Ptr<NrRlcUmDualpi2> rlc = CreateObject<NrRlcUmDualpi2>();
+    rlc->SetAttribute("MaxTxBufferSize", UintegerValue(2 * sdusPerPdu * (sduSize + 2)));
+    // The DualQ must hold the SDUs of a whole PDU, or it force-drops the excess
+    std::ostringstream aqmType;
+    aqmType << "ns3::DualQCoupledPiSquareQueueDisc[QueueLimit=" << 2 * sdusPerPdu << "]";
+    rlc->SetAttribute("AqmType", StringValue(aqmType.str()));
+    rlc->SetRnti(1);
+    rlc->SetLcId(3);
+    rlc->SetNrMacSapProvider(&mac);
+
+    NrPdcpHeader pdcpHeader;
+    uint32_t pdcpSize = sduSize + pdcpHeader.GetSerializedSize();
+
+    // 2-byte fixed header and 12 bits of E and LI fields per SDU but the last one
+    NrMacSapUser::TxOpportunityParameters txOp(
+        2 + sdusPerPdu * pdcpSize + (12 * (sdusPerPdu - 1) + 7) / 8,
+        0,
+        0,
+        0,
+        1,
+        3);
+
+    double elapsed = 0;
+    for (uint32_t i = 0; i < nOpportunities; i++)
+    {
+        for (uint32_t s = 0; s < sdusPerPdu; s++)
+        {
+            Ptr<Packet> p = Create<Packet>(sduSize);
+            pdcpHeader.SetEct(s % 2);
+            p->AddHeader(pdcpHeader);
+
+            NrRlcSapProvider::TransmitPdcpPduParameters params;
+            params.pdcpPdu = p;
+            params.rnti = 1;
+            params.lcid = 3;
+            rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+        auto stop = std::chrono::steady_clock::now();
+        elapsed += std::chrono::duration<double>(stop - start).count();
+    }
+
+    NS_ABORT_MSG_IF(mac.m_pdus != nOpportunities, "Some TX opportunities produced no PDU");
+    NrRlcMetricsRecord record;
+    rlc->GetMetrics(record);
+    NS_ABORT_MSG_IF(record.drops != 0, "Some SDUs were dropped");
+    rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+    NS_ABORT_MSG_IF(mac.m_pdus != nOpportunities, "Each TX opportunity should drain the AQM");
+    rlc->Dispose();
+    Simulator::Destroy();
+
+    return nOpportunities / elapsed;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t runs = 3;
+    uint32_t opportunities = 20000;
+    uint32_t sduSize = 1000;
+
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("runs", "Number of repetitions per configuration", runs);
+    cmd.AddValue("opportunities", "Number of TX opportunities per run", opportunities);
+    cmd.AddValue("sduSize", "SDU size in bytes, without the PDCP header", sduSize);
+    cmd.Parse(argc, argv);
+
+    std::cout << std::setw(10) << "SDUs/PDU" << std::setw(20) << "TX opportunities/s" << std::endl;
+
+    for (uint32_t sdusPerPdu : {1, 10, 50})
+    {
+        double rate = 0;
+        for (uint32_t r = 0; r < runs; r++)
+        {
+            rate += RunOnce(sdusPerPdu, opportunities, sduSize);
+        }
+        std::cout << std::setw(10) << sdusPerPdu << std::setw(20) << rate / runs << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/nr-mac-sap.h"
+#include "ns3/nr-rlc-sap.h"
+#include "ns3/nr-rlc-um.h"
+
+#include <chrono>
+#include <iomanip>
+
+/** -------------- RLC UM TX buffer micro-benchmark --------------
+ *
+ * Fills an NrRlcUm entity with a backlog of SDUs, then alternates the
+ * arrival of one SDU with a TX opportunity one byte short of an SDU, so
+ * that every PDU segments an SDU and gives its remainder back to the head
+ * of the buffer. As the PDUs also carry the LI field of the remainder,
+ * each pair adds a few bytes to the buffer, so the backlog slowly grows
+ * over a run. MaxTxBufferSize leaves room for every arrival of the run,
+ * and a run aborts if any SDU was dropped. Measures the number of
+ * arrival/TX opportunity pairs served per second of wall-clock time with
+ * the deque and the ring storage of the TX buffer (TxBufferStorage).
+ *
+ * ./ns3 run "nr-rlc-um-txqueue-bench --runs=5 --backlog=10000"
+ */
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("NrRlcUmTxQueueBench");
+
+/**
+ * MAC that swallows the PDUs and the buffer status reports
+ */
+class BenchMacSapProvider : public NrMacSapProvider
+{
+  public:
+    void TransmitPdu(TransmitPduParameters params) override
+    {
+        m_pdus++;
+    }
+
+    void ReportBufferStatus(ReportBufferStatusParameters params) override
+    {
+    }
+
+    uint64_t m_pdus{0}; ///< Number of PDUs received
+};
+
+double
+RunOnce(NrRlcUm::TxBufferStorage storage,
+        uint32_t backlog,
+        uint32_t nOpportunities,
+        uint32_t sduSize)
+{
+    BenchMacSapProvider mac;
+    Ptr<NrRlcUm> rlc = CreateObject<NrRlcUm>();
+    rlc->SetAttribute("TxBufferStorage", EnumValue(storage));
+    // Room for the backlog and for every arrival, should no PDU drain it
+    rlc->SetAttribute("MaxTxBufferSize", UintegerValue((backlog + nOpportunities) * sduSize));
+    rlc->SetRnti(1);
+    rlc->SetLcId(3);
+    rlc->SetNrMacSapProvider(&mac);
+
+    NrRlcSapProvider::TransmitPdcpPduParameters params;
+    params.rnti = 1;
+    params.lcid = 3;
+    for (uint32_t s = 0; s < backlog; s++)
+    {
+        params.pdcpPdu = Create<Packet>(sduSize);
+        rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+    }
+
+    // 2-byte fixed header and one byte short of an SDU for the data field
+    NrMacSapUser::TxOpportunityParameters txOp(1 + sduSize, 0, 0, 0, 1, 3);
+
+    double elapsed = 0;
+    for (uint32_t i = 0; i < nOpportunities; i++)
+    {
+        params.pdcpPdu = Create<Packet>(sduSize);
+
+        auto start = std::chrono::steady_clock::now();
+        rlc->GetNrRlcSapProvider()->TransmitPdcpPdu(params);
+        rlc->GetNrMacSapUser()->NotifyTxOpportunity(txOp);
+        auto stop = std::chrono::steady_clock::now();
+        elapsed += std::chrono::duration<double>(stop - start).count();
+    }
+
+    NS_ABORT_MSG_IF(mac.m_pdus != nOpportunities, "Some TX opportunities produced no PDU");
+    NrRlcMetricsRecord record;
+    rlc->GetMetrics(record);
+    NS_ABORT_MSG_IF(record.drops != 0, "Some SDUs were dropped by the TX buffer");
+    rlc->Dispose();
+    Simulator::Destroy();
+
+    return nOpportunities / elapsed;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t runs = 3;
+    uint32_t backlog = 10000;
+    uint32_t opportunities = 100000;
+    uint32_t sduSize = 100;
+
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("runs", "Number of repetitions per configuration", runs);
+    cmd.AddValue("backlog", "Number of SDUs in the TX buffer", backlog);
+    cmd.AddValue("opportunities", "Number of TX opportunities per run", opportunities);
+    cmd.AddValue("sduSize", "SDU size in bytes", sduSize);
+    cmd.Parse(argc, argv);
+
+    std::cout << std::setw(18) << "TxBufferStorage" << std::setw(20) << "TX opportunities/s"
+              << std::endl;
+
+    for (auto storage : {NrRlcUm::TX_BUFFER_DEQUE, NrRlcUm::TX_BUFFER_RING})
+    {
+        double rate = 0;
+        for (uint32_t r = 0; r < runs; r++)
+        {
+            rate += RunOnce(storage, backlog, opportunities, sduSize);
+        }
+        std::cout << std::setw(18)
+                  << (storage == NrRlcUm::TX_BUFFER_DEQUE ? "TX_BUFFER_DEQUE" : "TX_BUFFER_RING")
+                  << std::setw(20) << rate / runs << std::endl;
+    }
+
+    return 0;
+}
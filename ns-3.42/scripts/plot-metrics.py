@@ -11,13 +11,31 @@ ue_counts = [2, 5, 7, 10]  # Different UE scenarios
 avg_queue_delays_base = []
 avg_buffer_sizes_base = []
 avg_mac_credits_base = []
+avg_marks_base = []
+avg_drops_base = []
 aqm_avg_throughputs = []
 
 avg_queue_delays_other = []
 avg_buffer_sizes_other = []
 avg_mac_credits_other = []
+avg_drops_other = []
 no_aqm_avg_throughputs = []
 
+# Layout of the file written by NrRlcMetricsRing (nr/model/nr-rlc-metrics.h)
+RLC_METRICS_FILE = "nr-rlc-metrics.bin"
+RLC_METRICS_MAGIC = b"NRRLCMET"
+RLC_METRICS_VERSION = 1
+RLC_METRICS_COLUMNS = [
+    ("time_ns", np.int64),
+    ("hol_delay_ns", np.int64),
+    ("queue_bytes", np.uint32),
+    ("mac_grant_bytes", np.uint32),
+    ("marks", np.uint32),
+    ("drops", np.uint32),
+    ("rnti", np.uint16),
+    ("lcid", np.uint8),
+]
+
 def extract_downlink_throughput(file_path):
     downlink_throughputs = []
     with open(file_path, "r") as file:
@@ -39,52 +57,55 @@ def extract_downlink_throughput(file_path):
 
     return np.mean(downlink_throughputs) if downlink_throughputs else 0
 
-def process_rlc_logs(folder_path):
-    """ Process all RLC log files in the given folder and compute average metrics per UE count. """
-    metrics = {"queue_delay": [], "buffer_size": [], "mac_credits": []}
-    
-    all_files = sorted([f for f in os.listdir(folder_path) if f.endswith(".log")])
-
-    for file_name in all_files:
-        file_path = os.path.join(folder_path, file_name)
-
-        queue_delays = []
-        buffer_sizes = []
-        mac_credits = []
-
-        with open(file_path, "r") as file:
-            lines = file.readlines()
+def read_rlc_metrics(file_path):
+    """ Read an RLC metrics file into one numpy array per column. """
+    data = np.memmap(file_path, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data[:16], dtype=np.uint32, offset=8)
+    if bytes(data[:8]) != RLC_METRICS_MAGIC or header[0] != RLC_METRICS_VERSION \
+            or header[1] != len(RLC_METRICS_COLUMNS):
+        raise ValueError(f"{file_path} is not a version {RLC_METRICS_VERSION} RLC metrics file")
+
+    record_size = sum(np.dtype(t).itemsize for _, t in RLC_METRICS_COLUMNS)
+    columns = {name: [] for name, _ in RLC_METRICS_COLUMNS}
+    offset = 16
+    while offset + 8 <= len(data):
+        n = int(np.frombuffer(data, dtype=np.uint32, count=1, offset=offset)[0])
+        block_size = (8 + n * record_size + 7) & ~7
+        if offset + block_size > len(data):
+            print(f"Warning: {file_path} ends with a truncated block")
+            break
+        column_offset = offset + 8
+        for name, dtype in RLC_METRICS_COLUMNS:
+            columns[name].append(np.frombuffer(data, dtype=dtype, count=n, offset=column_offset))
+            column_offset += n * np.dtype(dtype).itemsize
+        offset += block_size
+
+    return {name: np.concatenate(parts) if parts else np.array([], dtype=dtype)
+            for (name, dtype), parts in zip(RLC_METRICS_COLUMNS, columns.values())}
 
-        # Iterate through lines, searching for metric blocks
-        for i in range(len(lines)):
-            line = lines[i].strip()
-
-            if line == "RLC Stats":
-                # Extract MAC credits
-                if "MAC credits:" in lines[i + 1]:
-                    mac_credits.append(int(lines[i + 1].split(":")[1].strip().split()[0]))
-
-                # Extract Queue Size
-                if "Queue size:" in lines[i + 2]:
-                    buffer_sizes.append(int(lines[i + 2].split(":")[1].strip().split()[0]))
-
-                # Extract Queue Delay
-                if "Queue delay:" in lines[i + 3]:
-                    queue_delays.append(int(lines[i + 3].split(":")[1].strip().split()[0]))
-
-        # Store averages per UE log
-        if queue_delays and buffer_sizes and mac_credits:
-            metrics["queue_delay"].append(np.mean(queue_delays))
-            metrics["buffer_size"].append(np.mean(buffer_sizes))
-            metrics["mac_credits"].append(np.mean(mac_credits))
-
-    # Compute final averages across all UEs in this folder
-    if metrics["queue_delay"]:
-        metrics["queue_delay"] = np.mean(metrics["queue_delay"])
-        metrics["buffer_size"] = np.mean(metrics["buffer_size"])
-        metrics["mac_credits"] = np.mean(metrics["mac_credits"])
+def process_rlc_logs(folder_path):
+    """ Process the RLC metrics file in the given folder and compute average metrics per UE count. """
+    metrics = {"queue_delay": [], "buffer_size": [], "mac_credits": [], "marks": [], "drops": []}
+
+    file_path = os.path.join(folder_path, RLC_METRICS_FILE)
+    if os.path.exists(file_path):
+        records = read_rlc_metrics(file_path)
+        bearers = records["rnti"].astype(np.uint32) << 8 | records["lcid"]
+
+        # Average per RLC entity, then across entities
+        for bearer in np.unique(bearers):
+            mask = bearers == bearer
+            metrics["queue_delay"].append(np.mean(records["hol_delay_ns"][mask] // 1000000))
+            metrics["buffer_size"].append(np.mean(records["queue_bytes"][mask]))
+            metrics["mac_credits"].append(np.mean(records["mac_grant_bytes"][mask]))
+            # Marks and drops are cumulative
+            metrics["marks"].append(np.max(records["marks"][mask]))
+            metrics["drops"].append(np.max(records["drops"][mask]))
     else:
-        metrics["queue_delay"], metrics["buffer_size"], metrics["mac_credits"] = 0, 0, 0
+        print(f"Warning: {file_path} not found!")
+
+    for key in metrics:
+        metrics[key] = np.mean(metrics[key]) if metrics[key] else 0
 
     return metrics
 
@@ -112,11 +133,6 @@ def plot_buffer_size_mac_credits(save_folder=None):
     plt.show()
 
 def plot_marks_drops(save_folder=None):
-    # Values extracted from the logs
-    avg_marks_base = [2504, 1760, 1327.85, 1141]
-    avg_drops_base = [272, 185.2, 176.14, 113.8]
-    avg_drops_other = [336, 230.6, 128.3, 105.8]
-
     plt.figure(figsize=(10,6))
     plt.plot(ue_counts, avg_drops_base, marker='s', linestyle='-', label="DualPi2 AQM - Drops", color='b')
     plt.plot(ue_counts, avg_marks_base, marker='s', linestyle='-', label="DualPi2 AQM - Marks", color='purple')
@@ -186,7 +202,9 @@ if __name__ == '__main__':
             avg_queue_delays_base.append(metrics["queue_delay"])
             avg_buffer_sizes_base.append(metrics["buffer_size"])
             avg_mac_credits_base.append(metrics["mac_credits"])
-            
+            avg_marks_base.append(metrics["marks"])
+            avg_drops_base.append(metrics["drops"])
+
             filename = os.path.join(folder_path, f"default-{ue}")
             aqm_avg_throughputs.append(extract_downlink_throughput(filename))
 
@@ -195,6 +213,8 @@ if __name__ == '__main__':
             avg_queue_delays_base.append(0)
             avg_buffer_sizes_base.append(0)
             avg_mac_credits_base.append(0)
+            avg_marks_base.append(0)
+            avg_drops_base.append(0)
     
     # Process no-AQM metrics
     if base_folder_no_aqm:
@@ -205,6 +225,7 @@ if __name__ == '__main__':
                 avg_queue_delays_other.append(metrics["queue_delay"])
                 avg_buffer_sizes_other.append(metrics["buffer_size"])
                 avg_mac_credits_other.append(metrics["mac_credits"])
+                avg_drops_other.append(metrics["drops"])
 
                 filename = os.path.join(folder_path, f"default-{ue}")
                 no_aqm_avg_throughputs.append(extract_downlink_throughput(filename))
@@ -214,6 +235,7 @@ if __name__ == '__main__':
                 avg_queue_delays_other.append(0)
                 avg_buffer_sizes_other.append(0)
                 avg_mac_credits_other.append(0)
+                avg_drops_other.append(0)
     
     plot_buffer_size_mac_credits(save_folder=save_folder)
     plot_marks_drops(save_folder=save_folder)
@@ -20,18 +20,21 @@
  */
 
  #include "math.h"
+ #include <cstring>
  #include "ns3/log.h"
  #include "ns3/enum.h"
  #include "ns3/uinteger.h"
  #include "ns3/double.h"
+ #include "ns3/boolean.h"
  #include "ns3/simulator.h"
  #include "ns3/abort.h"
  #include "ns3/object-factory.h"
  #include "ns3/string.h"
  #include "dual-q-coupled-pi-square-queue-disc.h"
  #include "ns3/drop-tail-queue.h"
- #include "ns3/ipv4.h"
- #include "ns3/ipv4-l3-protocol.h"
+ #include "ns3/header.h"
+ #include "ns3/hash.h"
+ #include "ns3/packet.h"
  
  #define min (a,b)((a) < (b) ? (a) : (b))
  
@@ -40,45 +43,371 @@
  NS_LOG_COMPONENT_DEFINE ("DualQCoupledPiSquareQueueDisc");
  
  /**
-  * L4S Queue Disc Item Implementations
+  * Maximum number of bytes that may precede the IPv4 header of a DualQ item
   */
- DualQueueL4SQueueDiscItem::DualQueueL4SQueueDiscItem (Ptr<Packet> p, const Address & addr, uint16_t protocol)
-   : QueueDiscItem (p, addr, protocol)
+ static const uint32_t DUALQ_MAX_IPV4_HEADER_OFFSET = 16;
+ 
+ /**
+  * Number of leading IPv4 header bytes needed to rewrite the ECN field:
+  * everything up to and including the header checksum
+  */
+ static const uint32_t DUALQ_ECN_PATCH_IPV4_BYTES = 12;
+ 
+ /**
+  * Probability 1 in the fixed-point representation used on the dequeue path
+  */
+ static const uint64_t DUALQ_PROB_ONE = 1ULL << 32;
+ 
+ /**
+  * \brief Opaque header used to write back the leading bytes of a packet
+  *        after the ECN field of its IPv4 header has been rewritten
+  *
+  * Serializing these bytes as they are is much cheaper than reserializing
+  * an Ipv4Header (and any header in front of it).
+  */
+ class DualQEcnPatchHeader : public Header
+ {
+ public:
+   DualQEcnPatchHeader ();
+   /**
+    * \brief Constructor
+    * \param bytes the raw bytes to serialize
+    * \param size the number of raw bytes
+    */
+   DualQEcnPatchHeader (const uint8_t *bytes, uint32_t size);
+   /**
+    * \brief Get the type ID.
+    * \return the object TypeId
+    */
+   static TypeId GetTypeId (void);
+   virtual TypeId GetInstanceTypeId (void) const;
+ 
+   virtual uint32_t GetSerializedSize (void) const;
+   virtual void Serialize (Buffer::Iterator start) const;
+   virtual uint32_t Deserialize (Buffer::Iterator start);
+   virtual void Print (std::ostream &os) const;
+ 
+ private:
+   uint8_t m_bytes[DUALQ_MAX_IPV4_HEADER_OFFSET + DUALQ_ECN_PATCH_IPV4_BYTES]; //!< Raw bytes
+   uint32_t m_size;                                                            //!< Number of raw bytes
+ };
+ 
+ NS_OBJECT_ENSURE_REGISTERED (DualQEcnPatchHeader);
+ 
+ DualQEcnPatchHeader::DualQEcnPatchHeader ()
+   : m_size (0)
  {
  }
  
- DualQueueL4SQueueDiscItem::~DualQueueL4SQueueDiscItem ()
+ DualQEcnPatchHeader::DualQEcnPatchHeader (const uint8_t *bytes, uint32_t size)
+   : m_size (size)
+ {
+   NS_ASSERT (size <= sizeof (m_bytes));
+   memcpy (m_bytes, bytes, size);
+ }
+ 
+ TypeId
+ DualQEcnPatchHeader::GetTypeId (void)
+ {
+   static TypeId tid = TypeId ("ns3::DualQEcnPatchHeader")
+     .SetParent<Header> ()
+     .SetGroupName ("TrafficControl")
+     .AddConstructor<DualQEcnPatchHeader> ()
+   ;
+   return tid;
+ }
+ 
+ TypeId
+ DualQEcnPatchHeader::GetInstanceTypeId (void) const
+ {
+   return GetTypeId ();
+ }
+ 
+ uint32_t
+ DualQEcnPatchHeader::GetSerializedSize (void) const
  {
+   return m_size;
  }
  
  void
- DualQueueL4SQueueDiscItem::AddHeader (void)
+ DualQEcnPatchHeader::Serialize (Buffer::Iterator start) const
  {
+   start.Write (m_bytes, m_size);
  }
  
- bool
- DualQueueL4SQueueDiscItem::Mark (void)
+ uint32_t
+ DualQEcnPatchHeader::Deserialize (Buffer::Iterator start)
+ {
+   start.Read (m_bytes, m_size);
+   return m_size;
+ }
+ 
+ void
+ DualQEcnPatchHeader::Print (std::ostream &os) const
+ {
+   os << "size=" << m_size;
+ }
+ 
+ /**
+  * \brief Incrementally update an Internet checksum after a 16-bit word
+  *        of the checksummed data has changed (RFC 1624, eqn. 3)
+  * \param checksum the current checksum
+  * \param oldWord the old value of the word
+  * \param newWord the new value of the word
+  * \return the updated checksum
+  */
+ static uint16_t
+ DualQUpdateChecksum (uint16_t checksum, uint16_t oldWord, uint16_t newWord)
+ {
+   uint32_t sum = (~checksum & 0xffff) + (~oldWord & 0xffff) + newWord;
+   sum = (sum & 0xffff) + (sum >> 16);
+   sum = (sum & 0xffff) + (sum >> 16);
+   return ~sum & 0xffff;
+ }
+ 
+ /**
+  * \brief Write back the leading bytes of a packet through the headers
+  *        that hold them, as recorded in the packet metadata
+  *
+  * When the packet metadata is enabled (Packet::EnablePrinting or
+  * Packet::EnableChecking), replacing the leading bytes with an opaque
+  * header would break the removal of the real headers by the receiver and
+  * the printing of the packet. Instead, the headers holding these bytes
+  * are created from their TypeId, removed, deserialized from the new bytes
+  * and added back.
+  *
+  * \param packet the packet
+  * \param bytes the new leading bytes
+  * \param size the number of new leading bytes
+  * \return false, leaving the packet untouched, if the leading bytes are
+  *         not all held by whole headers that can be created from their TypeId
+  */
+ static bool
+ DualQRewriteHeaders (Ptr<Packet> packet, const uint8_t *bytes, uint32_t size)
  {
-   Ptr<Packet> m_packet = this->GetPacket();
+   std::vector<Header *> headers;
+   uint32_t covered = 0;
+   bool ok = true;
+   PacketMetadata::ItemIterator it = packet->BeginItem ();
+   while (ok && covered < size && it.HasNext ())
+     {
+       PacketMetadata::Item item = it.Next ();
+       Header *header = nullptr;
+       if (item.type == PacketMetadata::Item::HEADER && !item.isFragment && item.tid.HasConstructor ())
+         {
+           ObjectBase *object = item.tid.GetConstructor () ();
+           header = dynamic_cast<Header *> (object);
+           if (!header)
+             {
+               delete object;
+             }
+         }
+       if (header)
+         {
+           headers.push_back (header);
+           covered += item.currentSize;
+         }
+       ok = (header != nullptr);
+     }
+   ok = ok && covered >= size;
+ 
+   if (ok)
+     {
+       std::vector<uint8_t> patched (covered);
+       packet->CopyData (patched.data (), covered);
+       memcpy (patched.data (), bytes, size);
+       Buffer buffer;
+       buffer.AddAtStart (covered);
+       buffer.Begin ().Write (patched.data (), covered);
+ 
+       Buffer::Iterator start = buffer.Begin ();
+       for (Header *header : headers)
+         {
+           packet->RemoveHeader (*header);
+           start.Next (header->Deserialize (start));
+         }
+       for (auto h = headers.rbegin (); h != headers.rend (); ++h)
+         {
+           packet->AddHeader (**h);
+         }
+     }
+ 
+   for (Header *header : headers)
+     {
+       delete header;
+     }
+   return ok;
+ }
+ 
+ /**
+  * \brief Set the ECN field of the IPv4 header of a packet to CE
+  *
+  * Only the bytes up to the IPv4 header checksum are copied out of the
+  * packet. If the ECN field has to change, the TOS byte is rewritten, the
+  * checksum is patched incrementally (unless checksums are disabled, in
+  * which case it is zero) and the bytes are written back in place of the
+  * original ones. No header is deserialized or reserialized, unless the
+  * packet metadata is enabled, see DualQRewriteHeaders.
+  *
+  * \param packet the packet
+  * \param offset the number of bytes preceding the IPv4 header
+  * \param markNotEct whether a Not-ECT packet should be marked anyway
+  * \return true if the packet carries CE upon return
+  */
+ static bool
+ DualQSetEcnCe (Ptr<Packet> packet, uint32_t offset, bool markNotEct)
+ {
+   if (offset > DUALQ_MAX_IPV4_HEADER_OFFSET)
+     {
+       return false;
+     }
+ 
+   uint8_t bytes[DUALQ_MAX_IPV4_HEADER_OFFSET + DUALQ_ECN_PATCH_IPV4_BYTES];
+   uint32_t size = offset + DUALQ_ECN_PATCH_IPV4_BYTES;
+   if (packet->GetSize () < size || packet->CopyData (bytes, size) != size)
+     {
+       return false;
+     }
  
-   Ipv4Header ipv4Header;
-   if (m_packet->PeekHeader(ipv4Header)) {
-     uint8_t ecn = ipv4Header.GetEcn();
+   uint8_t *ip = bytes + offset;
+   if ((ip[0] >> 4) != 4)
+     {
+       return false;
+     }
  
-     if(ecn == Ipv4Header::ECN_CE) {
+   uint8_t ecn = ip[1] & 0x03;
+   if (ecn == 0x03)
+     {
        return true;
      }
-     else {
-       ipv4Header.SetEcn(Ipv4Header::ECN_CE);
+   if (ecn == 0x00 && !markNotEct)
+     {
+       return false;
+     }
+ 
+   uint16_t oldWord = (ip[0] << 8) | ip[1];
+   ip[1] |= 0x03;
+   uint16_t newWord = (ip[0] << 8) | ip[1];
  
-       // Reinsert the modified header back into the packet
-       m_packet->RemoveHeader(ipv4Header);
-       m_packet->AddHeader(ipv4Header);
+   uint16_t checksum = (ip[10] << 8) | ip[11];
+   if (checksum != 0)
+     {
+       checksum = DualQUpdateChecksum (checksum, oldWord, newWord);
+       ip[10] = checksum >> 8;
+       ip[11] = checksum & 0xff;
+     }
  
+   if (packet->BeginItem ().HasNext () && DualQRewriteHeaders (packet, bytes, size))
+     {
        return true;
      }
-   }
-   return false;
+   packet->RemoveAtStart (size);
+   packet->AddHeader (DualQEcnPatchHeader (bytes, size));
+   return true;
+ }
+ 
+ /**
+  * \brief Hash the 5-tuple of the IPv4 packet carried by a DualQ item
+  *
+  * Hashes the same fields as Ipv4QueueDiscItem::Hash: the addresses, the
+  * protocol and, for unfragmented TCP and UDP packets, the ports.
+  *
+  * \param packet the packet
+  * \param offset the number of bytes preceding the IPv4 header
+  * \param perturbation hash perturbation value
+  * \return the hash, or 0 if the packet carries no IPv4 header
+  */
+ static uint32_t
+ DualQHashFlow (Ptr<const Packet> packet, uint32_t offset, uint32_t perturbation)
+ {
+   if (offset > DUALQ_MAX_IPV4_HEADER_OFFSET)
+     {
+       return 0;
+     }
+ 
+   // Largest IPv4 header followed by the ports
+   uint8_t bytes[DUALQ_MAX_IPV4_HEADER_OFFSET + 60 + 4];
+   uint32_t size = packet->CopyData (bytes, sizeof (bytes));
+   if (size < offset + 20)
+     {
+       return 0;
+     }
+ 
+   const uint8_t *ip = bytes + offset;
+   if ((ip[0] >> 4) != 4)
+     {
+       return 0;
+     }
+   uint32_t ihl = (ip[0] & 0x0f) * 4;
+   uint8_t protocol = ip[9];
+   bool firstFragment = (((ip[6] & 0x1f) << 8) | ip[7]) == 0;
+ 
+   uint8_t buf[17];
+   memcpy (buf, ip + 12, 8);
+   buf[8] = protocol;
+   memset (buf + 9, 0, 4);
+   if ((protocol == 6 || protocol == 17) && firstFragment && size >= offset + ihl + 4)
+     {
+       memcpy (buf + 9, ip + ihl, 4);
+     }
+   memcpy (buf + 13, &perturbation, 4);
+ 
+   return Hash32 ((const char *) buf, sizeof (buf));
+ }
+ 
+ /**
+  * \brief Read the DS field of the IPv4 packet carried by a DualQ item
+  *
+  * \param packet the packet
+  * \param offset the number of bytes preceding the IPv4 header
+  * \param value the DS field (DSCP and ECN)
+  * \return false if the packet carries no IPv4 header
+  */
+ static bool
+ DualQGetDsField (Ptr<const Packet> packet, uint32_t offset, uint8_t &value)
+ {
+   if (offset > DUALQ_MAX_IPV4_HEADER_OFFSET)
+     {
+       return false;
+     }
+ 
+   uint8_t bytes[DUALQ_MAX_IPV4_HEADER_OFFSET + 2];
+   uint32_t size = offset + 2;
+   if (packet->GetSize () < size || packet->CopyData (bytes, size) != size)
+     {
+       return false;
+     }
+   if ((bytes[offset] >> 4) != 4)
+     {
+       return false;
+     }
+   value = bytes[offset + 1];
+   return true;
+ }
+ 
+ /**
+  * L4S Queue Disc Item Implementations
+  */
+ DualQueueL4SQueueDiscItem::DualQueueL4SQueueDiscItem (Ptr<Packet> p, const Address & addr, uint16_t protocol)
+   : QueueDiscItem (p, addr, protocol),
+     m_ipv4HeaderOffset (0),
+     m_segmentOffset (0)
+ {
+ }
+ 
+ DualQueueL4SQueueDiscItem::~DualQueueL4SQueueDiscItem ()
+ {
+ }
+ 
+ void
+ DualQueueL4SQueueDiscItem::AddHeader (void)
+ {
+ }
+ 
+ bool
+ DualQueueL4SQueueDiscItem::Mark (void)
+ {
+   return DualQSetEcnCe (GetPacket (), m_ipv4HeaderOffset, true);
  }
  
  bool
@@ -87,11 +416,60 @@
    return true;
  }
  
+ uint32_t
+ DualQueueL4SQueueDiscItem::Hash (uint32_t perturbation) const
+ {
+   return DualQHashFlow (GetPacket (), m_ipv4HeaderOffset, perturbation);
+ }
+ 
+ bool
+ DualQueueL4SQueueDiscItem::GetUint8Value (Uint8Values field, uint8_t &value) const
+ {
+   return field == IP_DSFIELD && DualQGetDsField (GetPacket (), m_ipv4HeaderOffset, value);
+ }
+ 
+ void
+ DualQueueL4SQueueDiscItem::SetIpv4HeaderOffset (uint32_t offset)
+ {
+   m_ipv4HeaderOffset = offset;
+ }
+ 
+ uint32_t
+ DualQueueL4SQueueDiscItem::GetIpv4HeaderOffset (void) const
+ {
+   return m_ipv4HeaderOffset;
+ }
+ 
+ void
+ DualQueueL4SQueueDiscItem::SetSegmentOffset (uint32_t offset)
+ {
+   NS_ASSERT_MSG (offset <= GetPacket ()->GetSize (), "Segment offset beyond the packet");
+   m_segmentOffset = offset;
+   if (offset > 0)
+     {
+       m_ipv4HeaderOffset = DUALQ_NO_IPV4_HEADER;
+     }
+ }
+ 
+ uint32_t
+ DualQueueL4SQueueDiscItem::GetSegmentOffset (void) const
+ {
+   return m_segmentOffset;
+ }
+ 
+ uint32_t
+ DualQueueL4SQueueDiscItem::GetSize (void) const
+ {
+   return GetPacket ()->GetSize () - m_segmentOffset;
+ }
+ 
  /**
   * Classic Queue Disc Item Implementations
   */
  DualQueueClassicQueueDiscItem::DualQueueClassicQueueDiscItem (Ptr<Packet> p, const Address & addr, uint16_t protocol)
-   : QueueDiscItem (p, addr, protocol)
+   : QueueDiscItem (p, addr, protocol),
+     m_ipv4HeaderOffset (0),
+     m_segmentOffset (0)
  {
  }
  
@@ -105,32 +483,63 @@
  }
  
  bool 
- DualQueueClassicQueueDiscItem::Mark (void) {
-   Ptr<Packet> m_packet = this->GetPacket();
- 
-   Ipv4Header ipv4Header;
-   if (m_packet->PeekHeader(ipv4Header)) {
-     
-     // Check if ECN is enabled (NotECT packets cannot be marked)
-     if (ipv4Header.GetEcn() == ns3::Ipv4Header::ECN_NotECT)
-       return false;
+ DualQueueClassicQueueDiscItem::Mark (void)
+ {
+   // Not-ECT packets cannot be marked
+   return DualQSetEcnCe (GetPacket (), m_ipv4HeaderOffset, false);
+ }
  
-     ipv4Header.SetEcn(Ipv4Header::ECN_CE);
+ bool
+ DualQueueClassicQueueDiscItem::IsL4S (void)
+ {
+   return false;
+ }
  
-     // Reinsert the modified header back into the packet
-     m_packet->RemoveHeader(ipv4Header);
-     m_packet->AddHeader(ipv4Header);
+ uint32_t
+ DualQueueClassicQueueDiscItem::Hash (uint32_t perturbation) const
+ {
+   return DualQHashFlow (GetPacket (), m_ipv4HeaderOffset, perturbation);
+ }
  
-     return true; // Packet marked successfully
-   }
+ bool
+ DualQueueClassicQueueDiscItem::GetUint8Value (Uint8Values field, uint8_t &value) const
+ {
+   return field == IP_DSFIELD && DualQGetDsField (GetPacket (), m_ipv4HeaderOffset, value);
+ }
  
-   return false;
+ void
+ DualQueueClassicQueueDiscItem::SetIpv4HeaderOffset (uint32_t offset)
+ {
+   m_ipv4HeaderOffset = offset;
  }
  
- bool
- DualQueueClassicQueueDiscItem::IsL4S (void)
+ uint32_t
+ DualQueueClassicQueueDiscItem::GetIpv4HeaderOffset (void) const
  {
-   return false;
+   return m_ipv4HeaderOffset;
+ }
+ 
+ void
+ DualQueueClassicQueueDiscItem::SetSegmentOffset (uint32_t offset)
+ {
+   NS_ASSERT_MSG (offset <= GetPacket ()->GetSize (), "Segment offset beyond the packet");
+   m_segmentOffset = offset;
+   if (offset > 0)
+     {
+       m_ipv4HeaderOffset = DUALQ_NO_IPV4_HEADER;
+     }
+ }
+ 
+ uint32_t
+ DualQueueClassicQueueDiscItem::GetSegmentOffset (void) const
+ {
+   return m_segmentOffset;
+ }
+ 
+ uint32_t
+ DualQueueClassicQueueDiscItem::GetSize (void) const
+ {
+   return GetPacket ()->GetSize () - m_segmentOffset;
  }
  
  class DualQCoupledPiSquareTimestampTag : public Tag
@@ -275,6 +684,113 @@
                     UintegerValue (2),
                     MakeUintegerAccessor (&DualQCoupledPiSquareQueueDisc::m_k),
                     MakeUintegerChecker<uint32_t> ())
+     .AddAttribute ("UseTimestampTag",
+                    "Store the arrival time in a packet tag (legacy) instead of the queue disc item",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&DualQCoupledPiSquareQueueDisc::m_useTimestampTag),
+                    MakeBooleanChecker ())
+     .AddAttribute ("Storage",
+                    "Packet storage engine: internal DropTail queues or built-in ring buffers",
+                    EnumValue (STORAGE_INTERNAL_QUEUES),
+                    MakeEnumAccessor<StorageMode> (&DualQCoupledPiSquareQueueDisc::m_storage),
+                    MakeEnumChecker (STORAGE_INTERNAL_QUEUES, "STORAGE_INTERNAL_QUEUES",
+                                     STORAGE_RING_BUFFER, "STORAGE_RING_BUFFER"))
+     .AddAttribute ("CheckBacklog",
+                    "Check the backlog counters against the packet storage on every enqueue/dequeue (debug)",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&DualQCoupledPiSquareQueueDisc::m_checkBacklog),
+                    MakeBooleanChecker ())
+     .AddAttribute ("MaxInteriorSize",
+                    "Size above which an item can only end a DequeueBurst batch, as accounted by GetBurstBytes",
+                    UintegerValue (0xffffffff),
+                    MakeUintegerAccessor (&DualQCoupledPiSquareQueueDisc::m_maxInteriorSize),
+                    MakeUintegerChecker<uint32_t> ())
+     .AddAttribute ("Controller",
+                    "Probability controller: the PI2 of the early DualQ drafts, or the DualPI2 of RFC 9332",
+                    EnumValue (CONTROLLER_LEGACY),
+                    MakeEnumAccessor<ControllerMode> (&DualQCoupledPiSquareQueueDisc::m_controller),
+                    MakeEnumChecker (CONTROLLER_LEGACY, "CONTROLLER_LEGACY",
+                                     CONTROLLER_RFC9332, "CONTROLLER_RFC9332"))
+     .AddAttribute ("Rfc9332Alpha",
+                    "Integral gain of the RFC 9332 controller, in Hz (applied once per Tupdate)",
+                    DoubleValue (0.16),
+                    MakeDoubleAccessor (&DualQCoupledPiSquareQueueDisc::m_rfcAlpha),
+                    MakeDoubleChecker<double> (0))
+     .AddAttribute ("Rfc9332Beta",
+                    "Proportional gain of the RFC 9332 controller, in Hz (applied once per Tupdate)",
+                    DoubleValue (3.2),
+                    MakeDoubleAccessor (&DualQCoupledPiSquareQueueDisc::m_rfcBeta),
+                    MakeDoubleChecker<double> (0))
+     .AddAttribute ("L4SMinThreshold",
+                    "Sojourn time at which the native L4S ramp starts marking",
+                    TimeValue (MicroSeconds (800)),
+                    MakeTimeAccessor (&DualQCoupledPiSquareQueueDisc::m_rampMinThreshold),
+                    MakeTimeChecker ())
+     .AddAttribute ("L4SRange",
+                    "Width of the native L4S ramp (0 for a step at L4SMinThreshold)",
+                    TimeValue (MicroSeconds (400)),
+                    MakeTimeAccessor (&DualQCoupledPiSquareQueueDisc::m_rampRange),
+                    MakeTimeChecker ())
+     .AddAttribute ("L4SRamp",
+                    "Mark L4S packets with the native ramp instead of the L4SMarkThresold step "
+                    "with the legacy controller (the RFC 9332 controller always uses the ramp)",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&DualQCoupledPiSquareQueueDisc::m_l4sRamp),
+                    MakeBooleanChecker ())
+     .AddAttribute ("FixedPoint",
+                    "Run the probability update in integer time steps and 2^-32 fixed-point probabilities, "
+                    "and draw the mark/drop decisions from a xorshift generator seeded by the rng stream",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&DualQCoupledPiSquareQueueDisc::m_fixedPoint),
+                    MakeBooleanChecker ())
+     .AddAttribute ("LazyUpdate",
+                    "Apply the probability updates due every Tupdate at the next enqueue/dequeue "
+                    "instead of running a periodic timer",
+                    BooleanValue (false),
+                    MakeBooleanAccessor (&DualQCoupledPiSquareQueueDisc::m_lazyUpdate),
+                    MakeBooleanChecker ())
+     .AddAttribute ("QueueDelayEstimator",
+                    "How the queue delay is obtained: from the arrival timestamps, from the departure rate, "
+                    "or from the timestamps with the departure rate as a fallback when they read zero",
+                    EnumValue (QUEUE_DELAY_TIMESTAMP),
+                    MakeEnumAccessor<QueueDelayEstimator> (&DualQCoupledPiSquareQueueDisc::m_delayEstimator),
+                    MakeEnumChecker (QUEUE_DELAY_TIMESTAMP, "QUEUE_DELAY_TIMESTAMP",
+                                     QUEUE_DELAY_DEPARTURE_RATE, "QUEUE_DELAY_DEPARTURE_RATE",
+                                     QUEUE_DELAY_TIMESTAMP_OR_RATE, "QUEUE_DELAY_TIMESTAMP_OR_RATE"))
+     .AddAttribute ("DequeueThreshold",
+                    "Minimum number of bytes dequeued in a departure rate measurement cycle",
+                    UintegerValue (10000),
+                    MakeUintegerAccessor (&DualQCoupledPiSquareQueueDisc::m_dqThreshold),
+                    MakeUintegerChecker<uint32_t> (1))
+     .AddAttribute ("DequeueRateWeight",
+                    "Weight of the previous average in the departure rate EWMA",
+                    DoubleValue (0.5),
+                    MakeDoubleAccessor (&DualQCoupledPiSquareQueueDisc::m_dqRateWeight),
+                    MakeDoubleChecker<double> (0, 1))
+     .AddAttribute ("MarkingPoint",
+                    "Where the mark/drop decisions are taken: at dequeue on the sojourn of the packet, "
+                    "at enqueue on the sojourn of the head of its queue, or L4S at enqueue and Classic at dequeue",
+                    EnumValue (MARK_ON_DEQUEUE),
+                    MakeEnumAccessor<MarkingPoint> (&DualQCoupledPiSquareQueueDisc::m_markingPoint),
+                    MakeEnumChecker (MARK_ON_DEQUEUE, "MARK_ON_DEQUEUE",
+                                     MARK_ON_ENQUEUE, "MARK_ON_ENQUEUE",
+                                     MARK_HYBRID, "MARK_HYBRID"))
+     .AddTraceSource ("EnqueueMark",
+                      "A packet was marked at enqueue",
+                      MakeTraceSourceAccessor (&DualQCoupledPiSquareQueueDisc::m_enqueueMarkTrace),
+                      "ns3::DualQCoupledPiSquareQueueDisc::MarkTracedCallback")
+     .AddTraceSource ("DequeueMark",
+                      "A packet was marked at dequeue",
+                      MakeTraceSourceAccessor (&DualQCoupledPiSquareQueueDisc::m_dequeueMarkTrace),
+                      "ns3::DualQCoupledPiSquareQueueDisc::MarkTracedCallback")
+     .AddTraceSource ("DequeueRate",
+                      "A departure rate measurement cycle ended",
+                      MakeTraceSourceAccessor (&DualQCoupledPiSquareQueueDisc::m_dequeueRateTrace),
+                      "ns3::DualQCoupledPiSquareQueueDisc::DequeueRateTracedCallback")
+     .AddTraceSource ("DequeueBurst",
+                      "A batch of items was dequeued by DequeueBurst",
+                      MakeTraceSourceAccessor (&DualQCoupledPiSquareQueueDisc::m_dequeueBurstTrace),
+                      "ns3::DualQCoupledPiSquareQueueDisc::BurstTracedCallback")
    ;
  
    return tid;
@@ -285,8 +801,19 @@
  {
    NS_LOG_FUNCTION (this);
    m_uv = CreateObject<UniformRandomVariable> ();
-   m_rtrsEvent = Simulator::Schedule (m_sUpdate, &DualQCoupledPiSquareQueueDisc::CalculateP, this);
-   m_queueSizeBytes = 0;
+   m_prngState = 0;
+   m_targetScale = 1;
+   m_nClasses = 2;
+   m_lastDequeuedClass = 0;
+   m_nLargeItems = 0;
+   for (uint32_t q = 0; q < DUALQ_MAX_CLASSES; q++)
+     {
+       m_dqCount[q] = 0;
+       m_inMeasurement[q] = false;
+       m_avgDqRate[q] = 0;
+       m_backlog[q] = {0, 0};
+       ResetRing (m_rings[q], 1);
+     }
  }
  
  DualQCoupledPiSquareQueueDisc::~DualQCoupledPiSquareQueueDisc ()
@@ -300,6 +827,12 @@
    NS_LOG_FUNCTION (this);
    m_uv = 0;
    Simulator::Remove (m_rtrsEvent);
+   for (uint32_t q = 0; q < m_nClasses; q++)
+     {
+       ResetRing (m_rings[q], 1);
+       m_headSegments[q] = nullptr;
+     }
+   m_classifier = MakeNullCallback<uint32_t, Ptr<QueueDiscItem> > ();
    QueueDisc::DoDispose ();
  }
  
@@ -314,7 +847,12 @@
  DualQCoupledPiSquareQueueDisc::GetQueueSizeBytes (void)
  {
    NS_LOG_FUNCTION (this);
-   return m_queueSizeBytes;
+   int bytes = 0;
+   for (uint32_t q = 0; q < m_nClasses; q++)
+     {
+       bytes += m_backlog[q].bytes;
+     }
+   return bytes;
  }
  
  DualQCoupledPiSquareQueueDisc::QueueDiscMode
@@ -335,76 +873,134 @@
  DualQCoupledPiSquareQueueDisc::GetQueueSize (void)
  {
    NS_LOG_FUNCTION (this);
-   if (GetMode () == QUEUE_DISC_MODE_BYTES)
+   uint32_t size = 0;
+   if (m_mode == QUEUE_DISC_MODE_BYTES)
      {
-       NS_ASSERT(GetInternalQueue (0)->GetNBytes () >= 0);
-       NS_ASSERT(GetInternalQueue (1)->GetNBytes () >= 0);
-       
-       return (GetInternalQueue (0)->GetNBytes () + GetInternalQueue (1)->GetNBytes ());
+       for (uint32_t q = 0; q < m_nClasses; q++)
+         {
+           size += m_backlog[q].bytes;
+         }
      }
-   else if (GetMode () == QUEUE_DISC_MODE_PACKETS)
+   else if (m_mode == QUEUE_DISC_MODE_PACKETS)
      {
-       NS_ASSERT(GetInternalQueue (0)->GetNPackets () >= 0);
-       NS_ASSERT(GetInternalQueue (1)->GetNPackets () >= 0);
- 
-       return (GetInternalQueue (0)->GetNPackets () + GetInternalQueue (1)->GetNPackets ());
+       for (uint32_t q = 0; q < m_nClasses; q++)
+         {
+           size += m_backlog[q].packets;
+         }
      }
    else
      {
        NS_ABORT_MSG ("Unknown Dual Queue PI Square mode.");
      }
+   return size;
  }
  
- DualQCoupledPiSquareQueueDisc::Stats
- DualQCoupledPiSquareQueueDisc::GetStats ()
+ DualQCoupledPiSquareQueueDisc::Backlog
+ DualQCoupledPiSquareQueueDisc::GetL4SBacklog (void) const
  {
-   NS_LOG_FUNCTION (this);
-   return m_stats;
+   return m_backlog[1];
  }
  
- Time
- DualQCoupledPiSquareQueueDisc::GetQueueDelay (void)
+ DualQCoupledPiSquareQueueDisc::Backlog
+ DualQCoupledPiSquareQueueDisc::GetClassicBacklog (void) const
  {
-     NS_LOG_FUNCTION(this);
+   return m_backlog[0];
+ }
  
-     Ptr<const QueueDiscItem> item1;
-     Ptr<const QueueDiscItem> item2;
-     Time classicQueueTime;
-     Time l4sQueueTime;
-     DualQCoupledPiSquareTimestampTag tag1;
-     DualQCoupledPiSquareTimestampTag tag2;
+ DualQCoupledPiSquareQueueDisc::Backlog
+ DualQCoupledPiSquareQueueDisc::GetClassBacklog (uint32_t q) const
+ {
+   NS_ASSERT_MSG (q < m_nClasses, "No class " << q);
+   return m_backlog[q];
+ }
  
-     if ((item1 = GetInternalQueue(0)->Peek()))
-     {
-         item1->GetPacket()->PeekPacketTag(tag1);
-         classicQueueTime = tag1.GetTxTime();
-     }
-     else
-     {
-         classicQueueTime = Time(Seconds(0));
-     }
+ Time
+ DualQCoupledPiSquareQueueDisc::GetClassHeadArrival (uint32_t q) const
+ {
+   NS_ASSERT_MSG (q < m_nClasses, "No class " << q);
+   return GetHeadArrivalTime (q);
+ }
  
-     if ((item2 = GetInternalQueue(1)->Peek()))
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::AddClass (Time target, double coupling, Time bias)
+ {
+   NS_LOG_FUNCTION (this << target << coupling << bias);
+   NS_ABORT_MSG_IF (IsInitialized (), "Classes must be added before the queue disc is initialized");
+   NS_ABORT_MSG_IF (m_nClasses == DUALQ_MAX_CLASSES, "At most " << DUALQ_MAX_CLASSES << " classes");
+   m_classes.push_back ({target, coupling, bias});
+   return m_nClasses++;
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::GetNClasses (void) const
+ {
+   return m_nClasses;
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::SetClassifier (Classifier classifier)
+ {
+   NS_LOG_FUNCTION (this);
+   m_classifier = classifier;
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::ClassifyLowerEffort (Ptr<QueueDiscItem> item)
+ {
+   uint8_t dsField;
+   if (item->GetUint8Value (QueueItem::IP_DSFIELD, dsField))
      {
-         item2->GetPacket()->PeekPacketTag(tag2);
-         l4sQueueTime = tag2.GetTxTime();
+       // LE (RFC 8622) and CS1, the former scavenger codepoint
+       uint8_t dscp = dsField >> 2;
+       if (dscp == 1 || dscp == 8)
+         {
+           return 2;
+         }
      }
-     else
+   return item->IsL4S () ? 1 : 0;
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::Classify (Ptr<QueueDiscItem> item)
+ {
+   if (m_classifier.IsNull ())
      {
-         l4sQueueTime = Time(Seconds(0));
+       return item->IsL4S () ? 1 : 0;
      }
+   uint32_t q = m_classifier (item);
+   NS_ABORT_MSG_IF (q >= m_nClasses, "The classifier returned class " << q << " out of " << m_nClasses);
+   return q;
+ }
+ 
+ DualQCoupledPiSquareQueueDisc::Stats
+ DualQCoupledPiSquareQueueDisc::GetStats ()
+ {
+   NS_LOG_FUNCTION (this);
+   return m_stats;
+ }
  
-     if (classicQueueTime >= l4sQueueTime)
-         return classicQueueTime;
+ Time
+ DualQCoupledPiSquareQueueDisc::GetQueueDelay (void)
+ {
+     NS_LOG_FUNCTION(this);
  
-     else
-         return l4sQueueTime;
+     Time queueTime = EstimateHeadArrival (0, Simulator::Now ());
+     for (uint32_t q = 1; q < m_nClasses; q++)
+       {
+         Time classQueueTime = EstimateHeadArrival (q, Simulator::Now ());
+         if (classQueueTime > queueTime)
+           {
+             queueTime = classQueueTime;
+           }
+       }
+     return queueTime;
  }
  
  double
  DualQCoupledPiSquareQueueDisc::GetDropProb (void)
  {
    NS_LOG_FUNCTION (this);
+   CatchUpProb ();
    return m_dropProb;
  }
  
@@ -413,19 +1009,330 @@
  {
    NS_LOG_FUNCTION (this << stream);
    m_uv->SetStream (stream);
+   m_prngState = 0;
    return 1;
  }
  
+ Time
+ DualQCoupledPiSquareQueueDisc::GetArrivalTime (Ptr<const QueueDiscItem> item) const
+ {
+   if (m_useTimestampTag)
+     {
+       DualQCoupledPiSquareTimestampTag tag;
+       item->GetPacket ()->PeekPacketTag (tag);
+       return tag.GetTxTime ();
+     }
+   return item->GetTimeStamp ();
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::ResetRing (DualQRing &ring, uint32_t capacity)
+ {
+   uint32_t size = 1;
+   while (size < capacity)
+     {
+       size <<= 1;
+     }
+   ring.items.assign (size, nullptr);
+   ring.arrivals.assign (size, 0);
+   ring.sizes.assign (size, 0);
+   ring.head = 0;
+   ring.count = 0;
+   ring.mask = size - 1;
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::GrowRing (DualQRing &ring)
+ {
+   uint32_t size = ring.mask + 1;
+   std::vector<Ptr<QueueDiscItem> > items (2 * size);
+   std::vector<int64_t> arrivals (2 * size);
+   std::vector<uint32_t> sizes (2 * size);
+   for (uint32_t i = 0; i < ring.count; i++)
+     {
+       uint32_t idx = (ring.head + i) & ring.mask;
+       items[i] = ring.items[idx];
+       arrivals[i] = ring.arrivals[idx];
+       sizes[i] = ring.sizes[idx];
+     }
+   ring.items.swap (items);
+   ring.arrivals.swap (arrivals);
+   ring.sizes.swap (sizes);
+   ring.head = 0;
+   ring.mask = 2 * size - 1;
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::GetNPacketsIn (uint32_t q) const
+ {
+   return m_backlog[q].packets;
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::GetNBytesIn (uint32_t q) const
+ {
+   return m_backlog[q].bytes;
+ }
+ 
+ Time
+ DualQCoupledPiSquareQueueDisc::GetHeadArrivalTime (uint32_t q) const
+ {
+   if (m_headSegments[q])
+     {
+       return m_headSegmentArrivals[q];
+     }
+   return GetStoredHeadArrival (q);
+ }
+ 
+ Ptr<const QueueDiscItem>
+ DualQCoupledPiSquareQueueDisc::PeekIn (uint32_t q) const
+ {
+   if (m_headSegments[q])
+     {
+       return m_headSegments[q];
+     }
+   return PeekStored (q);
+ }
+ 
+ bool
+ DualQCoupledPiSquareQueueDisc::EnqueueIn (uint32_t q, Ptr<QueueDiscItem> item)
+ {
+   uint32_t size = item->GetSize ();
+   if (!StoreItem (q, item))
+     {
+       return false;
+     }
+ 
+   m_backlog[q].packets++;
+   m_backlog[q].bytes += size;
+   m_nLargeItems += (size > m_maxInteriorSize);
+   if (m_checkBacklog)
+     {
+       CheckBacklog ();
+     }
+   return true;
+ }
+ 
+ Ptr<QueueDiscItem>
+ DualQCoupledPiSquareQueueDisc::DequeueFrom (uint32_t q)
+ {
+   Ptr<QueueDiscItem> item;
+   uint32_t size;
+   if (m_headSegments[q])
+     {
+       // Already accounted as dequeued by the base class the first time
+       item = m_headSegments[q];
+       size = item->GetSize ();
+       m_headSegments[q] = nullptr;
+     }
+   else
+     {
+       item = ExtractItem (q, size);
+       if (!item)
+         {
+           return nullptr;
+         }
+     }
+ 
+   m_backlog[q].packets--;
+   m_backlog[q].bytes -= size;
+   m_nLargeItems -= (size > m_maxInteriorSize);
+   m_lastDequeuedClass = q;
+   if (m_delayEstimator != QUEUE_DELAY_TIMESTAMP)
+     {
+       UpdateDequeueRate (q, size);
+     }
+   if (m_checkBacklog)
+     {
+       CheckBacklog ();
+     }
+   return item;
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::UpdateDequeueRate (uint32_t q, uint32_t size)
+ {
+   Time now = Simulator::Now ();
+   // Start a measurement cycle once the queue has built up, as PIE does
+   if (!m_inMeasurement[q] && m_backlog[q].bytes + size >= m_dqThreshold)
+     {
+       m_dqStart[q] = now;
+       m_dqCount[q] = 0;
+       m_inMeasurement[q] = true;
+     }
+   if (!m_inMeasurement[q])
+     {
+       return;
+     }
+ 
+   m_dqCount[q] += size;
+   // A whole grant is dequeued at once: the cycle only ends once time has
+   // passed since it started
+   if (m_dqCount[q] < m_dqThreshold || now <= m_dqStart[q])
+     {
+       return;
+     }
+ 
+   double sample = m_dqCount[q] / (now - m_dqStart[q]).GetSeconds ();
+   m_avgDqRate[q] = (m_avgDqRate[q] == 0) ? sample : m_dqRateWeight * m_avgDqRate[q] + (1 - m_dqRateWeight) * sample;
+   m_dequeueRateTrace (q, sample, m_avgDqRate[q]);
+   NS_LOG_LOGIC ("Queue " << q << " departure rate sample " << sample << " B/s, average " << m_avgDqRate[q] << " B/s");
+ 
+   // Restart a measurement cycle if there is enough data
+   m_dqStart[q] = now;
+   m_dqCount[q] = 0;
+   m_inMeasurement[q] = m_backlog[q].bytes > m_dqThreshold;
+ }
+ 
+ Time
+ DualQCoupledPiSquareQueueDisc::EstimateHeadArrival (uint32_t q, Time now) const
+ {
+   Time arrival = GetHeadArrivalTime (q);
+   if (m_delayEstimator == QUEUE_DELAY_TIMESTAMP || GetNPacketsIn (q) == 0 || m_avgDqRate[q] == 0)
+     {
+       return arrival;
+     }
+   if (m_delayEstimator == QUEUE_DELAY_TIMESTAMP_OR_RATE && arrival < now)
+     {
+       return arrival;
+     }
+   // Sojourn time of the head estimated as backlog / departure rate
+   return now - Seconds (m_backlog[q].bytes / m_avgDqRate[q]);
+ }
+ 
+ Time
+ DualQCoupledPiSquareQueueDisc::GetStoredHeadArrival (uint32_t q) const
+ {
+   if (m_storage == STORAGE_RING_BUFFER)
+     {
+       const DualQRing &ring = m_rings[q];
+       return ring.count ? TimeStep (ring.arrivals[ring.head]) : Time (Seconds (0));
+     }
+   Ptr<const QueueDiscItem> item = GetInternalQueue (q)->Peek ();
+   return item ? GetArrivalTime (item) : Time (Seconds (0));
+ }
+ 
+ Ptr<const QueueDiscItem>
+ DualQCoupledPiSquareQueueDisc::PeekStored (uint32_t q) const
+ {
+   if (m_storage == STORAGE_RING_BUFFER)
+     {
+       const DualQRing &ring = m_rings[q];
+       if (ring.count == 0)
+         {
+           return nullptr;
+         }
+       return ring.items[ring.head];
+     }
+   return GetInternalQueue (q)->Peek ();
+ }
+ 
+ bool
+ DualQCoupledPiSquareQueueDisc::StoreItem (uint32_t q, Ptr<QueueDiscItem> item)
+ {
+   if (m_storage != STORAGE_RING_BUFFER)
+     {
+       return GetInternalQueue (q)->Enqueue (item);
+     }
+ 
+   DualQRing &ring = m_rings[q];
+   if (ring.count > ring.mask)
+     {
+       GrowRing (ring);
+     }
+   uint32_t tail = (ring.head + ring.count) & ring.mask;
+   ring.items[tail] = item;
+   ring.arrivals[tail] = Simulator::Now ().GetTimeStep ();
+   ring.sizes[tail] = item->GetSize ();
+   ring.count++;
+   PacketEnqueued (item);
+   return true;
+ }
+ 
+ Ptr<QueueDiscItem>
+ DualQCoupledPiSquareQueueDisc::ExtractItem (uint32_t q, uint32_t &size)
+ {
+   Ptr<QueueDiscItem> item;
+   if (m_storage != STORAGE_RING_BUFFER)
+     {
+       item = GetInternalQueue (q)->Dequeue ();
+       size = item ? item->GetSize () : 0;
+       return item;
+     }
+ 
+   DualQRing &ring = m_rings[q];
+   if (ring.count == 0)
+     {
+       size = 0;
+       return nullptr;
+     }
+   item = ring.items[ring.head];
+   size = ring.sizes[ring.head];
+   ring.items[ring.head] = nullptr;
+   ring.head = (ring.head + 1) & ring.mask;
+   ring.count--;
+   PacketDequeued (item);
+   return item;
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::GetStoredBacklog (uint32_t q, uint32_t &packets, uint32_t &bytes) const
+ {
+   if (m_storage == STORAGE_RING_BUFFER)
+     {
+       const DualQRing &ring = m_rings[q];
+       packets = ring.count;
+       bytes = 0;
+       for (uint32_t i = 0; i < ring.count; i++)
+         {
+           bytes += ring.sizes[(ring.head + i) & ring.mask];
+         }
+     }
+   else
+     {
+       packets = GetInternalQueue (q)->GetNPackets ();
+       bytes = GetInternalQueue (q)->GetNBytes ();
+     }
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::CheckBacklog (void) const
+ {
+   for (uint32_t q = 0; q < m_nClasses; q++)
+     {
+       uint32_t packets;
+       uint32_t bytes;
+       GetStoredBacklog (q, packets, bytes);
+       if (m_headSegments[q])
+         {
+           packets++;
+           bytes += m_headSegments[q]->GetSize ();
+         }
+       NS_ABORT_MSG_IF (packets != m_backlog[q].packets,
+                        "Queue " << q << " holds " << packets << " packets, counter says " << m_backlog[q].packets);
+       NS_ABORT_MSG_IF (bytes != m_backlog[q].bytes,
+                        "Queue " << q << " holds " << bytes << " bytes, counter says " << m_backlog[q].bytes);
+     }
+ }
+ 
  bool
  DualQCoupledPiSquareQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
  {
    NS_LOG_FUNCTION (this << item);
-   bool queueNumber;
+   uint32_t queueNumber;
  
-   // attach arrival time to packet
-   Ptr<Packet> p = item->GetPacket ();
-   DualQCoupledPiSquareTimestampTag tag;
-   p->AddPacketTag (tag);
+   CatchUpProb ();
+ 
+   // attach arrival time to the item (or to the packet, in legacy mode)
+   if (m_useTimestampTag)
+     {
+       DualQCoupledPiSquareTimestampTag tag;
+       item->GetPacket ()->AddPacketTag (tag);
+     }
+   else
+     {
+       item->SetTimeStamp (Simulator::Now ());
+     }
  
    uint32_t nQueued = GetQueueSize ();
    if ((GetMode () == QUEUE_DISC_MODE_PACKETS && nQueued >= m_queueLimit)
@@ -438,54 +1345,174 @@
      }
    else
      {
-       if (item->IsL4S ())
-         {
-           NS_LOG_INFO("Enqueuing L4S packet");
-           queueNumber = 1;
-         }
-       else
+       queueNumber = Classify (item);
+       NS_LOG_INFO ("Enqueuing packet in queue-number " << queueNumber);
+     }
+ 
+   if (DecidesAtEnqueue (queueNumber))
+     {
+       // The item is expected to wait about as long as the head of its queue
+       Time headArrival = GetHeadArrivalTime (queueNumber);
+       int64_t sojourn = GetNPacketsIn (queueNumber) ? Simulator::Now ().GetTimeStep () - headArrival.GetTimeStep () : 0;
+       if (!Decide (queueNumber, item, sojourn, true))
          {
-           NS_LOG_INFO("Enqueuing Classic packet");
-           queueNumber = 0;
+           return false;
          }
      }
  
-   m_queueSizeBytes += item->GetSize ();
-   bool retval = GetInternalQueue (queueNumber)->Enqueue (item);
-   NS_LOG_INFO ("Number packets in queue-number " << (int) queueNumber << ": " << GetInternalQueue (queueNumber)->GetNPackets ());
-   NS_LOG_INFO ("Number packets in queue-number " << (int) !queueNumber << ": " << GetInternalQueue (!queueNumber)->GetNPackets ());
+   bool retval = EnqueueIn (queueNumber, item);
+   NS_LOG_INFO ("Number packets in queue-number " << queueNumber << ": " << GetNPacketsIn (queueNumber));
    return retval;
  }
  
  void
  DualQCoupledPiSquareQueueDisc::InitializeParams (void)
  {
-   m_tShift = 2 * m_classicQueueDelayRef;
-   m_alphaU = m_alpha * m_tUpdate.GetSeconds ();
-   m_betaU = m_beta * m_tUpdate.GetSeconds ();
+   // Values from the attributes, SetTargetScale () is relative to them
+   m_targetScale = 1;
+   m_baseClassicQueueDelayRef = m_classicQueueDelayRef;
+   m_baseL4sThreshold = m_l4sThreshold;
+   m_baseRampMinThreshold = m_rampMinThreshold;
+   m_baseRampRange = m_rampRange;
+   m_baseAlpha = m_alpha;
+   m_baseBeta = m_beta;
+   m_baseRfcAlpha = m_rfcAlpha;
+   m_baseRfcBeta = m_rfcBeta;
+   UpdateControlParams ();
    m_minL4SLength = 2 * m_meanPktSize;
    m_dropProb = 0.0;
+   m_classicDropProb = 0.0;
+   m_l4sDropProb = 0.0;
+   // p_Cmax = min (1/k^2, 1)
+   m_classicMaxProb = (m_k > 1) ? 1.0 / (m_k * m_k) : 1.0;
+   m_l4sDropProbFixed = 0;
+   m_dropProbFixed = 0;
+   m_classicDropProbFixed = 0;
    m_qDelayOld = Time (Seconds (0));
    m_stats.forcedDrop = 0;
    m_stats.unforcedClassicDrop = 0;
    m_stats.unforcedClassicMark = 0;
    m_stats.unforcedL4SMark = 0;
+   m_stats.unforcedL4SDrop = 0;
+   m_stats.enqueueClassicDrop = 0;
+   m_stats.enqueueClassicMark = 0;
+   m_stats.enqueueL4SMark = 0;
+   m_stats.enqueueL4SDrop = 0;
+   m_stats.unforcedOtherMark = 0;
+   m_stats.unforcedOtherDrop = 0;
+   for (uint32_t q = 0; q < m_nClasses; q++)
+     {
+       m_dqStart[q] = Time (Seconds (0));
+       m_dqCount[q] = 0;
+       m_inMeasurement[q] = false;
+       m_avgDqRate[q] = 0;
+     }
+ 
+   // Start the updates only now that Supdate and Tupdate are set
+   if (m_lazyUpdate)
+     {
+       m_nextUpdate = Simulator::Now () + m_sUpdate;
+     }
+   else
+     {
+       m_rtrsEvent = Simulator::Schedule (m_sUpdate, &DualQCoupledPiSquareQueueDisc::CalculateP, this);
+     }
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::UpdateControlParams (void)
+ {
+   m_tShift = 2 * m_classicQueueDelayRef;
+   m_alphaU = m_alpha * m_tUpdate.GetSeconds ();
+   m_betaU = m_beta * m_tUpdate.GetSeconds ();
+   // Gains of the fixed-point PI update, in units of 2^-48 per time step
+   double stepsPerSecond = static_cast<double> (Seconds (1).GetTimeStep ());
+   double alpha = (m_controller == CONTROLLER_RFC9332) ? m_rfcAlpha : m_alphaU;
+   double beta = (m_controller == CONTROLLER_RFC9332) ? m_rfcBeta : m_betaU;
+   m_alphaFixed = static_cast<int64_t> (alpha * 281474976710656.0 / stepsPerSecond + 0.5);
+   m_betaFixed = static_cast<int64_t> (beta * 281474976710656.0 / stepsPerSecond + 0.5);
+   // The ramp is evaluated as (sojourn - minTh) * slope, in units of 2^-32
+   m_rampMinTs = m_rampMinThreshold.GetTimeStep ();
+   m_rampMaxTs = (m_rampMinThreshold + m_rampRange).GetTimeStep ();
+   m_rampSlope = (m_rampMaxTs > m_rampMinTs) ? DUALQ_PROB_ONE / (m_rampMaxTs - m_rampMinTs) : 0;
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::SetTargetScale (double scale)
+ {
+   NS_LOG_FUNCTION (this << scale);
+   NS_ABORT_MSG_IF (scale <= 0, "The target scale must be positive");
+   // Updates due before now are taken with the previous targets
+   CatchUpProb ();
+   m_targetScale = scale;
+   m_classicQueueDelayRef = Seconds (m_baseClassicQueueDelayRef.GetSeconds () * scale);
+   m_l4sThreshold = Seconds (m_baseL4sThreshold.GetSeconds () * scale);
+   m_rampMinThreshold = Seconds (m_baseRampMinThreshold.GetSeconds () * scale);
+   m_rampRange = Seconds (m_baseRampRange.GetSeconds () * scale);
+   m_alpha = m_baseAlpha / scale;
+   m_beta = m_baseBeta / scale;
+   m_rfcAlpha = m_baseRfcAlpha / scale;
+   m_rfcBeta = m_baseRfcBeta / scale;
+   UpdateControlParams ();
+ }
+ 
+ double
+ DualQCoupledPiSquareQueueDisc::GetTargetScale (void) const
+ {
+   return m_targetScale;
+ }
+ 
+ Time
+ DualQCoupledPiSquareQueueDisc::GetL4SThreshold (void) const
+ {
+   return m_l4sThreshold;
  }
  
  void DualQCoupledPiSquareQueueDisc::CalculateP ()
  {
    NS_LOG_FUNCTION (this);
+   UpdateProb (Simulator::Now ());
+   m_rtrsEvent = Simulator::Schedule (m_tUpdate, &DualQCoupledPiSquareQueueDisc::CalculateP, this);
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::CatchUpProb (void)
+ {
+   if (!m_lazyUpdate)
+     {
+       return;
+     }
+   NS_LOG_FUNCTION (this);
+   Time now = Simulator::Now ();
+ 
+   // The queue has not changed since the last enqueue/dequeue, so the
+   // Classic head seen at each missed update is the current one
+   while (m_nextUpdate <= now)
+     {
+       if (GetNPacketsIn (0) == 0 && m_dropProb == 0 && m_qDelayOld.IsZero ())
+         {
+           // Idle: every remaining update leaves the probability at zero
+           int64_t n = (now - m_nextUpdate).GetTimeStep () / m_tUpdate.GetTimeStep () + 1;
+           m_nextUpdate += TimeStep (n * m_tUpdate.GetTimeStep ());
+           break;
+         }
+       UpdateProb (m_nextUpdate);
+       m_nextUpdate += m_tUpdate;
+     }
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::UpdateProb (Time now)
+ {
+   NS_LOG_FUNCTION (this << now);
  
    // Use queuing time of first-in Classic packet
-   Ptr<const QueueDiscItem> item;
    Time qDelay;
    bool updateProb = true;
  
-   if ((item = GetInternalQueue (0)->Peek ()))
+   if (GetNPacketsIn (0) > 0)
      {
-       DualQCoupledPiSquareTimestampTag tag;
-       item->GetPacket ()->PeekPacketTag (tag);
-       qDelay = Simulator::Now () - tag.GetTxTime ();
+       qDelay = now - EstimateHeadArrival (0, now);
      }
    else
      {
@@ -494,121 +1521,485 @@
  
    // If qdelay is zero and qlen is not, it means qlen is very small,
    // less than dequeue_rate, so we do not update probabilty in this round
-   if (qDelay.IsZero() && GetQueueSize () > 0)
+   // (legacy controller only)
+   if (m_controller == CONTROLLER_LEGACY && qDelay.IsZero() && GetQueueSize () > 0)
      {
-       m_rtrsEvent = Simulator::Schedule (m_tUpdate, &DualQCoupledPiSquareQueueDisc::CalculateP, this);
        return;
      }
-   double delta = m_alphaU * (qDelay.GetSeconds () - m_classicQueueDelayRef.GetSeconds ()) +
-     m_betaU * (qDelay.GetSeconds () - m_qDelayOld.GetSeconds ());
  
-   m_dropProb += delta;
- 
-   // Non-linear drop in probability: Reduce drop probability quickly if delay
-   // is 0 for 2 consecutive Tupdate periods
-   if ((qDelay.IsZero()) && (m_qDelayOld.IsZero()) && updateProb)
+   if (m_fixedPoint)
+     {
+       UpdateProbFixed (qDelay.GetTimeStep ());
+     }
+   else if (m_controller == CONTROLLER_RFC9332)
      {
-       m_dropProb = (m_dropProb * 0.98);
+       // RFC 9332, Figure 4: base PI update of p', then p_CL = k * p' and
+       // p_C = p'^2, without the heuristics of the legacy controller
+       m_dropProb += m_rfcAlpha * (qDelay - m_classicQueueDelayRef).GetSeconds ()
+         + m_rfcBeta * (qDelay - m_qDelayOld).GetSeconds ();
      }
+   else
+     {
+       double delta = m_alphaU * (qDelay.GetSeconds () - m_classicQueueDelayRef.GetSeconds ()) +
+         m_betaU * (qDelay.GetSeconds () - m_qDelayOld.GetSeconds ());
  
-   m_dropProb = (m_dropProb > 0) ? m_dropProb : 0;
-   m_dropProb = (m_dropProb < 1) ? m_dropProb : 1;
+       m_dropProb += delta;
  
-   m_l4sDropProb = m_dropProb * m_k;
-   m_classicDropProb = m_dropProb * m_dropProb;
+       // Non-linear drop in probability: Reduce drop probability quickly if delay
+       // is 0 for 2 consecutive Tupdate periods
+       if ((qDelay.IsZero()) && (m_qDelayOld.IsZero()) && updateProb)
+         {
+           m_dropProb = (m_dropProb * 0.98);
+         }
+     }
+ 
+   if (!m_fixedPoint)
+     {
+       m_dropProb = (m_dropProb > 0) ? m_dropProb : 0;
+       m_dropProb = (m_dropProb < 1) ? m_dropProb : 1;
+ 
+       m_l4sDropProb = m_dropProb * m_k;
+       m_classicDropProb = m_dropProb * m_dropProb;
+       m_l4sDropProbFixed = (m_l4sDropProb < 1) ? static_cast<uint64_t> (m_l4sDropProb * DUALQ_PROB_ONE) : DUALQ_PROB_ONE;
+       m_classicDropProbFixed = static_cast<uint64_t> (m_classicDropProb * DUALQ_PROB_ONE);
+     }
    m_qDelayOld = qDelay;
-   m_rtrsEvent = Simulator::Schedule (m_tUpdate, &DualQCoupledPiSquareQueueDisc::CalculateP, this);
    
    NS_LOG_INFO(this << " Finished computing drop probility: " << m_classicDropProb);
  }
  
+ void
+ DualQCoupledPiSquareQueueDisc::UpdateProbFixed (int64_t qDelay)
+ {
+   NS_LOG_FUNCTION (this << qDelay);
+   int64_t target = m_classicQueueDelayRef.GetTimeStep ();
+   int64_t qDelayOld = m_qDelayOld.GetTimeStep ();
+ 
+   // Gains are in units of 2^-48 per time step
+   int64_t prob = static_cast<int64_t> (m_dropProbFixed)
+     + m_alphaFixed * (qDelay - target) / 65536
+     + m_betaFixed * (qDelay - qDelayOld) / 65536;
+ 
+   if (m_controller == CONTROLLER_LEGACY && qDelay == 0 && qDelayOld == 0)
+     {
+       // prob * 0.98
+       prob -= prob / 50;
+     }
+ 
+   prob = (prob > 0) ? prob : 0;
+   prob = (prob < static_cast<int64_t> (DUALQ_PROB_ONE)) ? prob : DUALQ_PROB_ONE;
+   m_dropProbFixed = prob;
+   m_l4sDropProbFixed = (m_dropProbFixed * m_k < DUALQ_PROB_ONE) ? m_dropProbFixed * m_k : DUALQ_PROB_ONE;
+   m_classicDropProbFixed = (m_dropProbFixed < DUALQ_PROB_ONE) ? (m_dropProbFixed * m_dropProbFixed) >> 32 : DUALQ_PROB_ONE;
+ 
+   // Floating point view, for GetDropProb () and the overload check
+   m_dropProb = static_cast<double> (m_dropProbFixed) / DUALQ_PROB_ONE;
+   m_l4sDropProb = m_dropProb * m_k;
+   m_classicDropProb = m_dropProb * m_dropProb;
+ }
+ 
  Ptr<QueueDiscItem>
  DualQCoupledPiSquareQueueDisc::DoDequeue ()
  {
    NS_LOG_FUNCTION (this);
-   Ptr<const QueueDiscItem> item1;
-   Ptr<const QueueDiscItem> item2;
-   Time classicQueueTime;
-   Time l4sQueueTime;
-   DualQCoupledPiSquareTimestampTag tag1;
-   DualQCoupledPiSquareTimestampTag tag2;
+ 
+   CatchUpProb ();
  
    while (GetQueueSize () > 0)
      {
-       if ((item1 = GetInternalQueue (0)->Peek ()))
+       uint32_t q = SelectClass ();
+       if (m_headSegments[q])
          {
-           item1->GetPacket ()->PeekPacketTag (tag1);
-           classicQueueTime = tag1.GetTxTime ();
+           // The mark/drop decision was taken for the first segment
+           return DequeueFrom (q);
          }
-       else
+       Ptr<QueueDiscItem> item = DequeueFrom (q);
+       if (!DecidesAtEnqueue (q)
+           && !Decide (q, item, Simulator::Now ().GetTimeStep () - GetArrivalTime (item).GetTimeStep (), false))
          {
-           classicQueueTime = Time (Seconds (0));
+           continue;
          }
+       return item;
+     }
+   NS_LOG_INFO("Queue empty");
+   return nullptr;
+ }
+ 
+ uint64_t
+ DualQCoupledPiSquareQueueDisc::GetNativeL4SProb (int64_t sojourn) const
+ {
+   // Th_len = 1 packet: the dequeued packet was alone in the L4S queue
+   if (GetNPacketsIn (1) == 0)
+     {
+       return 0;
+     }
+   // With a zero range, the end of the ramp is a step at minTh
+   if (sojourn >= m_rampMaxTs)
+     {
+       return DUALQ_PROB_ONE;
+     }
+   if (sojourn <= m_rampMinTs)
+     {
+       return 0;
+     }
+   return (sojourn - m_rampMinTs) * m_rampSlope;
+ }
+ 
+ uint64_t
+ DualQCoupledPiSquareQueueDisc::DrawFixedPoint (void)
+ {
+   if (m_fixedPoint)
+     {
+       return NextFastRandom ();
+     }
+   return static_cast<uint64_t> (m_uv->GetValue () * DUALQ_PROB_ONE);
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::NextFastRandom (void)
+ {
+   if (m_prngState == 0)
+     {
+       // Seeded from the rng stream, so that AssignStreams () still applies
+       m_prngState = (static_cast<uint64_t> (m_uv->GetInteger (1, 0xfffffffe)) << 32)
+         | m_uv->GetInteger (0, 0xfffffffe);
+     }
+   // xorshift64*
+   m_prngState ^= m_prngState >> 12;
+   m_prngState ^= m_prngState << 25;
+   m_prngState ^= m_prngState >> 27;
+   return (m_prngState * 0x2545F4914F6CDD1DULL) >> 32;
+ }
+ 
+ bool
+ DualQCoupledPiSquareQueueDisc::Bernoulli (double prob, uint64_t probFixed)
+ {
+   if (m_fixedPoint)
+     {
+       return probFixed > NextFastRandom ();
+     }
+   return prob > m_uv->GetValue ();
+ }
  
-       if ((item2 = GetInternalQueue (1)->Peek ()))
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::SelectClass (void) const
+ {
+   Time classicQueueTime = GetHeadArrivalTime (0);
+   Time l4sQueueTime = GetHeadArrivalTime (1);
+   uint32_t q = 0;
+   Time arrival = classicQueueTime;
+   if (l4sQueueTime + m_tShift >= classicQueueTime && GetNPacketsIn (1) > 0)
+     {
+       q = 1;
+       arrival = l4sQueueTime;
+     }
+   bool found = GetNPacketsIn (q) > 0;
+   for (uint32_t c = 2; c < m_nClasses; c++)
+     {
+       if (GetNPacketsIn (c) == 0)
          {
-           item2->GetPacket ()->PeekPacketTag (tag2);
-           l4sQueueTime = tag2.GetTxTime ();
+           continue;
          }
-       else
+       // Served first once its head arrived more than the bias earlier
+       Time shifted = GetHeadArrivalTime (c) + m_classes[c - 2].bias;
+       if (!found || shifted < arrival)
          {
-           l4sQueueTime = Time (Seconds (0));
+           q = c;
+           arrival = shifted;
+           found = true;
          }
+     }
+   return q;
+ }
  
-       if (l4sQueueTime.GetSeconds () + m_tShift.GetSeconds () >= classicQueueTime.GetSeconds () && GetInternalQueue (1)->Peek () )
-         {
-           Ptr<QueueDiscItem> item = GetInternalQueue (1)->Dequeue ();
-           DualQCoupledPiSquareTimestampTag tag;
-           item->GetPacket ()->PeekPacketTag (tag);
-           bool minL4SQueueSizeFlag = false;
-           if (GetMode () == QUEUE_DISC_MODE_BYTES && GetInternalQueue (1)->GetNBytes () > 2 * m_meanPktSize)
-             {
-               minL4SQueueSizeFlag = true;
-             }
-           else if (GetMode () == QUEUE_DISC_MODE_PACKETS && GetInternalQueue (1)->GetNPackets () > 2 )
-             {
-               minL4SQueueSizeFlag = true;
-             }
+ bool
+ DualQCoupledPiSquareQueueDisc::DecidesAtEnqueue (uint32_t q) const
+ {
+   return m_markingPoint == MARK_ON_ENQUEUE || (m_markingPoint == MARK_HYBRID && q == 1);
+ }
+ 
+ bool
+ DualQCoupledPiSquareQueueDisc::Decide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue)
+ {
+   if (q > 1)
+     {
+       return OtherClassDecide (q, item, sojourn, atEnqueue);
+     }
+   if (m_controller == CONTROLLER_RFC9332)
+     {
+       return Rfc9332Decide (q, item, sojourn, atEnqueue);
+     }
+   return LegacyDecide (q, item, sojourn, atEnqueue);
+ }
  
-           if ((Simulator::Now () - tag.GetTxTime () > m_l4sThreshold && minL4SQueueSizeFlag) || (m_l4sDropProb > m_uv->GetValue ()))
+ bool
+ DualQCoupledPiSquareQueueDisc::LegacyDecide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue)
+ {
+   NS_LOG_FUNCTION (this << q << item << sojourn << atEnqueue);
+   if (q == 1)
+     {
+       if (m_l4sRamp)
+         {
+           // Native ramp on the sojourn time, combined with the coupled probability
+           uint64_t prob = GetNativeL4SProb (sojourn);
+           prob = (prob > m_l4sDropProbFixed) ? prob : m_l4sDropProbFixed;
+           if (prob > DrawFixedPoint ())
              {
-               item->Mark ();
-               m_stats.unforcedL4SMark++;
+               MarkItem (1, item, sojourn, atEnqueue);
              }
+           return true;
+         }
+       bool minL4SQueueSizeFlag = false;
+       if (GetMode () == QUEUE_DISC_MODE_BYTES && GetNBytesIn (1) > 2 * m_meanPktSize)
+         {
+           minL4SQueueSizeFlag = true;
+         }
+       else if (GetMode () == QUEUE_DISC_MODE_PACKETS && GetNPacketsIn (1) > 2 )
+         {
+           minL4SQueueSizeFlag = true;
+         }
  
-           m_queueSizeBytes -= item->GetSize ();
-           return item;
+       if ((sojourn > m_l4sThreshold.GetTimeStep () && minL4SQueueSizeFlag) || Bernoulli (m_l4sDropProb, m_l4sDropProbFixed))
+         {
+           MarkItem (1, item, sojourn, atEnqueue);
          }
+       return true;
+     }
  
-       else
+   if (Bernoulli (m_classicDropProb / (m_k * 1.0), m_classicDropProbFixed / m_k))
+     {
+       if (MarkItem (0, item, sojourn, atEnqueue))
+         {
+           return true;
+         }
+       if (GetQueueSize ())
          {
-           Ptr<QueueDiscItem> item = GetInternalQueue (0)->Dequeue ();
-           m_queueSizeBytes -= item->GetSize ();
+           // there is something else in the queue
+           DropItem (0, item, "Drops due to drop probability", atEnqueue);
+           return false;
+         }
+       // it is the only packet in the queue, so send it anyway
+     }
+   return true;
+ }
  
-           if (m_classicDropProb / (m_k * 1.0) >  m_uv->GetValue ())
+ bool
+ DualQCoupledPiSquareQueueDisc::Rfc9332Decide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue)
+ {
+   NS_LOG_FUNCTION (this << q << item << sojourn << atEnqueue);
+   // Overload: p_C >= p_Cmax, i.e., p_CL >= p_Lmax = 1
+   bool overload = m_classicDropProb >= m_classicMaxProb;
+ 
+   if (q == 1)
+     {
+       if (!overload)
+         {
+           // RFC 9332, Figure 5: p_L = max (p'_L, p_CL)
+           uint64_t prob = GetNativeL4SProb (sojourn);
+           prob = (prob > m_l4sDropProbFixed) ? prob : m_l4sDropProbFixed;
+           if (prob > DrawFixedPoint ())
              {
-               if (!item->Mark ())
-                 {
-                   if(GetQueueSize()){ // there is something else in the queue
-                     Drop (item, "Drops due to drop probability");
-                     m_stats.unforcedClassicDrop++;
-                     continue;
-                   }
-                   else // it was the only packet in the queue, so send it anyway
-                     return item;
-                   
-                 }
-               else
-                 {
-                   m_stats.unforcedClassicMark++;
-                   return item;
-                 }
+               MarkItem (1, item, sojourn, atEnqueue);
              }
-           return item;
+           return true;
          }
+       // Revert to Classic drop, then mark the rest (p_CL >= 1)
+       if (Bernoulli (m_classicDropProb, m_classicDropProbFixed) && GetQueueSize ())
+         {
+           // there is something else in the queue
+           DropItem (1, item, "L4S drop due to overload", atEnqueue);
+           return false;
+         }
+       MarkItem (1, item, sojourn, atEnqueue);
+       return true;
      }
-   NS_LOG_INFO("Queue empty");
-   return nullptr;
+ 
+   if (Bernoulli (m_classicDropProb, m_classicDropProbFixed))
+     {
+       // Under overload, ECN capable packets are dropped as well
+       if (!overload && MarkItem (0, item, sojourn, atEnqueue))
+         {
+           return true;
+         }
+       if (GetQueueSize ())
+         {
+           // there is something else in the queue
+           DropItem (0, item, "Drops due to drop probability", atEnqueue);
+           return false;
+         }
+       // it is the only packet in the queue, so send it anyway
+     }
+   return true;
+ }
+ 
+ bool
+ DualQCoupledPiSquareQueueDisc::OtherClassDecide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue)
+ {
+   NS_LOG_FUNCTION (this << q << item << sojourn << atEnqueue);
+   const ClassParams &params = m_classes[q - 2];
+   double prob = m_dropProb * params.coupling;
+   prob = (prob < 1) ? prob * prob : 1;
+   if (sojourn <= params.target.GetTimeStep ()
+       && !Bernoulli (prob, static_cast<uint64_t> (prob * DUALQ_PROB_ONE)))
+     {
+       return true;
+     }
+   if (MarkItem (q, item, sojourn, atEnqueue))
+     {
+       return true;
+     }
+   if (GetQueueSize ())
+     {
+       DropItem (q, item, "Drops due to drop probability or delay target", atEnqueue);
+       return false;
+     }
+   // it is the only packet in the queue, so send it anyway
+   return true;
+ }
+ 
+ bool
+ DualQCoupledPiSquareQueueDisc::MarkItem (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue)
+ {
+   if (!item->Mark ())
+     {
+       return false;
+     }
+   if (q > 1)
+     {
+       m_stats.unforcedOtherMark++;
+     }
+   else if (q == 1)
+     {
+       m_stats.unforcedL4SMark++;
+       m_stats.enqueueL4SMark += atEnqueue;
+     }
+   else
+     {
+       m_stats.unforcedClassicMark++;
+       m_stats.enqueueClassicMark += atEnqueue;
+     }
+   if (atEnqueue)
+     {
+       m_enqueueMarkTrace (item, TimeStep (sojourn));
+     }
+   else
+     {
+       m_dequeueMarkTrace (item, TimeStep (sojourn));
+     }
+   return true;
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::DropItem (uint32_t q, Ptr<QueueDiscItem> item, const char* reason, bool atEnqueue)
+ {
+   if (atEnqueue)
+     {
+       DropBeforeEnqueue (item, reason);
+     }
+   else
+     {
+       Drop (item, reason);
+     }
+   if (q > 1)
+     {
+       m_stats.unforcedOtherDrop++;
+     }
+   else if (q == 1)
+     {
+       m_stats.unforcedL4SDrop++;
+       m_stats.enqueueL4SDrop += atEnqueue;
+     }
+   else
+     {
+       m_stats.unforcedClassicDrop++;
+       m_stats.enqueueClassicDrop += atEnqueue;
+     }
+ }
+ 
+ void
+ DualQCoupledPiSquareQueueDisc::RequeueHead (Ptr<QueueDiscItem> item)
+ {
+   NS_LOG_FUNCTION (this << item);
+   uint32_t q = m_lastDequeuedClass;
+   NS_ASSERT_MSG (!m_headSegments[q], "There is already a head segment in queue " << q);
+ 
+   m_headSegments[q] = item;
+   m_headSegmentArrivals[q] = GetArrivalTime (item);
+   m_backlog[q].packets++;
+   m_backlog[q].bytes += item->GetSize ();
+   m_nLargeItems += (item->GetSize () > m_maxInteriorSize);
+   if (m_checkBacklog)
+     {
+       CheckBacklog ();
+     }
+ }
+ 
+ uint32_t
+ DualQCoupledPiSquareQueueDisc::GetBurstBytes (uint32_t perItemOverheadBits, uint32_t perBatchOverhead) const
+ {
+   uint32_t packets = 0;
+   uint32_t bytes = 0;
+   for (uint32_t q = 0; q < m_nClasses; q++)
+     {
+       packets += m_backlog[q].packets;
+       bytes += m_backlog[q].bytes;
+     }
+   if (packets == 0)
+     {
+       return 0;
+     }
+ 
+   bytes += perBatchOverhead + (perItemOverheadBits * (packets - 1) + 7) / 8;
+   if (m_nLargeItems)
+     {
+       // Each large item may end a batch, and the overhead of each batch
+       // is rounded up to bytes on its own
+       bytes += m_nLargeItems * (perBatchOverhead + 1);
+     }
+   return bytes;
+ }
+ 
+ Ptr<QueueDiscItem>
+ DualQCoupledPiSquareQueueDisc::DequeueBurst (uint32_t byteBudget, std::vector<Ptr<QueueDiscItem> > &out,
+                                              uint32_t perItemOverheadBits, uint32_t maxInteriorSize)
+ {
+   NS_LOG_FUNCTION (this << byteBudget << perItemOverheadBits << maxInteriorSize);
+   uint32_t overheadBits = 0;
+   uint32_t usedBytes = 0;
+   uint32_t nItems = 0;
+   Ptr<QueueDiscItem> partial;
+ 
+   // The first item goes through Dequeue () so that a requeued item is served first
+   Ptr<QueueDiscItem> item = Dequeue ();
+   while (item)
+     {
+       out.push_back (item);
+       nItems++;
+       uint32_t size = item->GetSize ();
+       uint32_t available = byteBudget - usedBytes - (overheadBits + 7) / 8;
+       usedBytes += size;
+ 
+       if (size > available)
+         {
+           NS_LOG_LOGIC ("Item of " << size << " bytes exceeds the " << available << " bytes left");
+           partial = item;
+           break;
+         }
+       if (size > maxInteriorSize || available - size <= (perItemOverheadBits + 7) / 8)
+         {
+           break;
+         }
+ 
+       overheadBits += perItemOverheadBits;
+       item = DoDequeue ();
+     }
+ 
+   NS_LOG_LOGIC ("Dequeued a batch of " << nItems << " items and " << usedBytes << " bytes");
+   if (nItems)
+     {
+       m_dequeueBurstTrace (nItems, usedBytes);
+     }
+   return partial;
  }
  
  Ptr<const QueueDiscItem>
@@ -617,13 +2008,13 @@
    NS_LOG_FUNCTION (this);
    Ptr<const QueueDiscItem> item;
  
-   for (uint32_t i = 0; i < GetNInternalQueues (); i++)
+   for (uint32_t i = 0; i < m_nClasses; i++)
      {
-       if ((item = GetInternalQueue (i)->Peek ()))
+       if ((item = PeekIn (i)))
          {
            NS_LOG_LOGIC ("Peeked from queue number " << i << ": " << item);
-           NS_LOG_LOGIC ("Number packets queue number " << i << ": " << GetInternalQueue (i)->GetNPackets ());
-           NS_LOG_LOGIC ("Number bytes queue number " << i << ": " << GetInternalQueue (i)->GetNBytes ());
+           NS_LOG_LOGIC ("Number packets queue number " << i << ": " << GetNPacketsIn (i));
+           NS_LOG_LOGIC ("Number bytes queue number " << i << ": " << GetNBytesIn (i));
            return item;
          }
      }
@@ -648,29 +2039,43 @@
        return false;
      }
  
-   if (GetNInternalQueues () == 0)
+   if (m_storage == STORAGE_RING_BUFFER)
      {
-       // Create 2 DropTail queues
-       Ptr<InternalQueue> queue1 = CreateObjectWithAttributes<DropTailQueue<QueueDiscItem> > ();
-       Ptr<InternalQueue> queue2 = CreateObjectWithAttributes<DropTailQueue<QueueDiscItem> > ();
-       if (m_mode == QUEUE_DISC_MODE_PACKETS)
+       if (GetNInternalQueues () > 0)
          {
- 
-           queue1->SetMaxSize(QueueSize(QueueSizeUnit::PACKETS, m_queueLimit));
-           queue2->SetMaxSize(QueueSize(QueueSizeUnit::PACKETS, m_queueLimit));
+           NS_LOG_ERROR ("DualQCoupledPiSquareQueueDisc cannot have internal queues when using ring buffer storage");
+           return false;
          }
-       else
+       // In bytes mode the rings start small and grow on demand
+       uint32_t capacity = (m_mode == QUEUE_DISC_MODE_PACKETS) ? m_queueLimit : 64;
+       for (uint32_t q = 0; q < m_nClasses; q++)
+         {
+           ResetRing (m_rings[q], capacity);
+         }
+       return true;
+     }
+ 
+   if (GetNInternalQueues () == 0)
+     {
+       // Create a DropTail queue per class
+       for (uint32_t q = 0; q < m_nClasses; q++)
          {
-           queue1->SetMaxSize(QueueSize(QueueSizeUnit::BYTES, m_queueLimit));
-           queue2->SetMaxSize(QueueSize(QueueSizeUnit::BYTES, m_queueLimit));
+           Ptr<InternalQueue> queue = CreateObjectWithAttributes<DropTailQueue<QueueDiscItem> > ();
+           if (m_mode == QUEUE_DISC_MODE_PACKETS)
+             {
+               queue->SetMaxSize(QueueSize(QueueSizeUnit::PACKETS, m_queueLimit));
+             }
+           else
+             {
+               queue->SetMaxSize(QueueSize(QueueSizeUnit::BYTES, m_queueLimit));
+             }
+           AddInternalQueue (queue);
          }
-       AddInternalQueue (queue1);
-       AddInternalQueue (queue2);
      }
  
-   if (GetNInternalQueues () != 2)
+   if (GetNInternalQueues () != m_nClasses)
      {
-       NS_LOG_ERROR ("DualQCoupledPiSquareQueueDisc needs 2 internal queue");
+       NS_LOG_ERROR ("DualQCoupledPiSquareQueueDisc needs " << m_nClasses << " internal queues, one per class");
        return false;
      }
    if ((GetInternalQueue (0)->GetCurrentSize ().GetUnit() == QueueSizeUnit::PACKETS && m_mode == QUEUE_DISC_MODE_BYTES)
@@ -701,6 +2106,21 @@
        return false;
      }
  
+   for (uint32_t q = 2; q < m_nClasses; q++)
+     {
+       if ((GetInternalQueue (q)->GetCurrentSize ().GetUnit() == QueueSizeUnit::PACKETS && m_mode == QUEUE_DISC_MODE_BYTES)
+           || (GetInternalQueue (q)->GetCurrentSize ().GetUnit() == QueueSizeUnit::BYTES && m_mode == QUEUE_DISC_MODE_PACKETS))
+         {
+           NS_LOG_ERROR ("The mode provided for the queue of class " << q << " does not match the mode set on the DualQCoupledPiSquareQueueDisc");
+           return false;
+         }
+       if (GetInternalQueue (q)->GetMaxSize ().GetValue() < m_queueLimit)
+         {
+           NS_LOG_ERROR ("The size of the internal queue of class " << q << " is less than the queue disc limit");
+           return false;
+         }
+     }
+ 
    return true;
  }
  
@@ -23,6 +23,7 @@
 #define DUAL_Q_COUPLED_PI_SQUARE_QUEUE_DISC_H
 
 #include <queue>
+#include <vector>
 #include "ns3/packet.h"
 #include "ns3/queue-disc.h"
 #include "ns3/nstime.h"
@@ -34,12 +35,25 @@
 #include "ns3/simulator.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/trace-source-accessor.h"
+#include "ns3/traced-callback.h"
 
 namespace ns3 {
 
 class TraceContainer;
 class UniformRandomVariable;
 
+/**
+ * Value of the IPv4 header offset of a DualQ item whose packet does not
+ * start with an IPv4 header (e.g., the remainder of a segmented RLC SDU),
+ * hence cannot be ECN marked
+ */
+static const uint32_t DUALQ_NO_IPV4_HEADER = 0xffffffff;
+
+/**
+ * Maximum number of traffic classes of a DualQ, Classic and L4S included
+ */
+static const uint32_t DUALQ_MAX_CLASSES = 8;
+
 class DualQueueL4SQueueDiscItem : public QueueDiscItem
 {
 public:
@@ -48,6 +62,55 @@ public:
   void AddHeader (void) override;
   bool Mark (void) override;
   bool IsL4S (void) override;
+  /**
+   * \brief Hash the IPv4 5-tuple (addresses, protocol and TCP/UDP ports)
+   * \param perturbation hash perturbation value
+   * \return the hash, or 0 if the packet carries no IPv4 header
+   */
+  uint32_t Hash (uint32_t perturbation = 0) const override;
+  /**
+   * \brief Read the DS field (DSCP and ECN) of the IPv4 header
+   * \param field the field, only IP_DSFIELD is supported
+   * \param value the value of the field
+   * \return false if the packet carries no IPv4 header
+   */
+  bool GetUint8Value (Uint8Values field, uint8_t &value) const override;
+
+  /**
+   * \brief Set the number of bytes preceding the IPv4 header in the packet
+   * \param offset the offset (e.g., the size of the NR PDCP header), or
+   *        DUALQ_NO_IPV4_HEADER if the packet carries no IPv4 header
+   */
+  void SetIpv4HeaderOffset (uint32_t offset);
+  /**
+   * \brief Get the number of bytes preceding the IPv4 header in the packet
+   * \return the offset of the IPv4 header
+   */
+  uint32_t GetIpv4HeaderOffset (void) const;
+
+  /**
+   * \brief Turn the item into a view of the packet from the given offset
+   *
+   * Used to keep the remainder of a segmented packet (e.g., an RLC SDU)
+   * without copying or shrinking the packet. A view that does not start at
+   * the beginning of the packet carries no IPv4 header, so it is never
+   * marked.
+   *
+   * \param offset the number of leading bytes of the packet already sent
+   */
+  void SetSegmentOffset (uint32_t offset);
+  /**
+   * \return the number of leading bytes of the packet excluded from the item
+   */
+  uint32_t GetSegmentOffset (void) const;
+  /**
+   * \return the size of the packet from the segment offset
+   */
+  uint32_t GetSize (void) const override;
+
+private:
+  uint32_t m_ipv4HeaderOffset; //!< Bytes preceding the IPv4 header
+  uint32_t m_segmentOffset;    //!< Leading bytes of the packet excluded from the item
 };
 
 class DualQueueClassicQueueDiscItem : public QueueDiscItem
@@ -58,6 +121,55 @@ public:
   void AddHeader (void) override;
   bool Mark (void) override;
   bool IsL4S (void) override;
+  /**
+   * \brief Hash the IPv4 5-tuple (addresses, protocol and TCP/UDP ports)
+   * \param perturbation hash perturbation value
+   * \return the hash, or 0 if the packet carries no IPv4 header
+   */
+  uint32_t Hash (uint32_t perturbation = 0) const override;
+  /**
+   * \brief Read the DS field (DSCP and ECN) of the IPv4 header
+   * \param field the field, only IP_DSFIELD is supported
+   * \param value the value of the field
+   * \return false if the packet carries no IPv4 header
+   */
+  bool GetUint8Value (Uint8Values field, uint8_t &value) const override;
+
+  /**
+   * \brief Set the number of bytes preceding the IPv4 header in the packet
+   * \param offset the offset (e.g., the size of the NR PDCP header), or
+   *        DUALQ_NO_IPV4_HEADER if the packet carries no IPv4 header
+   */
+  void SetIpv4HeaderOffset (uint32_t offset);
+  /**
+   * \brief Get the number of bytes preceding the IPv4 header in the packet
+   * \return the offset of the IPv4 header
+   */
+  uint32_t GetIpv4HeaderOffset (void) const;
+
+  /**
+   * \brief Turn the item into a view of the packet from the given offset
+   *
+   * Used to keep the remainder of a segmented packet (e.g., an RLC SDU)
+   * without copying or shrinking the packet. A view that does not start at
+   * the beginning of the packet carries no IPv4 header, so it is never
+   * marked.
+   *
+   * \param offset the number of leading bytes of the packet already sent
+   */
+  void SetSegmentOffset (uint32_t offset);
+  /**
+   * \return the number of leading bytes of the packet excluded from the item
+   */
+  uint32_t GetSegmentOffset (void) const;
+  /**
+   * \return the size of the packet from the segment offset
+   */
+  uint32_t GetSize (void) const override;
+
+private:
+  uint32_t m_ipv4HeaderOffset; //!< Bytes preceding the IPv4 header
+  uint32_t m_segmentOffset;    //!< Leading bytes of the packet excluded from the item
 };
 
 /**
@@ -93,9 +205,25 @@ public:
     uint32_t unforcedClassicDrop;      //!< Probability drops of Classic traffic: proactive
     uint32_t unforcedClassicMark;      //!< Probability marks of Classic traffic: proactive
     uint32_t unforcedL4SMark;          //!< Probability marks of L4S traffic: proactive
+    uint32_t unforcedL4SDrop;          //!< Probability drops of L4S traffic under overload (RFC 9332 controller)
     uint32_t forcedDrop;               //!< Drops due to queue limit: reactive
+    uint32_t enqueueClassicDrop;       //!< Of unforcedClassicDrop, those decided at enqueue
+    uint32_t enqueueClassicMark;       //!< Of unforcedClassicMark, those decided at enqueue
+    uint32_t enqueueL4SMark;           //!< Of unforcedL4SMark, those decided at enqueue
+    uint32_t enqueueL4SDrop;           //!< Of unforcedL4SDrop, those decided at enqueue
+    uint32_t unforcedOtherMark;        //!< Marks of the classes added by AddClass
+    uint32_t unforcedOtherDrop;        //!< Probability and delay target drops of the classes added by AddClass
   } Stats;
 
+  /**
+   * \brief Backlog of one traffic class
+   */
+  typedef struct
+  {
+    uint32_t packets;                  //!< Number of queued packets
+    uint32_t bytes;                    //!< Number of queued bytes
+  } Backlog;
+
   /**
    * \brief Enumeration of the modes supported in the class.
    */
@@ -105,6 +233,44 @@ public:
     QUEUE_DISC_MODE_BYTES,       /**< Use number of bytes for maximum queue disc size */
   };
 
+  /**
+   * \brief Enumeration of the packet storage engines supported in the class.
+   */
+  enum StorageMode
+  {
+    STORAGE_INTERNAL_QUEUES,     /**< Two DropTailQueue<QueueDiscItem> internal queues */
+    STORAGE_RING_BUFFER,         /**< Two built-in ring buffers of items, arrival times and sizes */
+  };
+
+  /**
+   * \brief Enumeration of the controllers supported in the class.
+   */
+  enum ControllerMode
+  {
+    CONTROLLER_LEGACY,           /**< PI2 controller of the early DualQ drafts (default) */
+    CONTROLLER_RFC9332,          /**< DualPI2 of RFC 9332: base PI, native L4S ramp and overload handling */
+  };
+
+  /**
+   * \brief Enumeration of the queue delay estimators supported in the class.
+   */
+  enum QueueDelayEstimator
+  {
+    QUEUE_DELAY_TIMESTAMP,         /**< Sojourn time of the head packet, from its arrival timestamp (default) */
+    QUEUE_DELAY_DEPARTURE_RATE,    /**< Backlog divided by the measured departure rate, as in PIE */
+    QUEUE_DELAY_TIMESTAMP_OR_RATE, /**< Timestamps, or the departure rate when they give a zero delay */
+  };
+
+  /**
+   * \brief Enumeration of the points where the mark/drop decisions are taken.
+   */
+  enum MarkingPoint
+  {
+    MARK_ON_DEQUEUE,             /**< On the sojourn of the dequeued packet (default) */
+    MARK_ON_ENQUEUE,             /**< On the sojourn of the head of the queue the arriving packet joins */
+    MARK_HYBRID,                 /**< L4S packets at enqueue, Classic packets at dequeue */
+  };
+
   /**
    * \brief Set the operating mode of this queue.
    *
@@ -133,6 +299,89 @@ public:
    */
   uint32_t GetQueueSize (void);
 
+  /**
+   * \brief Get the backlog of the L4S queue.
+   *
+   * \returns The number of packets and bytes in the L4S queue.
+   */
+  Backlog GetL4SBacklog (void) const;
+
+  /**
+   * \brief Get the backlog of the Classic queue.
+   *
+   * \returns The number of packets and bytes in the Classic queue.
+   */
+  Backlog GetClassicBacklog (void) const;
+
+  /**
+   * \brief Get the backlog of a traffic class.
+   *
+   * \param q the class index (0 for Classic, 1 for L4S, or as returned by AddClass)
+   * \returns The number of packets and bytes of the class.
+   */
+  Backlog GetClassBacklog (uint32_t q) const;
+
+  /**
+   * \brief Get the arrival time of the head packet of a traffic class.
+   *
+   * \param q the class index (0 for Classic, 1 for L4S, or as returned by AddClass)
+   * \returns The arrival time of the head packet of the class, zero if it is empty.
+   */
+  Time GetClassHeadArrival (uint32_t q) const;
+
+  /**
+   * \brief Callback giving the traffic class of an item: 0 for Classic, 1
+   *        for L4S, or an index returned by AddClass
+   */
+  typedef Callback<uint32_t, Ptr<QueueDiscItem> > Classifier;
+
+  /**
+   * \brief Add a traffic class next to the Classic and L4S ones
+   *
+   * The packets of the class get the base probability times the coupling
+   * factor, squared as for Classic packets, and are marked (or dropped if
+   * not ECN capable) whenever their sojourn exceeds the delay target. The
+   * class is served before the Classic or L4S head picked by the scheduler
+   * once its head arrived more than the scheduler bias before it; a large
+   * bias makes a scavenger class, served when the others are idle.
+   *
+   * Classes must be added before the queue disc is initialized, and items
+   * are only put into them by a classifier, see SetClassifier ().
+   *
+   * \param target the delay target of the class
+   * \param coupling the coupling factor of the class
+   * \param bias the scheduler bias of the class
+   * \returns the index of the class
+   */
+  uint32_t AddClass (Time target, double coupling, Time bias);
+
+  /**
+   * \returns the number of traffic classes, Classic and L4S included
+   */
+  uint32_t GetNClasses (void) const;
+
+  /**
+   * \brief Set the classifier of the items
+   *
+   * Without a classifier, items go to the L4S class if IsL4S () is true
+   * and to the Classic class otherwise.
+   *
+   * \param classifier the classifier
+   */
+  void SetClassifier (Classifier classifier);
+
+  /**
+   * \brief Classifier putting the Lower Effort packets in class 2
+   *
+   * Packets with the LE codepoint of RFC 8622 or CS1 go to class 2, the
+   * others to the L4S or Classic class as by default. Meant for a single
+   * class added by AddClass.
+   *
+   * \param item the item
+   * \returns the class of the item
+   */
+  static uint32_t ClassifyLowerEffort (Ptr<QueueDiscItem> item);
+
   /**
    * \brief Set the limit of the queue in bytes or packets.
    *
@@ -142,6 +391,8 @@ public:
 
   /**
    * \brief Get queue delay
+   * \returns the latest of the (estimated) head arrival times of the
+   *          classes, zero if all the classes are empty
    */
   Time GetQueueDelay (void);
 
@@ -150,6 +401,40 @@ public:
    */
   double GetDropProb (void);
 
+  /**
+   * \brief Get the time at which the given item was enqueued
+   *
+   * Reads the item timestamp, or the packet tag if UseTimestampTag is set.
+   *
+   * \param item an item enqueued by this queue disc
+   * \returns the arrival time of the item
+   */
+  Time GetArrivalTime (Ptr<const QueueDiscItem> item) const;
+
+  /**
+   * \brief Scale the delay targets and the PI gains of the controller
+   *
+   * ClassicQueueDelayReference, L4SMarkThresold, L4SMinThreshold and
+   * L4SRange are multiplied by the scale, and the PI gains (A, B,
+   * Rfc9332Alpha and Rfc9332Beta) divided by it, relative to the values
+   * they had when the queue disc was initialized. The probability is kept.
+   * Meant to follow the capacity of a link, e.g. its CQI.
+   *
+   * \param scale the scale, 1 for the configured values
+   */
+  void SetTargetScale (double scale);
+
+  /**
+   * \returns the scale set by SetTargetScale ()
+   */
+  double GetTargetScale (void) const;
+
+  /**
+   * \returns the sojourn above which L4S packets are marked, scaled by
+   *          SetTargetScale ()
+   */
+  Time GetL4SThreshold (void) const;
+
   /**
    * \brief Get Dual Queue PI Square statistics after running.
    *
@@ -157,6 +442,95 @@ public:
    */
   Stats GetStats ();
 
+  /**
+   * \brief Dequeue as many items as fit in a transmission opportunity
+   *
+   * Runs the scheduler and the mark/drop decisions item after item, as
+   * successive calls to Dequeue () would, and stops as soon as the batch
+   * fills the byte budget. Every item but the last one is charged
+   * perItemOverheadBits on top of its size (e.g., 12 bits for the RLC
+   * E and LI fields); the accumulated overhead is rounded up to bytes.
+   * Another item is only dequeued if the budget left after the current
+   * one exceeds the overhead of one more item. Items larger than
+   * maxInteriorSize can only be the last one of a batch.
+   *
+   * A requeued item, if any, is always returned first. The DequeueBurst
+   * trace is fired once per batch, but the rest of the per-item work is
+   * not batched: each item still goes through the QueueDisc dequeue
+   * accounting (Dequeue trace, statistics and sojourn time), the scheduler
+   * and the mark/drop decisions, as with Dequeue (). What the caller saves
+   * is one call per item and the size bookkeeping of the batch.
+   *
+   * \param byteBudget the number of bytes available for items and overhead
+   * \param out the vector the dequeued items are appended to
+   * \param perItemOverheadBits the overhead of each item followed by another one
+   * \param maxInteriorSize the size above which an item ends the batch
+   * \returns the last item of the batch if it does not fit in the budget
+   *          and must be segmented by the caller, null otherwise
+   */
+  Ptr<QueueDiscItem> DequeueBurst (uint32_t byteBudget, std::vector<Ptr<QueueDiscItem> > &out,
+                                   uint32_t perItemOverheadBits = 0,
+                                   uint32_t maxInteriorSize = 0xffffffff);
+
+  /**
+   * \brief Give back the remainder of a segmented item
+   *
+   * The item must be the last one dequeued from this queue disc, shrunk by
+   * the caller (e.g., the RLC removing the first segment of an SDU). It is
+   * stored in the head segment slot of its class, keeping its original
+   * arrival time, and is served before any other item of that class by
+   * the same scheduler. The mark/drop decision was taken when the item was
+   * first dequeued, so it is not taken again.
+   *
+   * \param item the remainder of the item
+   */
+  void RequeueHead (Ptr<QueueDiscItem> item);
+
+  /**
+   * \brief Get the budget needed to dequeue the whole backlog
+   *
+   * The result is kept up to date in constant time from the backlog
+   * counters and from the number of items larger than the MaxInteriorSize
+   * attribute, counted as they enter and leave the queue disc.
+   *
+   * Without such items, it is the byte budget, plus perBatchOverhead, with
+   * which DequeueBurst (called with the same perItemOverheadBits and
+   * MaxInteriorSize) takes the whole backlog in one batch, provided the
+   * last item is larger than the overhead of one item. Each larger item
+   * can only end a batch, so with n of them the result is an upper bound
+   * of the bytes of n + 1 batches, each charged perBatchOverhead.
+   *
+   * \param perItemOverheadBits the overhead of each item followed by another one
+   * \param perBatchOverhead the overhead of each batch in bytes (e.g., a fixed header)
+   * \returns the number of bytes, zero if the queue disc is empty
+   */
+  uint32_t GetBurstBytes (uint32_t perItemOverheadBits, uint32_t perBatchOverhead) const;
+
+  /**
+   * TracedCallback signature for batches dequeued by DequeueBurst.
+   *
+   * \param [in] nItems the number of items in the batch
+   * \param [in] nBytes the number of bytes in the batch
+   */
+  typedef void (* BurstTracedCallback) (uint32_t nItems, uint32_t nBytes);
+
+  /**
+   * TracedCallback signature for the departure rate measurement cycles.
+   *
+   * \param [in] q the queue index (0 for Classic, 1 for L4S)
+   * \param [in] sample the departure rate measured over the cycle (bytes/s)
+   * \param [in] average the new average departure rate (bytes/s)
+   */
+  typedef void (* DequeueRateTracedCallback) (uint32_t q, double sample, double average);
+
+  /**
+   * TracedCallback signature for the marks applied at enqueue or dequeue.
+   *
+   * \param [in] item the marked item
+   * \param [in] sojourn the sojourn the decision was taken on
+   */
+  typedef void (* MarkTracedCallback) (Ptr<const QueueDiscItem> item, Time sojourn);
+
   /**
    * Assign a fixed random variable stream number to the random variables
    * used by this model.  Return the number of streams (possibly zero) that
@@ -173,26 +547,322 @@ protected:
    */
   virtual void DoDispose (void);
 
+  virtual bool CheckConfig (void);
+
+  /**
+   * \brief Store an item at the tail of the packet storage of the given queue
+   *
+   * The packet storage holds everything but the head segments; subclasses
+   * override these methods to organize it differently. The backlog
+   * counters are updated by the caller.
+   *
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \returns true if the item was stored
+   */
+  virtual bool StoreItem (uint32_t q, Ptr<QueueDiscItem> item);
+
+  /**
+   * \brief Extract the next item of the packet storage of the given queue
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param size set to the size of the item
+   * \returns the item, if any
+   */
+  virtual Ptr<QueueDiscItem> ExtractItem (uint32_t q, uint32_t &size);
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the next item of the packet storage of the given queue, if any
+   */
+  virtual Ptr<const QueueDiscItem> PeekStored (uint32_t q) const;
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the arrival time of the next item of the packet storage of the
+   *          given queue, zero if empty
+   */
+  virtual Time GetStoredHeadArrival (uint32_t q) const;
+
+  /**
+   * \brief Count the contents of the packet storage of the given queue
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param packets set to the number of stored packets
+   * \param bytes set to the number of stored bytes
+   */
+  virtual void GetStoredBacklog (uint32_t q, uint32_t &packets, uint32_t &bytes) const;
+
+  uint32_t m_queueLimit;                        //!< Queue limit in bytes / packets
+  QueueDiscMode m_mode;                         //!< Mode (bytes or packets)
+
 private:
   virtual bool DoEnqueue (Ptr<QueueDiscItem> item);
   virtual Ptr<QueueDiscItem> DoDequeue (void);
   virtual Ptr<const QueueDiscItem> DoPeek (void) const;
-  virtual bool CheckConfig (void);
 
   /**
    * \brief Initialize the queue parameters.
    */
   virtual void InitializeParams (void);
 
+  /**
+   * \brief Compute the parameters derived from the targets and the gains
+   */
+  void UpdateControlParams (void);
+
   /**
    * \brief Periodically calculate the drop probability
    */
   void CalculateP ();
 
+  /**
+   * \brief Update the drop probability as of a given time
+   *
+   * The queue must not have changed since that time.
+   *
+   * \param now the time of the update
+   */
+  void UpdateProb (Time now);
+
+  /**
+   * \brief Apply the updates missed since the last enqueue/dequeue (LazyUpdate only)
+   *
+   * The updates happen at the same times and give the same probabilities
+   * as with the timer. Updates on an idle queue with a zero probability
+   * leave it unchanged and are skipped.
+   */
+  void CatchUpProb (void);
+
+  /**
+   * \brief FIFO of queued items backed by power-of-two sized arrays
+   *
+   * Arrival times and sizes are kept in arrays parallel to the items so
+   * that head-of-line delay and byte counts never touch the item itself.
+   */
+  struct DualQRing
+  {
+    std::vector<Ptr<QueueDiscItem> > items;     //!< Queued items
+    std::vector<int64_t> arrivals;              //!< Arrival time (in time steps) of each item
+    std::vector<uint32_t> sizes;                //!< Size in bytes of each item
+    uint32_t head;                              //!< Index of the head item
+    uint32_t count;                             //!< Number of queued items
+    uint32_t mask;                              //!< Capacity minus one
+  };
+
+  /**
+   * \brief Reset a ring to an empty state with the given capacity
+   * \param ring the ring
+   * \param capacity the minimum number of items the ring can hold
+   */
+  static void ResetRing (DualQRing &ring, uint32_t capacity);
+
+  /**
+   * \brief Double the capacity of a full ring
+   * \param ring the ring
+   */
+  static void GrowRing (DualQRing &ring);
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the number of packets in the given queue
+   */
+  uint32_t GetNPacketsIn (uint32_t q) const;
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the number of bytes in the given queue
+   */
+  uint32_t GetNBytesIn (uint32_t q) const;
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the arrival time of the head packet of the given queue, zero if empty
+   */
+  Time GetHeadArrivalTime (uint32_t q) const;
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the head packet of the given queue (possibly a head segment), if any
+   */
+  Ptr<const QueueDiscItem> PeekIn (uint32_t q) const;
+
+  /**
+   * \brief Store an item at the tail of the given queue
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \returns true if the item was stored
+   */
+  bool EnqueueIn (uint32_t q, Ptr<QueueDiscItem> item);
+
+  /**
+   * \brief Extract the head item of the given queue, the head segment first
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the head item, if any
+   */
+  Ptr<QueueDiscItem> DequeueFrom (uint32_t q);
+
+  /**
+   * \brief Account a departure in the departure rate measurement of a queue
+   *
+   * A measurement cycle starts when the backlog reaches DequeueThreshold
+   * and ends once DequeueThreshold bytes have left and time has passed;
+   * its rate is then averaged into an EWMA.
+   *
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param size the size of the dequeued item
+   */
+  void UpdateDequeueRate (uint32_t q, uint32_t size);
+
+  /**
+   * \brief Arrival time of the head packet according to QueueDelayEstimator
+   *
+   * With the departure rate, this is the time the head packet would have
+   * arrived to be dequeued after backlog / rate. The timestamp is used as
+   * long as no rate has been measured.
+   *
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param now the current time
+   * \returns the (estimated) arrival time of the head packet, zero if empty
+   */
+  Time EstimateHeadArrival (uint32_t q, Time now) const;
+
+  /**
+   * \brief Abort if the backlog counters disagree with the packet storage
+   */
+  void CheckBacklog (void) const;
+
+  /**
+   * \brief Marking probability of the native L4S AQM
+   *
+   * A ramp from 0 at L4SMinThreshold to 1 at L4SMinThreshold + L4SRange
+   * (a step at L4SMinThreshold if the range is zero), evaluated with the
+   * slope precomputed by InitializeParams (). Nothing is marked while the
+   * L4S queue holds a single packet.
+   *
+   * \param sojourn the sojourn time of the dequeued L4S packet, in time steps
+   * \returns the native marking probability, in units of 2^-32
+   */
+  uint64_t GetNativeL4SProb (int64_t sojourn) const;
+
+  /**
+   * \brief Draw a uniform random number to compare a fixed-point probability with
+   * \returns a random number in [0, 2^32)
+   */
+  uint64_t DrawFixedPoint (void);
+
+  /**
+   * \brief Next output of the xorshift generator used with FixedPoint
+   * \returns a random number in [0, 2^32)
+   */
+  uint32_t NextFastRandom (void);
+
+  /**
+   * \brief Random mark/drop decision
+   *
+   * Compares the fixed-point probability with NextFastRandom () if
+   * FixedPoint is set, and the floating point one with the rng stream
+   * otherwise.
+   *
+   * \param prob the probability
+   * \param probFixed the same probability, in units of 2^-32
+   * \returns true with the given probability
+   */
+  bool Bernoulli (double prob, uint64_t probFixed);
+
+  /**
+   * \brief Fixed-point version of the probability update of CalculateP ()
+   * \param qDelay the queue delay of the Classic queue, in time steps
+   */
+  void UpdateProbFixed (int64_t qDelay);
+
+  /**
+   * \brief Parameters of a class added by AddClass
+   */
+  struct ClassParams
+  {
+    Time target;                                //!< Delay target
+    double coupling;                            //!< Coupling factor
+    Time bias;                                  //!< Scheduler bias
+  };
+
+  /**
+   * \param item the item
+   * \returns the class of the item
+   */
+  uint32_t Classify (Ptr<QueueDiscItem> item);
+
+  /**
+   * \returns the class the scheduler serves next
+   */
+  uint32_t SelectClass (void) const;
+
+  /**
+   * \brief Take the mark/drop decision for a class added by AddClass
+   * \param q the class index
+   * \param item the item
+   * \param sojourn the sojourn to decide on, in time steps
+   * \param atEnqueue whether the item is being enqueued rather than dequeued
+   * \returns false if the item was dropped
+   */
+  bool OtherClassDecide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue);
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns true if the decisions for the given queue are taken at enqueue
+   */
+  bool DecidesAtEnqueue (uint32_t q) const;
+
+  /**
+   * \brief Take the mark/drop decision of the configured controller
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \param sojourn the sojourn to decide on, in time steps
+   * \param atEnqueue whether the item is being enqueued rather than dequeued
+   * \returns false if the item was dropped
+   */
+  bool Decide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue);
+
+  /**
+   * \brief Take the mark/drop decision of the legacy controller
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \param sojourn the sojourn to decide on, in time steps
+   * \param atEnqueue whether the item is being enqueued rather than dequeued
+   * \returns false if the item was dropped
+   */
+  bool LegacyDecide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue);
+
+  /**
+   * \brief Take the RFC 9332 mark/drop decision
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \param sojourn the sojourn to decide on, in time steps
+   * \param atEnqueue whether the item is being enqueued rather than dequeued
+   * \returns false if the item was dropped
+   */
+  bool Rfc9332Decide (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue);
+
+  /**
+   * \brief Mark an item, and count and trace the mark
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \param sojourn the sojourn the decision was taken on, in time steps
+   * \param atEnqueue whether the item is being enqueued rather than dequeued
+   * \returns false if the item cannot be marked
+   */
+  bool MarkItem (uint32_t q, Ptr<QueueDiscItem> item, int64_t sojourn, bool atEnqueue);
+
+  /**
+   * \brief Drop an item on a probability decision, and count the drop
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param item the item
+   * \param reason the reason of the drop
+   * \param atEnqueue whether the item is being enqueued rather than dequeued
+   */
+  void DropItem (uint32_t q, Ptr<QueueDiscItem> item, const char* reason, bool atEnqueue);
+
   Stats m_stats;                                //!< DualQ Coupled PI Square statistics
 
   // ** Variables supplied by user
-  QueueDiscMode m_mode;                         //!< Mode (bytes or packets)
   Time m_classicQueueDelayRef;                  //!< Queue delay target for Classic traffic
   Time m_sUpdate;                               //!< Start time of the update timer
   Time m_tUpdate;                               //!< Time period after which CalculateP () is called
@@ -201,7 +871,37 @@ private:
   double m_beta;                                //!< Parameter to PI Square controller
   Time m_l4sThreshold;                          //!< L4S marking threshold (in time)
   uint32_t m_k;                                 //!< Coupling factor
-  uint32_t m_queueLimit;                        //!< Queue limit in bytes / packets
+  bool m_useTimestampTag;                       //!< Store arrival times in a packet tag instead of the item
+  StorageMode m_storage;                        //!< Packet storage engine
+  ControllerMode m_controller;                  //!< Probability controller
+  double m_rfcAlpha;                            //!< RFC 9332 integral gain (Hz)
+  double m_rfcBeta;                             //!< RFC 9332 proportional gain (Hz)
+  Time m_rampMinThreshold;                      //!< Native L4S ramp start (minTh)
+  Time m_rampRange;                             //!< Native L4S ramp width (range)
+  bool m_l4sRamp;                               //!< Use the native L4S ramp with the legacy controller
+  bool m_fixedPoint;                            //!< Integer probability update and mark/drop decisions
+  bool m_lazyUpdate;                            //!< Apply the probability updates at enqueue/dequeue
+  Time m_nextUpdate;                            //!< Time of the next probability update (LazyUpdate only)
+  bool m_checkBacklog;                          //!< Verify the backlog counters on every enqueue/dequeue
+  uint32_t m_maxInteriorSize;                   //!< Size above which an item ends a batch, for GetBurstBytes ()
+  uint32_t m_nLargeItems;                       //!< Number of queued items larger than m_maxInteriorSize
+  QueueDelayEstimator m_delayEstimator;         //!< Queue delay estimator
+  MarkingPoint m_markingPoint;                  //!< Where the mark/drop decisions are taken
+  std::vector<ClassParams> m_classes;           //!< Classes added by AddClass, from index 2
+  uint32_t m_nClasses;                          //!< Number of traffic classes
+  Classifier m_classifier;                      //!< Classifier of the items, IsL4S () if null
+  uint32_t m_lastDequeuedClass;                 //!< Class of the last dequeued item, for RequeueHead ()
+  double m_targetScale;                         //!< Scale of the targets, set by SetTargetScale ()
+  Time m_baseClassicQueueDelayRef;              //!< Configured Classic queue delay target
+  Time m_baseL4sThreshold;                      //!< Configured L4S marking threshold
+  Time m_baseRampMinThreshold;                  //!< Configured native L4S ramp start
+  Time m_baseRampRange;                         //!< Configured native L4S ramp width
+  double m_baseAlpha;                           //!< Configured legacy integral gain
+  double m_baseBeta;                            //!< Configured legacy proportional gain
+  double m_baseRfcAlpha;                        //!< Configured RFC 9332 integral gain
+  double m_baseRfcBeta;                         //!< Configured RFC 9332 proportional gain
+  uint32_t m_dqThreshold;                       //!< Minimum bytes of a departure rate measurement cycle
+  double m_dqRateWeight;                        //!< Weight of the previous average in the departure rate EWMA
 
   // ** Variables maintained by DualQ Coupled PI Square
   Time m_classicQueueTime;                      //!< Arrival time of a packet of Classic Traffic
@@ -211,14 +911,36 @@ private:
   double m_dropProb;                            //!< Variable used in calculation of drop probability
   double m_classicDropProb;                     //!< Variable used in calculation of drop probability of Classic traffic
   double m_l4sDropProb;                         //!< Variable used in calculation of drop probability of L4S traffic
+  double m_classicMaxProb;                      //!< Classic probability above which the RFC 9332 controller is overloaded (p_Cmax)
+  uint64_t m_dropProbFixed;                     //!< m_dropProb in units of 2^-32 (FixedPoint only)
+  uint64_t m_l4sDropProbFixed;                  //!< m_l4sDropProb in units of 2^-32, saturated at 1
+  uint64_t m_classicDropProbFixed;              //!< m_classicDropProb in units of 2^-32
+  int64_t m_alphaFixed;                         //!< Integral gain, in units of 2^-48 per time step
+  int64_t m_betaFixed;                          //!< Proportional gain, in units of 2^-48 per time step
+  uint64_t m_prngState;                         //!< State of the xorshift generator, 0 until seeded
+  int64_t m_rampMinTs;                          //!< Native L4S ramp start, in time steps
+  int64_t m_rampMaxTs;                          //!< Native L4S ramp end, in time steps
+  uint64_t m_rampSlope;                         //!< Native L4S ramp slope, in units of 2^-32 per time step
   double m_alphaU;                              //!< Parameter to PI Square controller
   double m_betaU;                               //!< Parameter to PI Square controller
   Time m_qDelayOld;                             //!< Old value of queue delay
   Time m_qDelay;                                //!< Current value of queue delay
   EventId m_rtrsEvent;                          //!< Event used to decide the decision of interval of drop probability calculation
   Ptr<UniformRandomVariable> m_uv;              //!< Rng stream
+  TracedCallback<uint32_t, uint32_t> m_dequeueBurstTrace; //!< Fired once per DequeueBurst batch
+  TracedCallback<uint32_t, double, double> m_dequeueRateTrace; //!< Fired at the end of each departure rate measurement cycle
+  TracedCallback<Ptr<const QueueDiscItem>, Time> m_enqueueMarkTrace; //!< Fired for each mark decided at enqueue
+  TracedCallback<Ptr<const QueueDiscItem>, Time> m_dequeueMarkTrace; //!< Fired for each mark decided at dequeue
+
+  Time m_dqStart[DUALQ_MAX_CLASSES];            //!< Start of the current measurement cycle, per queue
+  uint32_t m_dqCount[DUALQ_MAX_CLASSES];        //!< Bytes dequeued in the current measurement cycle, per queue
+  bool m_inMeasurement[DUALQ_MAX_CLASSES];      //!< Whether a measurement cycle is running, per queue
+  double m_avgDqRate[DUALQ_MAX_CLASSES];        //!< Average departure rate (bytes/s), 0 until measured, per queue
 
-  int m_queueSizeBytes;                         //!< Current size of the queue in bytes
+  Backlog m_backlog[DUALQ_MAX_CLASSES];         //!< Backlog counters, per class
+  DualQRing m_rings[DUALQ_MAX_CLASSES];         //!< Rings, per class, used with STORAGE_RING_BUFFER
+  Ptr<QueueDiscItem> m_headSegments[DUALQ_MAX_CLASSES]; //!< Remainders of segmented items, per class
+  Time m_headSegmentArrivals[DUALQ_MAX_CLASSES]; //!< Arrival time of the original items of the head segments
 };
 
 }    // namespace ns3
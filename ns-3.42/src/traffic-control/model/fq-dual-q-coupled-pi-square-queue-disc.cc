@@ -0,0 +1,375 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+#include "fq-dual-q-coupled-pi-square-queue-disc.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FqDualQCoupledPiSquareQueueDisc");
+
+NS_OBJECT_ENSURE_REGISTERED (FqDualQCoupledPiSquareQueueDisc);
+
+TypeId FqDualQCoupledPiSquareQueueDisc::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::FqDualQCoupledPiSquareQueueDisc")
+    .SetParent<DualQCoupledPiSquareQueueDisc> ()
+    .SetGroupName ("TrafficControl")
+    .AddConstructor<FqDualQCoupledPiSquareQueueDisc> ()
+    .AddAttribute ("Flows",
+                   "Number of buckets of the flow table of each queue (rounded up to a power of two)",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&FqDualQCoupledPiSquareQueueDisc::m_nBuckets),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("MaxProbes",
+                   "Maximum number of buckets probed to find the bucket of a flow",
+                   UintegerValue (8),
+                   MakeUintegerAccessor (&FqDualQCoupledPiSquareQueueDisc::m_maxProbes),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Quantum",
+                   "Deficit round robin quantum, in bytes",
+                   UintegerValue (1514),
+                   MakeUintegerAccessor (&FqDualQCoupledPiSquareQueueDisc::m_quantum),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Perturbation",
+                   "The salt used as an additional input to the hash function used to classify packets",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&FqDualQCoupledPiSquareQueueDisc::m_perturbation),
+                   MakeUintegerChecker<uint32_t> ())
+  ;
+  return tid;
+}
+
+FqDualQCoupledPiSquareQueueDisc::FqDualQCoupledPiSquareQueueDisc ()
+  : DualQCoupledPiSquareQueueDisc (),
+    m_bucketMask (0),
+    m_nCollisions (0),
+    m_freeSlot (NONE)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t q = 0; q < 2; q++)
+    {
+      m_activeHead[q] = NONE;
+      m_activeTail[q] = NONE;
+      m_nActive[q] = 0;
+      m_stored[q] = {0, 0};
+    }
+}
+
+FqDualQCoupledPiSquareQueueDisc::~FqDualQCoupledPiSquareQueueDisc ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+FqDualQCoupledPiSquareQueueDisc::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t q = 0; q < 2; q++)
+    {
+      m_flows[q].clear ();
+      m_activeHead[q] = NONE;
+      m_activeTail[q] = NONE;
+      m_nActive[q] = 0;
+      m_stored[q] = {0, 0};
+    }
+  m_poolItems.clear ();
+  m_poolArrivals.clear ();
+  m_poolSizes.clear ();
+  m_poolNext.clear ();
+  m_freeSlot = NONE;
+  DualQCoupledPiSquareQueueDisc::DoDispose ();
+}
+
+uint32_t
+FqDualQCoupledPiSquareQueueDisc::GetNActiveFlows (uint32_t q) const
+{
+  return m_nActive[q];
+}
+
+uint32_t
+FqDualQCoupledPiSquareQueueDisc::GetNCollisions (void) const
+{
+  return m_nCollisions;
+}
+
+uint32_t
+FqDualQCoupledPiSquareQueueDisc::FindFlow (uint32_t q, uint32_t hash)
+{
+  std::vector<Flow> &flows = m_flows[q];
+  uint32_t home = hash & m_bucketMask;
+  uint32_t probes = (m_maxProbes < m_bucketMask + 1) ? m_maxProbes : m_bucketMask + 1;
+  uint32_t free = NONE;
+
+  // A flow may sit past a bucket freed after it was placed, so the whole
+  // probe window is searched before a free bucket is taken
+  for (uint32_t i = 0; i < probes; i++)
+    {
+      uint32_t f = (home + i) & m_bucketMask;
+      if (flows[f].packets == 0)
+        {
+          free = (free == NONE) ? f : free;
+        }
+      else if (flows[f].hash == hash)
+        {
+          return f;
+        }
+    }
+  if (free != NONE)
+    {
+      return free;
+    }
+
+  NS_LOG_LOGIC ("No free bucket for flow " << hash << ", sharing bucket " << home);
+  m_nCollisions++;
+  return home;
+}
+
+uint32_t
+FqDualQCoupledPiSquareQueueDisc::AllocSlot (void)
+{
+  if (m_freeSlot == NONE)
+    {
+      // Double the pool and chain the new slots into the free list
+      uint32_t size = m_poolItems.size ();
+      uint32_t newSize = size ? 2 * size : 64;
+      m_poolItems.resize (newSize);
+      m_poolArrivals.resize (newSize);
+      m_poolSizes.resize (newSize);
+      m_poolNext.resize (newSize);
+      for (uint32_t i = size; i < newSize; i++)
+        {
+          m_poolNext[i] = (i + 1 < newSize) ? i + 1 : NONE;
+        }
+      m_freeSlot = size;
+    }
+  uint32_t slot = m_freeSlot;
+  m_freeSlot = m_poolNext[slot];
+  m_poolNext[slot] = NONE;
+  return slot;
+}
+
+void
+FqDualQCoupledPiSquareQueueDisc::PushActive (uint32_t q, uint32_t f)
+{
+  m_flows[q][f].next = NONE;
+  if (m_activeTail[q] == NONE)
+    {
+      m_activeHead[q] = f;
+    }
+  else
+    {
+      m_flows[q][m_activeTail[q]].next = f;
+    }
+  m_activeTail[q] = f;
+}
+
+void
+FqDualQCoupledPiSquareQueueDisc::PopActive (uint32_t q)
+{
+  uint32_t f = m_activeHead[q];
+  m_activeHead[q] = m_flows[q][f].next;
+  if (m_activeHead[q] == NONE)
+    {
+      m_activeTail[q] = NONE;
+    }
+  m_flows[q][f].next = NONE;
+}
+
+bool
+FqDualQCoupledPiSquareQueueDisc::StoreItem (uint32_t q, Ptr<QueueDiscItem> item)
+{
+  NS_LOG_FUNCTION (this << q << item);
+  uint32_t hash = item->Hash (m_perturbation);
+  uint32_t f = FindFlow (q, hash);
+  Flow &flow = m_flows[q][f];
+
+  uint32_t slot = AllocSlot ();
+  uint32_t size = item->GetSize ();
+  m_poolItems[slot] = item;
+  m_poolArrivals[slot] = Simulator::Now ().GetTimeStep ();
+  m_poolSizes[slot] = size;
+
+  if (flow.packets == 0)
+    {
+      // A new flow gets a full quantum and joins the end of the round
+      flow.hash = hash;
+      flow.head = slot;
+      flow.deficit = m_quantum;
+      PushActive (q, f);
+      m_nActive[q]++;
+    }
+  else
+    {
+      m_poolNext[flow.tail] = slot;
+    }
+  flow.tail = slot;
+  flow.packets++;
+  flow.bytes += size;
+  m_stored[q].packets++;
+  m_stored[q].bytes += size;
+
+  PacketEnqueued (item);
+  return true;
+}
+
+Ptr<QueueDiscItem>
+FqDualQCoupledPiSquareQueueDisc::ExtractItem (uint32_t q, uint32_t &size)
+{
+  NS_LOG_FUNCTION (this << q);
+  uint32_t f = m_activeHead[q];
+  if (f == NONE)
+    {
+      size = 0;
+      return nullptr;
+    }
+  Flow &flow = m_flows[q][f];
+
+  uint32_t slot = flow.head;
+  Ptr<QueueDiscItem> item = m_poolItems[slot];
+  size = m_poolSizes[slot];
+  flow.head = m_poolNext[slot];
+  m_poolItems[slot] = nullptr;
+  m_poolNext[slot] = m_freeSlot;
+  m_freeSlot = slot;
+
+  flow.packets--;
+  flow.bytes -= size;
+  flow.deficit -= size;
+  m_stored[q].packets--;
+  m_stored[q].bytes -= size;
+
+  if (flow.packets == 0)
+    {
+      PopActive (q);
+      m_nActive[q]--;
+    }
+  else if (flow.deficit <= 0)
+    {
+      // Out of credit: refill and move to the end of the round, so that
+      // the flow at the front always has credit left
+      while (flow.deficit <= 0)
+        {
+          flow.deficit += m_quantum;
+        }
+      if (m_activeHead[q] != m_activeTail[q])
+        {
+          PopActive (q);
+          PushActive (q, f);
+        }
+    }
+
+  PacketDequeued (item);
+  return item;
+}
+
+Ptr<const QueueDiscItem>
+FqDualQCoupledPiSquareQueueDisc::PeekStored (uint32_t q) const
+{
+  uint32_t f = m_activeHead[q];
+  if (f == NONE)
+    {
+      return nullptr;
+    }
+  return m_poolItems[m_flows[q][f].head];
+}
+
+Time
+FqDualQCoupledPiSquareQueueDisc::GetStoredHeadArrival (uint32_t q) const
+{
+  uint32_t f = m_activeHead[q];
+  if (f == NONE)
+    {
+      return Time (Seconds (0));
+    }
+  return TimeStep (m_poolArrivals[m_flows[q][f].head]);
+}
+
+void
+FqDualQCoupledPiSquareQueueDisc::GetStoredBacklog (uint32_t q, uint32_t &packets, uint32_t &bytes) const
+{
+  // Walk the round robin list, so that the per flow counters are checked too
+  packets = 0;
+  bytes = 0;
+  uint32_t nFlows = 0;
+  for (uint32_t f = m_activeHead[q]; f != NONE; f = m_flows[q][f].next)
+    {
+      const Flow &flow = m_flows[q][f];
+      uint32_t flowBytes = 0;
+      uint32_t flowPackets = 0;
+      for (uint32_t slot = flow.head; flowPackets < flow.packets; slot = m_poolNext[slot])
+        {
+          flowBytes += m_poolSizes[slot];
+          flowPackets++;
+        }
+      NS_ABORT_MSG_IF (flowBytes != flow.bytes,
+                       "Flow " << f << " holds " << flowBytes << " bytes, counter says " << flow.bytes);
+      packets += flow.packets;
+      bytes += flow.bytes;
+      nFlows++;
+    }
+  NS_ABORT_MSG_IF (nFlows != m_nActive[q],
+                   "Queue " << q << " has " << nFlows << " flows, counter says " << m_nActive[q]);
+  NS_ABORT_MSG_IF (packets != m_stored[q].packets || bytes != m_stored[q].bytes,
+                   "Queue " << q << " flows hold " << packets << " packets, counter says " << m_stored[q].packets);
+}
+
+bool
+FqDualQCoupledPiSquareQueueDisc::CheckConfig (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (GetNQueueDiscClasses () > 0)
+    {
+      NS_LOG_ERROR ("FqDualQCoupledPiSquareQueueDisc cannot have classes");
+      return false;
+    }
+
+  if (GetNPacketFilters () > 0)
+    {
+      NS_LOG_ERROR ("FqDualQCoupledPiSquareQueueDisc cannot have packet filters");
+      return false;
+    }
+
+  if (GetNInternalQueues () > 0)
+    {
+      NS_LOG_ERROR ("FqDualQCoupledPiSquareQueueDisc cannot have internal queues");
+      return false;
+    }
+
+  if (GetNClasses () > 2)
+    {
+      NS_LOG_ERROR ("FqDualQCoupledPiSquareQueueDisc only has the Classic and L4S classes");
+      return false;
+    }
+
+  uint32_t nBuckets = 1;
+  while (nBuckets < m_nBuckets)
+    {
+      nBuckets <<= 1;
+    }
+  m_bucketMask = nBuckets - 1;
+  for (uint32_t q = 0; q < 2; q++)
+    {
+      m_flows[q].assign (nBuckets, Flow {0, NONE, NONE, 0, 0, 0, NONE});
+    }
+  return true;
+}
+
+} //namespace ns3
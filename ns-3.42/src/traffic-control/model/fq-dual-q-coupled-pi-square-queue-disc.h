@@ -0,0 +1,154 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FQ_DUAL_Q_COUPLED_PI_SQUARE_QUEUE_DISC_H
+#define FQ_DUAL_Q_COUPLED_PI_SQUARE_QUEUE_DISC_H
+
+#include <vector>
+#include "ns3/dual-q-coupled-pi-square-queue-disc.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief DualQ Coupled PI Square queue disc with per-flow queues
+ *
+ * Each of the L4S and Classic queues of DualQCoupledPiSquareQueueDisc is
+ * split into flow queues, served by deficit round robin. Flows are told
+ * apart by QueueDiscItem::Hash (the IPv4 5-tuple for DualQ items). The
+ * scheduler between the two queues, the PI controller and the coupled
+ * mark/drop decisions are those of DualQCoupledPiSquareQueueDisc; the head
+ * of a queue is the head of the flow that deficit round robin serves next.
+ *
+ * The flows of each queue are kept in a fixed table of Flows buckets,
+ * searched by open addressing over at most MaxProbes buckets, so that
+ * lookups take constant time. A bucket is free while its flow is empty.
+ * If no bucket is free within MaxProbes, the packet shares the first
+ * bucket probed with the flow already there. Packets are stored in a pool
+ * of slots chained per flow, which only grows when the backlog exceeds
+ * its previous maximum. Classes added by AddClass are not supported.
+ */
+class FqDualQCoupledPiSquareQueueDisc : public DualQCoupledPiSquareQueueDisc
+{
+public:
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief FqDualQCoupledPiSquareQueueDisc Constructor
+   */
+  FqDualQCoupledPiSquareQueueDisc ();
+
+  /**
+   * \brief FqDualQCoupledPiSquareQueueDisc Destructor
+   */
+  virtual ~FqDualQCoupledPiSquareQueueDisc ();
+
+  /**
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \returns the number of backlogged flows in the given queue
+   */
+  uint32_t GetNActiveFlows (uint32_t q) const;
+
+  /**
+   * \returns the number of packets that shared the bucket of another flow
+   *          because no bucket was free
+   */
+  uint32_t GetNCollisions (void) const;
+
+protected:
+  virtual void DoDispose (void);
+  virtual bool CheckConfig (void);
+  virtual bool StoreItem (uint32_t q, Ptr<QueueDiscItem> item);
+  virtual Ptr<QueueDiscItem> ExtractItem (uint32_t q, uint32_t &size);
+  virtual Ptr<const QueueDiscItem> PeekStored (uint32_t q) const;
+  virtual Time GetStoredHeadArrival (uint32_t q) const;
+  virtual void GetStoredBacklog (uint32_t q, uint32_t &packets, uint32_t &bytes) const;
+
+private:
+  /**
+   * \brief A bucket of the flow table
+   */
+  struct Flow
+  {
+    uint32_t hash;                              //!< Hash of the flow, valid while it is backlogged
+    uint32_t head;                              //!< Pool slot of the head packet
+    uint32_t tail;                              //!< Pool slot of the tail packet
+    uint32_t packets;                           //!< Number of queued packets, 0 if the bucket is free
+    uint32_t bytes;                             //!< Number of queued bytes
+    int32_t deficit;                            //!< Deficit round robin credit, in bytes
+    uint32_t next;                              //!< Next flow in the round robin list of its queue
+  };
+
+  /**
+   * \brief Find the bucket of a flow, or a free bucket for it
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param hash the hash of the flow
+   * \returns the index of the bucket in the flow table of the queue
+   */
+  uint32_t FindFlow (uint32_t q, uint32_t hash);
+
+  /**
+   * \brief Take a slot from the pool, growing it if none is free
+   * \returns the index of the slot
+   */
+  uint32_t AllocSlot (void);
+
+  /**
+   * \brief Append a flow to the round robin list of its queue
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   * \param f the index of the flow
+   */
+  void PushActive (uint32_t q, uint32_t f);
+
+  /**
+   * \brief Remove the flow at the front of the round robin list of a queue
+   * \param q the queue index (0 for Classic, 1 for L4S)
+   */
+  void PopActive (uint32_t q);
+
+  static const uint32_t NONE = 0xffffffff;      //!< Null pool slot or flow index
+
+  // ** Variables supplied by user
+  uint32_t m_nBuckets;                          //!< Number of buckets of each flow table
+  uint32_t m_maxProbes;                         //!< Maximum number of buckets probed per lookup
+  uint32_t m_quantum;                           //!< Deficit round robin quantum, in bytes
+  uint32_t m_perturbation;                      //!< Hash perturbation value
+
+  // ** Variables maintained by FQ DualQ Coupled PI Square
+  std::vector<Flow> m_flows[2];                 //!< Classic (0) and L4S (1) flow tables
+  uint32_t m_bucketMask;                        //!< Number of buckets minus one
+  uint32_t m_activeHead[2];                     //!< Flow served next, per queue
+  uint32_t m_activeTail[2];                     //!< Last flow of the round robin list, per queue
+  uint32_t m_nActive[2];                        //!< Number of backlogged flows, per queue
+  Backlog m_stored[2];                          //!< Packets and bytes held in the flow queues, per queue
+  uint32_t m_nCollisions;                       //!< Packets stored in the bucket of another flow
+
+  std::vector<Ptr<QueueDiscItem> > m_poolItems; //!< Item of each pool slot
+  std::vector<int64_t> m_poolArrivals;          //!< Arrival time (in time steps) of each pool slot
+  std::vector<uint32_t> m_poolSizes;            //!< Size in bytes of each pool slot
+  std::vector<uint32_t> m_poolNext;             //!< Next slot of the same flow, or of the free list
+  uint32_t m_freeSlot;                          //!< First free slot of the pool
+};
+
+}    // namespace ns3
+
+#endif
@@ -22,12 +22,20 @@
 #include "ns3/test.h"
 #include "ns3/dual-q-coupled-pi-square-queue-disc.h"
 #include "ns3/drop-tail-queue.h"
+#include "ns3/header.h"
 #include "ns3/uinteger.h"
 #include "ns3/string.h"
 #include "ns3/double.h"
+#include "ns3/boolean.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
 using namespace ns3;
 
 class DualQueueL4SQueueDiscTestItem : public QueueDiscItem
@@ -112,6 +120,78 @@ DualQueueClassicQueueDiscTestItem::IsL4S (void)
   return false;
 }
 
+/**
+ * \brief Queue fixture shared by the DualQ test cases that drive a queue
+ *        with test items
+ */
+class DualQCoupledPiSquareTestCaseBase : public TestCase
+{
+public:
+  DualQCoupledPiSquareTestCaseBase (std::string name);
+protected:
+  /// Attribute names and values of a queue
+  typedef std::vector<std::pair<std::string, std::string> > Attributes;
+  /// Initialize is not called if \p initialize is false, e.g., to add classes first
+  Ptr<DualQCoupledPiSquareQueueDisc> CreateQueue (const Attributes &attributes, bool initialize = true);
+  void EnqueueItem (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t size, bool l4s);
+  void Enqueue (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t nPkt, bool l4s);
+  void Dequeue (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t nPkt);
+};
+
+DualQCoupledPiSquareTestCaseBase::DualQCoupledPiSquareTestCaseBase (std::string name)
+  : TestCase (name)
+{
+}
+
+Ptr<DualQCoupledPiSquareQueueDisc>
+DualQCoupledPiSquareTestCaseBase::CreateQueue (const Attributes &attributes, bool initialize)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateObject<DualQCoupledPiSquareQueueDisc> ();
+  for (const auto &attribute : attributes)
+    {
+      NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe (attribute.first, StringValue (attribute.second)), true,
+                             "Verify that we can actually set the attribute " << attribute.first);
+    }
+  queue->AssignStreams (1);
+  if (initialize)
+    {
+      queue->Initialize ();
+    }
+  return queue;
+}
+
+void
+DualQCoupledPiSquareTestCaseBase::EnqueueItem (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t size, bool l4s)
+{
+  Address dest;
+  if (l4s)
+    {
+      queue->Enqueue (Create<DualQueueL4SQueueDiscTestItem> (Create<Packet> (size), dest, 0));
+    }
+  else
+    {
+      queue->Enqueue (Create<DualQueueClassicQueueDiscTestItem> (Create<Packet> (size), dest, 0));
+    }
+}
+
+void
+DualQCoupledPiSquareTestCaseBase::Enqueue (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t nPkt, bool l4s)
+{
+  for (uint32_t i = 0; i < nPkt; i++)
+    {
+      EnqueueItem (queue, 1000, l4s);
+    }
+}
+
+void
+DualQCoupledPiSquareTestCaseBase::Dequeue (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t nPkt)
+{
+  for (uint32_t i = 0; i < nPkt; i++)
+    {
+      queue->Dequeue ();
+    }
+}
+
 class DualQCoupledPiSquareQueueDiscTestCase : public TestCase
 {
 public:
@@ -158,6 +238,8 @@ DualQCoupledPiSquareQueueDiscTestCase::RunPiSquareTest (StringValue mode)
 
   NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("QueueLimit", UintegerValue (qSize)), true,
                          "Verify that we can actually set the attribute QueueLimit");
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("CheckBacklog", BooleanValue (true)), true,
+                         "Verify that we can actually set the attribute CheckBacklog");
 
   Ptr<Packet> p1, p2, p3, p4, p5, p6, p7, p8;
   p1 = Create<Packet> (pktSize);
@@ -182,6 +264,9 @@ DualQCoupledPiSquareQueueDiscTestCase::RunPiSquareTest (StringValue mode)
   queue->Enqueue (Create<DualQueueL4SQueueDiscTestItem> (p7, dest, 0));
   queue->Enqueue (Create<DualQueueL4SQueueDiscTestItem> (p8, dest, 0));
   NS_TEST_EXPECT_MSG_EQ (queue->GetQueueSize (), 8 * modeSize, "There should be eight packets in there");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassicBacklog ().packets, 4, "There should be four Classic packets in there");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetL4SBacklog ().packets, 4, "There should be four L4S packets in there");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetL4SBacklog ().bytes, 4 * pktSize, "There should be four L4S packets worth of bytes in there");
 
   Ptr<QueueDiscItem> item;
 
@@ -359,6 +444,1184 @@ DualQCoupledPiSquareQueueDiscTestCase::DoRun (void)
   Simulator::Destroy ();
 }
 
+/**
+ * \brief Checks that the ring buffer storage engine behaves exactly like the
+ *        internal queue one
+ */
+class DualQCoupledPiSquareStorageTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareStorageTestCase ();
+  virtual void DoRun (void);
+private:
+  Ptr<DualQCoupledPiSquareQueueDisc> CreateQueue (std::string storage);
+};
+
+DualQCoupledPiSquareStorageTestCase::DualQCoupledPiSquareStorageTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check that the DualQ ring buffer storage matches the internal queue storage")
+{
+}
+
+Ptr<DualQCoupledPiSquareQueueDisc>
+DualQCoupledPiSquareStorageTestCase::CreateQueue (std::string storage)
+{
+  return DualQCoupledPiSquareTestCaseBase::CreateQueue ({{"Storage", storage},
+                                                         {"QueueLimit", "50"},
+                                                         {"ClassicQueueDelayReference", "150ms"}});
+}
+
+void
+DualQCoupledPiSquareStorageTestCase::DoRun (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queues[2];
+  queues[0] = CreateQueue ("STORAGE_INTERNAL_QUEUES");
+  queues[1] = CreateQueue ("STORAGE_RING_BUFFER");
+
+  for (uint32_t q = 0; q < 2; q++)
+    {
+      for (uint32_t i = 0; i < 400; i++)
+        {
+          Simulator::Schedule (Seconds (i * 0.005), &DualQCoupledPiSquareStorageTestCase::Enqueue, this, queues[q], 1, i % 3 == 0);
+          Simulator::Schedule (Seconds ((i + 1) * 0.012), &DualQCoupledPiSquareStorageTestCase::Dequeue, this, queues[q], 1);
+        }
+    }
+  Simulator::Stop (Seconds (8.0));
+  Simulator::Run ();
+
+  DualQCoupledPiSquareQueueDisc::Stats queueStats = queues[0]->GetStats ();
+  DualQCoupledPiSquareQueueDisc::Stats ringStats = queues[1]->GetStats ();
+  NS_TEST_EXPECT_MSG_NE (ringStats.forcedDrop, 0, "There should be some forced drops");
+  NS_TEST_EXPECT_MSG_EQ (ringStats.forcedDrop, queueStats.forcedDrop, "Forced drops should match");
+  NS_TEST_EXPECT_MSG_EQ (ringStats.unforcedL4SMark, queueStats.unforcedL4SMark, "L4S marks should match");
+  NS_TEST_EXPECT_MSG_EQ (ringStats.unforcedClassicMark, queueStats.unforcedClassicMark, "Classic marks should match");
+  NS_TEST_EXPECT_MSG_EQ (ringStats.unforcedClassicDrop, queueStats.unforcedClassicDrop, "Classic drops should match");
+  NS_TEST_EXPECT_MSG_EQ (queues[1]->GetNPackets (), queues[0]->GetNPackets (), "Backlogs should match");
+  NS_TEST_EXPECT_MSG_EQ (queues[1]->GetQueueSize (), queues[0]->GetQueueSize (), "Queue sizes should match");
+
+  queues[0]->Dispose ();
+  queues[1]->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Checks that the DualQ items rewrite the ECN field of the IPv4
+ *        header in place and keep the header checksum valid
+ */
+class DualQCoupledPiSquareMarkTestCase : public TestCase
+{
+public:
+  DualQCoupledPiSquareMarkTestCase ();
+  virtual void DoRun (void);
+private:
+  Ptr<Packet> CreateIpv4Packet (uint32_t prefix, uint8_t ecn, bool checksum);
+  uint16_t SumHeader (const uint8_t *header);
+  void CheckMarked (Ptr<Packet> p, uint32_t prefix, uint32_t size);
+};
+
+DualQCoupledPiSquareMarkTestCase::DualQCoupledPiSquareMarkTestCase ()
+  : TestCase ("Check ECN marking of DualQ items")
+{
+}
+
+uint16_t
+DualQCoupledPiSquareMarkTestCase::SumHeader (const uint8_t *header)
+{
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < 20; i += 2)
+    {
+      sum += (header[i] << 8) | header[i + 1];
+    }
+  while (sum >> 16)
+    {
+      sum = (sum & 0xffff) + (sum >> 16);
+    }
+  return sum;
+}
+
+Ptr<Packet>
+DualQCoupledPiSquareMarkTestCase::CreateIpv4Packet (uint32_t prefix, uint8_t ecn, bool checksum)
+{
+  uint8_t bytes[100] = {0};
+  for (uint32_t i = 0; i < prefix; i++)
+    {
+      bytes[i] = 0xa0 + i;
+    }
+  uint8_t *ip = bytes + prefix;
+  ip[0] = 0x45;
+  ip[1] = 0xb8 | ecn;
+  ip[3] = 100 - prefix;
+  ip[8] = 64;
+  ip[9] = 6;
+  ip[12] = 10;
+  ip[15] = 1;
+  ip[16] = 10;
+  ip[19] = 2;
+  if (checksum)
+    {
+      uint16_t sum = ~SumHeader (ip) & 0xffff;
+      ip[10] = sum >> 8;
+      ip[11] = sum & 0xff;
+    }
+  for (uint32_t i = prefix + 20; i < 100; i++)
+    {
+      bytes[i] = i;
+    }
+  return Create<Packet> (bytes, 100);
+}
+
+void
+DualQCoupledPiSquareMarkTestCase::CheckMarked (Ptr<Packet> p, uint32_t prefix, uint32_t size)
+{
+  uint8_t bytes[100];
+  NS_TEST_EXPECT_MSG_EQ (p->GetSize (), size, "Marking should not change the packet size");
+  p->CopyData (bytes, size);
+  for (uint32_t i = 0; i < prefix; i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[i], 0xa0 + i, "The bytes preceding the IPv4 header should be untouched");
+    }
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[prefix + 1], 0xbb, "The ECN field should be CE and the DSCP untouched");
+  NS_TEST_EXPECT_MSG_EQ (SumHeader (bytes + prefix), 0xffff, "The IPv4 header checksum should still be valid");
+  for (uint32_t i = prefix + 20; i < size; i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[i], i, "The payload should be untouched");
+    }
+}
+
+void
+DualQCoupledPiSquareMarkTestCase::DoRun (void)
+{
+  Address dest;
+
+  // ECT(1) packet carrying a bare IPv4 header
+  Ptr<Packet> p = CreateIpv4Packet (0, 0x01, true);
+  Ptr<DualQueueL4SQueueDiscItem> l4sItem = Create<DualQueueL4SQueueDiscItem> (p, dest, 0);
+  NS_TEST_EXPECT_MSG_EQ (l4sItem->Mark (), true, "An ECT(1) packet should be marked");
+  CheckMarked (p, 0, 100);
+  NS_TEST_EXPECT_MSG_EQ (l4sItem->Mark (), true, "A CE packet should stay marked");
+  CheckMarked (p, 0, 100);
+
+  // ECT(0) packet whose IPv4 header sits below a 2-byte header (e.g., PDCP)
+  p = CreateIpv4Packet (2, 0x02, true);
+  Ptr<DualQueueClassicQueueDiscItem> classicItem = Create<DualQueueClassicQueueDiscItem> (p, dest, 0);
+  classicItem->SetIpv4HeaderOffset (2);
+  NS_TEST_EXPECT_MSG_EQ (classicItem->Mark (), true, "An ECT(0) packet should be marked");
+  CheckMarked (p, 2, 100);
+
+  // Not-ECT packets cannot be marked by the Classic queue
+  p = CreateIpv4Packet (0, 0x00, true);
+  classicItem = Create<DualQueueClassicQueueDiscItem> (p, dest, 0);
+  NS_TEST_EXPECT_MSG_EQ (classicItem->Mark (), false, "A Not-ECT packet should not be marked");
+  uint8_t bytes[20];
+  p->CopyData (bytes, 20);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[1], 0xb8, "A Not-ECT packet should be untouched");
+
+  // A disabled (zero) checksum is left alone
+  p = CreateIpv4Packet (0, 0x01, false);
+  l4sItem = Create<DualQueueL4SQueueDiscItem> (p, dest, 0);
+  NS_TEST_EXPECT_MSG_EQ (l4sItem->Mark (), true, "An ECT(1) packet should be marked");
+  p->CopyData (bytes, 20);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[1], 0xb9, "The ECN field should be CE");
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) ((bytes[10] << 8) | bytes[11]), 0, "A zero checksum should stay zero");
+
+  // Segments that do not start with an IPv4 header are never marked
+  p = CreateIpv4Packet (0, 0x01, true);
+  l4sItem = Create<DualQueueL4SQueueDiscItem> (p, dest, 0);
+  l4sItem->SetIpv4HeaderOffset (DUALQ_NO_IPV4_HEADER);
+  NS_TEST_EXPECT_MSG_EQ (l4sItem->Mark (), false, "A packet without IPv4 header should not be marked");
+  p->CopyData (bytes, 20);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[1], 0xb9, "A packet without IPv4 header should be untouched");
+}
+
+/**
+ * \brief Checks that DequeueBurst fills a byte budget the way an RLC
+ *        transmitter would
+ */
+class DualQCoupledPiSquareBurstTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareBurstTestCase ();
+  virtual void DoRun (void);
+private:
+  void BurstTrace (uint32_t nItems, uint32_t nBytes);
+  uint32_t m_nBursts;         //!< Number of DequeueBurst traces fired
+  uint32_t m_burstItems;      //!< Items reported by the last trace
+  uint32_t m_burstBytes;      //!< Bytes reported by the last trace
+};
+
+DualQCoupledPiSquareBurstTestCase::DualQCoupledPiSquareBurstTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check DualQ batch dequeue"),
+    m_nBursts (0),
+    m_burstItems (0),
+    m_burstBytes (0)
+{
+}
+
+void
+DualQCoupledPiSquareBurstTestCase::BurstTrace (uint32_t nItems, uint32_t nBytes)
+{
+  m_nBursts++;
+  m_burstItems = nItems;
+  m_burstBytes = nBytes;
+}
+
+void
+DualQCoupledPiSquareBurstTestCase::DoRun (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"QueueLimit", "20"}});
+  queue->TraceConnectWithoutContext ("DequeueBurst", MakeCallback (&DualQCoupledPiSquareBurstTestCase::BurstTrace, this));
+  Enqueue (queue, 10, false);
+
+  // 3500 bytes with 12 bits of overhead per interior item: three whole
+  // items (3000 + 5 bytes), then 495 bytes left for the fourth one
+  std::vector<Ptr<QueueDiscItem> > out;
+  Ptr<QueueDiscItem> partial = queue->DequeueBurst (3500, out, 12);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 4, "Four items should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial, out.back (), "The last item should have to be segmented");
+  NS_TEST_EXPECT_MSG_EQ (m_nBursts, 1, "The trace should be fired once per batch");
+  NS_TEST_EXPECT_MSG_EQ (m_burstItems, 4, "The trace should report four items");
+  NS_TEST_EXPECT_MSG_EQ (m_burstBytes, 4000, "The trace should report 4000 bytes");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueSize (), 6, "There should be six packets left");
+
+  // Two items fill 2002 bytes exactly
+  out.clear ();
+  partial = queue->DequeueBurst (2002, out, 12);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 2, "Two items should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial == nullptr, true, "No item should have to be segmented");
+
+  // An item larger than maxInteriorSize ends the batch
+  out.clear ();
+  partial = queue->DequeueBurst (5000, out, 12, 999);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 1, "Only one item should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial == nullptr, true, "No item should have to be segmented");
+
+  // Not enough budget left after an item for another one
+  out.clear ();
+  partial = queue->DequeueBurst (1002, out, 12);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 1, "Only one item should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial == nullptr, true, "No item should have to be segmented");
+
+  // The queue runs dry before the budget
+  out.clear ();
+  partial = queue->DequeueBurst (100000, out, 12);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 2, "The last two items should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial == nullptr, true, "No item should have to be segmented");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueSize (), 0, "The queue should be empty");
+
+  out.clear ();
+  queue->DequeueBurst (100000, out, 12);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 0, "Nothing should be dequeued from an empty queue");
+  NS_TEST_EXPECT_MSG_EQ (m_nBursts, 5, "No trace should be fired for an empty batch");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Checks that the remainder of a segmented item is served first,
+ *        keeping its class and arrival time
+ */
+class DualQCoupledPiSquareRequeueHeadTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareRequeueHeadTestCase ();
+  virtual void DoRun (void);
+private:
+  void RunRequeueHeadTest (std::string storage);
+  void SegmentHead (Ptr<DualQCoupledPiSquareQueueDisc> queue);
+};
+
+DualQCoupledPiSquareRequeueHeadTestCase::DualQCoupledPiSquareRequeueHeadTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check DualQ head segment requeue")
+{
+}
+
+void
+DualQCoupledPiSquareRequeueHeadTestCase::SegmentHead (Ptr<DualQCoupledPiSquareQueueDisc> queue)
+{
+  Ptr<QueueDiscItem> item = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (item->GetSize (), 1000, "The first item should have been dequeued");
+
+  // Send the first 600 bytes and give back the remainder
+  item->GetPacket ()->RemoveAtStart (600);
+  queue->RequeueHead (item);
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassicBacklog ().packets, 2, "The remainder should be counted in the backlog");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassicBacklog ().bytes, 900, "The remainder should be counted in the backlog");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueDelay (), Seconds (0), "The remainder should keep its arrival time");
+
+  Ptr<QueueDiscItem> next = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (next, item, "The remainder should be served first");
+  NS_TEST_EXPECT_MSG_EQ (next->GetSize (), 400, "The remainder should be 400 bytes");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueDelay (), Seconds (0.2), "The second item should be the head");
+  next = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (next->GetSize (), 500, "The second item should be served next");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueSize (), 0, "The queue should be empty");
+}
+
+void
+DualQCoupledPiSquareRequeueHeadTestCase::RunRequeueHeadTest (std::string storage)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"Storage", storage},
+                                                           {"CheckBacklog", "true"}});
+
+  Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareRequeueHeadTestCase::EnqueueItem, this, queue, 1000, false);
+  Simulator::Schedule (Seconds (0.2), &DualQCoupledPiSquareRequeueHeadTestCase::EnqueueItem, this, queue, 500, false);
+  Simulator::Schedule (Seconds (1), &DualQCoupledPiSquareRequeueHeadTestCase::SegmentHead, this, queue);
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareRequeueHeadTestCase::DoRun (void)
+{
+  RunRequeueHeadTest ("STORAGE_INTERNAL_QUEUES");
+  RunRequeueHeadTest ("STORAGE_RING_BUFFER");
+}
+
+/**
+ * \brief Checks the native L4S ramp, with both controllers, and the
+ *        overload handling of the RFC 9332 controller
+ */
+class DualQCoupledPiSquareRfc9332TestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareRfc9332TestCase ();
+  virtual void DoRun (void);
+private:
+  Ptr<DualQCoupledPiSquareQueueDisc> CreateQueue (std::string controller, Time rampRange);
+  void RunRampTest (std::string controller, Time rampRange);
+  void RunOverloadTest (void);
+  void CheckLastPacket (Ptr<DualQCoupledPiSquareQueueDisc> queue, bool l4s);
+  void RunLastPacketTest (void);
+};
+
+DualQCoupledPiSquareRfc9332TestCase::DualQCoupledPiSquareRfc9332TestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check the RFC 9332 controller and the native L4S ramp of the DualQ")
+{
+}
+
+Ptr<DualQCoupledPiSquareQueueDisc>
+DualQCoupledPiSquareRfc9332TestCase::CreateQueue (std::string controller, Time rampRange)
+{
+  return DualQCoupledPiSquareTestCaseBase::CreateQueue ({{"Controller", controller},
+                                                         {"L4SRange", std::to_string (rampRange.GetMicroSeconds ()) + "us"},
+                                                         {"L4SRamp", "true"},
+                                                         {"QueueLimit", "1000"}});
+}
+
+void
+DualQCoupledPiSquareRfc9332TestCase::RunRampTest (std::string controller, Time rampRange)
+{
+  // The queue is too short for the base probability to grow: only the
+  // native ramp marks
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue (controller, rampRange);
+  Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareRfc9332TestCase::Enqueue, this, queue, 10, true);
+  // Below minTh
+  Simulator::Schedule (MicroSeconds (500), &DualQCoupledPiSquareRfc9332TestCase::Dequeue, this, queue, 5);
+  // Beyond minTh + range
+  Simulator::Schedule (MilliSeconds (2), &DualQCoupledPiSquareRfc9332TestCase::Dequeue, this, queue, 5);
+  Simulator::Stop (MilliSeconds (3));
+  Simulator::Run ();
+
+  DualQCoupledPiSquareQueueDisc::Stats st = queue->GetStats ();
+  NS_TEST_EXPECT_MSG_EQ (queue->GetDropProb (), 0, "The base probability should be zero");
+  NS_TEST_EXPECT_MSG_EQ (st.unforcedL4SMark, 4, "All the packets beyond the ramp but the last one should be marked");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueSize (), 0, "The queue should be empty");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareRfc9332TestCase::RunOverloadTest (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queues[2];
+  queues[0] = CreateQueue ("CONTROLLER_LEGACY", MicroSeconds (400));
+  queues[1] = CreateQueue ("CONTROLLER_RFC9332", MicroSeconds (400));
+
+  // A standing Classic queue of one second drives the probability to 1
+  for (uint32_t q = 0; q < 2; q++)
+    {
+      Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareRfc9332TestCase::Enqueue, this, queues[q], 200, false);
+      Simulator::Schedule (Seconds (1), &DualQCoupledPiSquareRfc9332TestCase::Dequeue, this, queues[q], 200);
+    }
+  Simulator::Stop (Seconds (1.5));
+  Simulator::Run ();
+
+  DualQCoupledPiSquareQueueDisc::Stats legacy = queues[0]->GetStats ();
+  NS_TEST_EXPECT_MSG_NE (legacy.unforcedClassicMark, 0, "The legacy controller should mark ECN capable packets");
+  NS_TEST_EXPECT_MSG_EQ (legacy.unforcedClassicDrop, 0, "The legacy controller should not drop ECN capable packets");
+
+  DualQCoupledPiSquareQueueDisc::Stats rfc = queues[1]->GetStats ();
+  NS_TEST_EXPECT_MSG_EQ (queues[1]->GetDropProb (), 1, "The base probability should be saturated");
+  NS_TEST_EXPECT_MSG_EQ (rfc.unforcedClassicMark, 0, "Nothing should be marked under overload");
+  NS_TEST_EXPECT_MSG_EQ (rfc.unforcedClassicDrop, 199, "All the ECN capable packets but the last one should be dropped under overload");
+
+  queues[0]->Dispose ();
+  queues[1]->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareRfc9332TestCase::CheckLastPacket (Ptr<DualQCoupledPiSquareQueueDisc> queue, bool l4s)
+{
+  NS_TEST_EXPECT_MSG_EQ (queue->GetDropProb (), 1, "The base probability should be saturated");
+  Enqueue (queue, 1, l4s);
+  Ptr<QueueDiscItem> item = queue->Dequeue ();
+  NS_TEST_ASSERT_MSG_NE (item, nullptr, "The only packet in the queue should be sent");
+  NS_TEST_EXPECT_MSG_EQ (item->IsL4S (), l4s, "The wrong packet was sent");
+}
+
+void
+DualQCoupledPiSquareRfc9332TestCase::RunLastPacketTest (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ("CONTROLLER_RFC9332", MicroSeconds (400));
+
+  // Drive the probability to 1 and drain the queue, then send packets alone
+  Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareRfc9332TestCase::Enqueue, this, queue, 200, false);
+  Simulator::Schedule (Seconds (1), &DualQCoupledPiSquareRfc9332TestCase::Dequeue, this, queue, 200);
+  Simulator::Schedule (MilliSeconds (1001), &DualQCoupledPiSquareRfc9332TestCase::CheckLastPacket, this, queue, false);
+  Simulator::Schedule (MilliSeconds (1002), &DualQCoupledPiSquareRfc9332TestCase::CheckLastPacket, this, queue, true);
+  Simulator::Stop (MilliSeconds (1003));
+  Simulator::Run ();
+
+  DualQCoupledPiSquareQueueDisc::Stats st = queue->GetStats ();
+  NS_TEST_EXPECT_MSG_EQ (st.unforcedClassicDrop, 199, "Only the packets followed by another one should be dropped");
+  NS_TEST_EXPECT_MSG_EQ (st.unforcedL4SDrop, 0, "The L4S packet alone in the queue should not be dropped");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetQueueSize (), 0, "The queue should be empty");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareRfc9332TestCase::DoRun (void)
+{
+  RunRampTest ("CONTROLLER_RFC9332", MicroSeconds (400));
+  // Step marking at minTh
+  RunRampTest ("CONTROLLER_RFC9332", Seconds (0));
+  // The legacy controller with the ramp instead of the L4SMarkThresold step
+  RunRampTest ("CONTROLLER_LEGACY", MicroSeconds (400));
+  RunOverloadTest ();
+  RunLastPacketTest ();
+}
+
+/**
+ * \brief Checks that the FixedPoint probability update tracks the floating
+ *        point one
+ */
+class DualQCoupledPiSquareFixedPointTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareFixedPointTestCase ();
+  virtual void DoRun (void);
+private:
+  Ptr<DualQCoupledPiSquareQueueDisc> CreateQueue (std::string controller, bool fixedPoint);
+  void CompareProb (Ptr<DualQCoupledPiSquareQueueDisc> floating, Ptr<DualQCoupledPiSquareQueueDisc> fixed);
+  void RunFixedPointTest (std::string controller);
+  double m_maxDeviation; //!< Largest deviation of the base probability seen so far
+};
+
+DualQCoupledPiSquareFixedPointTestCase::DualQCoupledPiSquareFixedPointTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check the fixed-point probability update of the DualQ against the floating point one"),
+    m_maxDeviation (0)
+{
+}
+
+Ptr<DualQCoupledPiSquareQueueDisc>
+DualQCoupledPiSquareFixedPointTestCase::CreateQueue (std::string controller, bool fixedPoint)
+{
+  return DualQCoupledPiSquareTestCaseBase::CreateQueue ({{"Controller", controller},
+                                                         {"FixedPoint", fixedPoint ? "true" : "false"},
+                                                         {"QueueLimit", "1000"}});
+}
+
+void
+DualQCoupledPiSquareFixedPointTestCase::CompareProb (Ptr<DualQCoupledPiSquareQueueDisc> floating, Ptr<DualQCoupledPiSquareQueueDisc> fixed)
+{
+  double deviation = std::abs (floating->GetDropProb () - fixed->GetDropProb ());
+  m_maxDeviation = (deviation > m_maxDeviation) ? deviation : m_maxDeviation;
+}
+
+void
+DualQCoupledPiSquareFixedPointTestCase::RunFixedPointTest (std::string controller)
+{
+  // Classic test items are always marked, never dropped, so both queues
+  // see the same sojourn times whatever their random draws are
+  Ptr<DualQCoupledPiSquareQueueDisc> floating = CreateQueue (controller, false);
+  Ptr<DualQCoupledPiSquareQueueDisc> fixed = CreateQueue (controller, true);
+  m_maxDeviation = 0;
+
+  // A standing queue of about 20 ms, a few ms above the target
+  for (Ptr<DualQCoupledPiSquareQueueDisc> queue : {floating, fixed})
+    {
+      Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareFixedPointTestCase::Enqueue, this, queue, 4, false);
+      for (uint32_t i = 0; i < 250; i++)
+        {
+          Simulator::Schedule (MilliSeconds (3 + 6 * i), &DualQCoupledPiSquareFixedPointTestCase::Dequeue, this, queue, 1);
+          Simulator::Schedule (MilliSeconds (6 + 6 * i), &DualQCoupledPiSquareFixedPointTestCase::Enqueue, this, queue, 1, false);
+        }
+    }
+  for (uint32_t i = 0; i < 150; i++)
+    {
+      Simulator::Schedule (MilliSeconds (1 + 10 * i), &DualQCoupledPiSquareFixedPointTestCase::CompareProb, this, floating, fixed);
+    }
+  Simulator::Stop (Seconds (1.5));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_GT (floating->GetDropProb (), 0, "The base probability should have grown");
+  NS_TEST_EXPECT_MSG_LT (floating->GetDropProb (), 0.5, "The RFC 9332 controller should not be overloaded");
+  NS_TEST_EXPECT_MSG_LT_OR_EQ (m_maxDeviation, 1e-5, "The fixed-point probability should track the floating point one");
+  NS_TEST_EXPECT_MSG_EQ (floating->GetStats ().unforcedClassicDrop, 0, "There should be no drops");
+  NS_TEST_EXPECT_MSG_EQ (fixed->GetStats ().unforcedClassicDrop, 0, "There should be no drops");
+
+  floating->Dispose ();
+  fixed->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareFixedPointTestCase::DoRun (void)
+{
+  RunFixedPointTest ("CONTROLLER_LEGACY");
+  RunFixedPointTest ("CONTROLLER_RFC9332");
+}
+
+/**
+ * \brief Checks that LazyUpdate gives the same probabilities as the timer
+ */
+class DualQCoupledPiSquareLazyUpdateTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareLazyUpdateTestCase ();
+  virtual void DoRun (void);
+private:
+  Ptr<DualQCoupledPiSquareQueueDisc> CreateQueue (std::string controller, bool lazy);
+  void CompareProb (Ptr<DualQCoupledPiSquareQueueDisc> timer, Ptr<DualQCoupledPiSquareQueueDisc> lazy);
+  void RunLazyUpdateTest (std::string controller);
+  uint32_t m_nMismatches; //!< Number of samples where the probabilities differ
+};
+
+DualQCoupledPiSquareLazyUpdateTestCase::DualQCoupledPiSquareLazyUpdateTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check that the lazy probability update of the DualQ matches the timer-driven one"),
+    m_nMismatches (0)
+{
+}
+
+Ptr<DualQCoupledPiSquareQueueDisc>
+DualQCoupledPiSquareLazyUpdateTestCase::CreateQueue (std::string controller, bool lazy)
+{
+  return DualQCoupledPiSquareTestCaseBase::CreateQueue ({{"Controller", controller},
+                                                         {"LazyUpdate", lazy ? "true" : "false"},
+                                                         {"Supdate", "5ms"},
+                                                         {"QueueLimit", "1000"}});
+}
+
+void
+DualQCoupledPiSquareLazyUpdateTestCase::CompareProb (Ptr<DualQCoupledPiSquareQueueDisc> timer, Ptr<DualQCoupledPiSquareQueueDisc> lazy)
+{
+  if (timer->GetDropProb () != lazy->GetDropProb ())
+    {
+      m_nMismatches++;
+    }
+}
+
+void
+DualQCoupledPiSquareLazyUpdateTestCase::RunLazyUpdateTest (std::string controller)
+{
+  // Updates are due at 5 ms + k * 16 ms; no enqueue, dequeue or sample
+  // falls on one of them, so the order of simultaneous events does not matter
+  Ptr<DualQCoupledPiSquareQueueDisc> timer = CreateQueue (controller, false);
+  Ptr<DualQCoupledPiSquareQueueDisc> lazy = CreateQueue (controller, true);
+  m_nMismatches = 0;
+
+  for (Ptr<DualQCoupledPiSquareQueueDisc> queue : {timer, lazy})
+    {
+      // A standing queue above the target, then an idle period that lets
+      // the probability decay back to zero, then a short burst
+      Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareLazyUpdateTestCase::Enqueue, this, queue, 4, false);
+      for (uint32_t i = 0; i < 100; i++)
+        {
+          Simulator::Schedule (MicroSeconds (3100 + 6000 * i), &DualQCoupledPiSquareLazyUpdateTestCase::Dequeue, this, queue, 1);
+          Simulator::Schedule (MicroSeconds (6100 + 6000 * i), &DualQCoupledPiSquareLazyUpdateTestCase::Enqueue, this, queue, 1, false);
+        }
+      Simulator::Schedule (MicroSeconds (700100), &DualQCoupledPiSquareLazyUpdateTestCase::Dequeue, this, queue, 4);
+      Simulator::Schedule (MicroSeconds (1500100), &DualQCoupledPiSquareLazyUpdateTestCase::Enqueue, this, queue, 3, false);
+      Simulator::Schedule (MicroSeconds (1550100), &DualQCoupledPiSquareLazyUpdateTestCase::Dequeue, this, queue, 3);
+    }
+  for (uint32_t i = 0; i < 200; i++)
+    {
+      Simulator::Schedule (MicroSeconds (1300 + 10000 * i), &DualQCoupledPiSquareLazyUpdateTestCase::CompareProb, this, timer, lazy);
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_nMismatches, 0, "The lazy update should give the same probabilities as the timer");
+  NS_TEST_EXPECT_MSG_EQ (timer->GetStats ().unforcedClassicMark, lazy->GetStats ().unforcedClassicMark,
+                         "The lazy update should give the same marks as the timer");
+
+  timer->Dispose ();
+  lazy->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareLazyUpdateTestCase::DoRun (void)
+{
+  RunLazyUpdateTest ("CONTROLLER_LEGACY");
+  RunLazyUpdateTest ("CONTROLLER_RFC9332");
+}
+
+/**
+ * \brief Checks the departure rate estimator of the queue delay
+ */
+class DualQCoupledPiSquareDepartureRateTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareDepartureRateTestCase ();
+  virtual void DoRun (void);
+private:
+  Ptr<DualQCoupledPiSquareQueueDisc> CreateQueue (std::string estimator);
+  void CheckDelay (Ptr<DualQCoupledPiSquareQueueDisc> queue, Time expected, Time tolerance);
+  void DequeueRate (uint32_t q, double sample, double average);
+  uint32_t m_nCycles;   //!< Number of measurement cycles traced
+  double m_lastSample;  //!< Last traced departure rate sample
+};
+
+DualQCoupledPiSquareDepartureRateTestCase::DualQCoupledPiSquareDepartureRateTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check the departure rate estimator of the DualQ queue delay"),
+    m_nCycles (0),
+    m_lastSample (0)
+{
+}
+
+Ptr<DualQCoupledPiSquareQueueDisc>
+DualQCoupledPiSquareDepartureRateTestCase::CreateQueue (std::string estimator)
+{
+  return DualQCoupledPiSquareTestCaseBase::CreateQueue ({{"QueueDelayEstimator", estimator},
+                                                         {"DequeueThreshold", "5000"},
+                                                         {"QueueLimit", "1000"}});
+}
+
+void
+DualQCoupledPiSquareDepartureRateTestCase::CheckDelay (Ptr<DualQCoupledPiSquareQueueDisc> queue, Time expected, Time tolerance)
+{
+  Time delay = Simulator::Now () - queue->GetQueueDelay ();
+  NS_TEST_EXPECT_MSG_EQ_TOL (delay, expected, tolerance, "Unexpected queue delay");
+}
+
+void
+DualQCoupledPiSquareDepartureRateTestCase::DequeueRate (uint32_t q, double sample, double /* average */)
+{
+  NS_TEST_EXPECT_MSG_EQ (q, 0, "Only the Classic queue is served");
+  m_nCycles++;
+  m_lastSample = sample;
+}
+
+void
+DualQCoupledPiSquareDepartureRateTestCase::DoRun (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> rate = CreateQueue ("QUEUE_DELAY_DEPARTURE_RATE");
+  Ptr<DualQCoupledPiSquareQueueDisc> fallback = CreateQueue ("QUEUE_DELAY_TIMESTAMP_OR_RATE");
+  rate->TraceConnectWithoutContext ("DequeueRate",
+                                    MakeCallback (&DualQCoupledPiSquareDepartureRateTestCase::DequeueRate, this));
+
+  // 50 packets of 1000 bytes drained at 1000 bytes per ms: a measurement
+  // cycle ends every 5 packets
+  for (Ptr<DualQCoupledPiSquareQueueDisc> queue : {rate, fallback})
+    {
+      Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareDepartureRateTestCase::Enqueue, this, queue, 50, false);
+      for (uint32_t i = 1; i <= 30; i++)
+        {
+          Simulator::Schedule (MilliSeconds (i), &DualQCoupledPiSquareDepartureRateTestCase::Dequeue, this, queue, 1);
+        }
+    }
+  // 20 packets left at about 1000 bytes per ms
+  Simulator::Schedule (MicroSeconds (30500), &DualQCoupledPiSquareDepartureRateTestCase::CheckDelay, this,
+                       rate, MilliSeconds (20), MilliSeconds (1));
+  // The timestamps are valid, so they are used
+  Simulator::Schedule (MicroSeconds (30500), &DualQCoupledPiSquareDepartureRateTestCase::CheckDelay, this,
+                       fallback, MicroSeconds (30500), MicroSeconds (1));
+  Simulator::Stop (MilliSeconds (31));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_nCycles, 6, "There should be 6 measurement cycles");
+  NS_TEST_EXPECT_MSG_EQ_TOL (m_lastSample, 1e6, 1, "The last cycle should measure 1000 bytes per ms");
+
+  rate->Dispose ();
+  fallback->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Checks that SetTargetScale scales the targets and the gains
+ */
+class DualQCoupledPiSquareTargetScaleTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareTargetScaleTestCase ();
+  virtual void DoRun (void);
+private:
+  void CheckParams (Ptr<DualQCoupledPiSquareQueueDisc> queue, double scale);
+};
+
+DualQCoupledPiSquareTargetScaleTestCase::DualQCoupledPiSquareTargetScaleTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check the scaling of the DualQ targets")
+{
+}
+
+void
+DualQCoupledPiSquareTargetScaleTestCase::CheckParams (Ptr<DualQCoupledPiSquareQueueDisc> queue, double scale)
+{
+  TimeValue time;
+  DoubleValue gain;
+  NS_TEST_EXPECT_MSG_EQ_TOL (queue->GetTargetScale (), scale, 1e-12, "Unexpected target scale");
+  queue->GetAttribute ("ClassicQueueDelayReference", time);
+  NS_TEST_EXPECT_MSG_EQ_TOL (time.Get (), MicroSeconds (15000 * scale), NanoSeconds (1), "Unexpected Classic target");
+  queue->GetAttribute ("L4SMarkThresold", time);
+  NS_TEST_EXPECT_MSG_EQ_TOL (time.Get (), MicroSeconds (1000 * scale), NanoSeconds (1), "Unexpected L4S threshold");
+  queue->GetAttribute ("A", gain);
+  NS_TEST_EXPECT_MSG_EQ_TOL (gain.Get (), 10 / scale, 1e-9, "Unexpected integral gain");
+  queue->GetAttribute ("B", gain);
+  NS_TEST_EXPECT_MSG_EQ_TOL (gain.Get (), 100 / scale, 1e-9, "Unexpected proportional gain");
+}
+
+void
+DualQCoupledPiSquareTargetScaleTestCase::DoRun (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"ClassicQueueDelayReference", "15ms"},
+                                                           {"L4SMarkThresold", "1ms"},
+                                                           {"A", "10"},
+                                                           {"B", "100"}});
+  CheckParams (queue, 1);
+
+  // The scale is relative to the configured values, not cumulative
+  queue->SetTargetScale (4);
+  CheckParams (queue, 4);
+  queue->SetTargetScale (0.5);
+  CheckParams (queue, 0.5);
+  queue->SetTargetScale (1);
+  CheckParams (queue, 1);
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Checks that the marks are decided where MarkingPoint says
+ */
+class DualQCoupledPiSquareMarkingPointTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareMarkingPointTestCase ();
+  virtual void DoRun (void);
+private:
+  void RunMarkingPointTest (std::string markingPoint, uint32_t enqueueMarks, uint32_t dequeueMarks);
+  void DequeueAll (Ptr<DualQCoupledPiSquareQueueDisc> queue);
+  void EnqueueMark (Ptr<const QueueDiscItem> item, Time sojourn);
+  void DequeueMark (Ptr<const QueueDiscItem> item, Time sojourn);
+  uint32_t m_enqueueMarks;  //!< Marks traced at enqueue
+  uint32_t m_dequeueMarks;  //!< Marks traced at dequeue
+};
+
+DualQCoupledPiSquareMarkingPointTestCase::DualQCoupledPiSquareMarkingPointTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check the marking point of the DualQ"),
+    m_enqueueMarks (0),
+    m_dequeueMarks (0)
+{
+}
+
+void
+DualQCoupledPiSquareMarkingPointTestCase::DequeueAll (Ptr<DualQCoupledPiSquareQueueDisc> queue)
+{
+  while (queue->Dequeue ())
+    {
+    }
+}
+
+void
+DualQCoupledPiSquareMarkingPointTestCase::EnqueueMark (Ptr<const QueueDiscItem> /* item */, Time sojourn)
+{
+  NS_TEST_EXPECT_MSG_EQ (sojourn, MilliSeconds (5), "The decision should use the sojourn of the head");
+  m_enqueueMarks++;
+}
+
+void
+DualQCoupledPiSquareMarkingPointTestCase::DequeueMark (Ptr<const QueueDiscItem> /* item */, Time sojourn)
+{
+  NS_TEST_EXPECT_MSG_EQ (sojourn, MilliSeconds (6), "The decision should use the sojourn of the packet");
+  m_dequeueMarks++;
+}
+
+void
+DualQCoupledPiSquareMarkingPointTestCase::RunMarkingPointTest (std::string markingPoint, uint32_t enqueueMarks, uint32_t dequeueMarks)
+{
+  m_enqueueMarks = 0;
+  m_dequeueMarks = 0;
+  // No probability, so that only the L4S threshold marks
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"MarkingPoint", markingPoint},
+                                                           {"L4SMarkThresold", "1ms"},
+                                                           {"A", "0"},
+                                                           {"B", "0"}});
+  queue->TraceConnectWithoutContext ("EnqueueMark",
+                                     MakeCallback (&DualQCoupledPiSquareMarkingPointTestCase::EnqueueMark, this));
+  queue->TraceConnectWithoutContext ("DequeueMark",
+                                     MakeCallback (&DualQCoupledPiSquareMarkingPointTestCase::DequeueMark, this));
+
+  // The sixth packet finds a head that waited 5 ms; at 6 ms, the first
+  // three packets leave more than 2 packets behind them
+  Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareMarkingPointTestCase::Enqueue, this, queue, 5, true);
+  Simulator::Schedule (MilliSeconds (5), &DualQCoupledPiSquareMarkingPointTestCase::Enqueue, this, queue, 1, true);
+  Simulator::Schedule (MilliSeconds (6), &DualQCoupledPiSquareMarkingPointTestCase::DequeueAll, this, queue);
+  Simulator::Stop (MilliSeconds (7));
+  Simulator::Run ();
+
+  DualQCoupledPiSquareQueueDisc::Stats stats = queue->GetStats ();
+  NS_TEST_EXPECT_MSG_EQ (m_enqueueMarks, enqueueMarks, "Unexpected number of marks at enqueue");
+  NS_TEST_EXPECT_MSG_EQ (m_dequeueMarks, dequeueMarks, "Unexpected number of marks at dequeue");
+  NS_TEST_EXPECT_MSG_EQ (stats.unforcedL4SMark, enqueueMarks + dequeueMarks, "All the marks should be counted");
+  NS_TEST_EXPECT_MSG_EQ (stats.enqueueL4SMark, enqueueMarks, "The marks at enqueue should be counted apart");
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareMarkingPointTestCase::DoRun (void)
+{
+  RunMarkingPointTest ("MARK_ON_DEQUEUE", 0, 3);
+  RunMarkingPointTest ("MARK_ON_ENQUEUE", 1, 0);
+  RunMarkingPointTest ("MARK_HYBRID", 1, 0);
+}
+
+/**
+ * \brief Checks the scheduling and the decisions of a class added next to
+ *        the Classic and L4S ones
+ */
+class DualQCoupledPiSquareMultiClassTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareMultiClassTestCase ();
+  virtual void DoRun (void);
+private:
+  void RunMultiClassTest (std::string storage);
+  static uint32_t Classify (Ptr<QueueDiscItem> item);
+  void CheckDequeue (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t size);
+};
+
+DualQCoupledPiSquareMultiClassTestCase::DualQCoupledPiSquareMultiClassTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check a third DualQ class")
+{
+}
+
+uint32_t
+DualQCoupledPiSquareMultiClassTestCase::Classify (Ptr<QueueDiscItem> item)
+{
+  // The 300 byte packets are the background ones
+  if (item->GetSize () == 300)
+    {
+      return 2;
+    }
+  return item->IsL4S () ? 1 : 0;
+}
+
+void
+DualQCoupledPiSquareMultiClassTestCase::CheckDequeue (Ptr<DualQCoupledPiSquareQueueDisc> queue, uint32_t size)
+{
+  Ptr<QueueDiscItem> item = queue->Dequeue ();
+  NS_TEST_ASSERT_MSG_EQ ((item != nullptr), true, "An item should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (item->GetSize (), size, "Unexpected item dequeued");
+}
+
+void
+DualQCoupledPiSquareMultiClassTestCase::RunMultiClassTest (std::string storage)
+{
+  // No probability, so that only the delay target marks
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"Storage", storage},
+                                                           {"CheckBacklog", "true"},
+                                                           {"A", "0"},
+                                                           {"B", "0"}}, false);
+  NS_TEST_EXPECT_MSG_EQ (queue->AddClass (MilliSeconds (50), 1, MilliSeconds (100)), 2, "The first added class should be 2");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNClasses (), 3, "There should be 3 classes");
+  queue->SetClassifier (MakeCallback (&DualQCoupledPiSquareMultiClassTestCase::Classify));
+  queue->Initialize ();
+
+  // Within the bias, the Classic packets go first
+  Simulator::Schedule (Seconds (0), &DualQCoupledPiSquareMultiClassTestCase::EnqueueItem, this, queue, 300, false);
+  Simulator::Schedule (MilliSeconds (1), &DualQCoupledPiSquareMultiClassTestCase::EnqueueItem, this, queue, 1000, false);
+  Simulator::Schedule (MilliSeconds (10), &DualQCoupledPiSquareMultiClassTestCase::CheckDequeue, this, queue, 1000);
+  Simulator::Schedule (MilliSeconds (10), &DualQCoupledPiSquareMultiClassTestCase::CheckDequeue, this, queue, 300);
+  // Beyond the bias, the background packet goes first, and is marked as
+  // it waited longer than its delay target
+  Simulator::Schedule (MilliSeconds (20), &DualQCoupledPiSquareMultiClassTestCase::EnqueueItem, this, queue, 300, false);
+  Simulator::Schedule (MilliSeconds (130), &DualQCoupledPiSquareMultiClassTestCase::EnqueueItem, this, queue, 1000, false);
+  Simulator::Schedule (MilliSeconds (140), &DualQCoupledPiSquareMultiClassTestCase::CheckDequeue, this, queue, 300);
+  Simulator::Schedule (MilliSeconds (140), &DualQCoupledPiSquareMultiClassTestCase::CheckDequeue, this, queue, 1000);
+  Simulator::Stop (MilliSeconds (150));
+  Simulator::Run ();
+
+  DualQCoupledPiSquareQueueDisc::Stats stats = queue->GetStats ();
+  NS_TEST_EXPECT_MSG_EQ (stats.unforcedOtherMark, 1, "The late background packet should have been marked");
+  NS_TEST_EXPECT_MSG_EQ (stats.unforcedClassicMark, 0, "No Classic packet should have been marked");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassBacklog (2).packets, 0, "The background class should be empty");
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareMultiClassTestCase::DoRun (void)
+{
+  RunMultiClassTest ("STORAGE_INTERNAL_QUEUES");
+  RunMultiClassTest ("STORAGE_RING_BUFFER");
+}
+
+/**
+ * \brief Checks that GetBurstBytes gives the budget with which
+ *        DequeueBurst drains the queue, as an RLC buffer status report
+ */
+class DualQCoupledPiSquareBurstBytesTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareBurstBytesTestCase ();
+  virtual void DoRun (void);
+private:
+  void RunBurstBytesTest (std::string storage);
+};
+
+DualQCoupledPiSquareBurstBytesTestCase::DualQCoupledPiSquareBurstBytesTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check DualQ burst budget accounting")
+{
+}
+
+void
+DualQCoupledPiSquareBurstBytesTestCase::RunBurstBytesTest (std::string storage)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"Storage", storage},
+                                                           {"MaxInteriorSize", "2047"},
+                                                           {"CheckBacklog", "true"}});
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 0, "An empty queue should need no budget");
+
+  // RLC UM framing: 2800 bytes of SDUs, 3 bytes of E and LI fields for
+  // the first two SDUs and the 2-byte fixed header
+  EnqueueItem (queue, 1000, false);
+  EnqueueItem (queue, 300, false);
+  EnqueueItem (queue, 1500, false);
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 2805, "The PDU draining the queue should be 2805 bytes");
+
+  std::vector<Ptr<QueueDiscItem> > out;
+  Ptr<QueueDiscItem> partial = queue->DequeueBurst (2805 - 2, out, 12, 2047);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 3, "The whole backlog should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial == nullptr, true, "No item should have to be segmented");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 0, "The queue should be empty");
+
+  // One byte less leaves one byte of the last SDU behind
+  EnqueueItem (queue, 1000, false);
+  EnqueueItem (queue, 300, false);
+  EnqueueItem (queue, 1500, false);
+  out.clear ();
+  partial = queue->DequeueBurst (2805 - 2 - 1, out, 12, 2047);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 3, "Three items should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (partial, out.back (), "The last item should have to be segmented");
+  partial->GetPacket ()->RemoveAtStart (1499);
+  queue->RequeueHead (partial);
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 3, "The remainder should need a PDU of 3 bytes");
+  out.clear ();
+  queue->DequeueBurst (1, out, 12, 2047);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 1, "The remainder should have been dequeued");
+
+  // An SDU above the LI limit ends the first PDU: 3000 + 2 and 500 + 2
+  // bytes are needed, the report is an upper bound
+  EnqueueItem (queue, 3000, false);
+  EnqueueItem (queue, 500, false);
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 3507, "The large SDU should be accounted as ending a PDU");
+  out.clear ();
+  partial = queue->DequeueBurst (3507 - 2, out, 12, 2047);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 1, "The large SDU should end the batch");
+  NS_TEST_EXPECT_MSG_EQ (partial == nullptr, true, "No item should have to be segmented");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 502, "The last SDU should need a PDU of 502 bytes");
+  out.clear ();
+  queue->DequeueBurst (502 - 2, out, 12, 2047);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 1, "The last SDU should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetBurstBytes (12, 2), 0, "The queue should be empty");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+void
+DualQCoupledPiSquareBurstBytesTestCase::DoRun (void)
+{
+  RunBurstBytesTest ("STORAGE_INTERNAL_QUEUES");
+  RunBurstBytesTest ("STORAGE_RING_BUFFER");
+}
+
+/**
+ * \brief Checks that an item can hold the remainder of its packet through
+ *        a segment offset, without shrinking the packet
+ */
+class DualQCoupledPiSquareSegmentOffsetTestCase : public DualQCoupledPiSquareTestCaseBase
+{
+public:
+  DualQCoupledPiSquareSegmentOffsetTestCase ();
+  virtual void DoRun (void);
+};
+
+DualQCoupledPiSquareSegmentOffsetTestCase::DualQCoupledPiSquareSegmentOffsetTestCase ()
+  : DualQCoupledPiSquareTestCaseBase ("Check DualQ item segment offset")
+{
+}
+
+void
+DualQCoupledPiSquareSegmentOffsetTestCase::DoRun (void)
+{
+  Ptr<DualQCoupledPiSquareQueueDisc> queue = CreateQueue ({{"CheckBacklog", "true"}});
+
+  Address dest;
+  Ptr<DualQueueL4SQueueDiscItem> item = Create<DualQueueL4SQueueDiscItem> (Create<Packet> (1000), dest, 0);
+  item->SetIpv4HeaderOffset (2);
+  queue->Enqueue (item);
+  queue->Enqueue (Create<DualQueueL4SQueueDiscItem> (Create<Packet> (500), dest, 0));
+
+  Ptr<QueueDiscItem> head = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (head, item, "The first item should have been dequeued");
+
+  // Send the first 600 bytes and give back the remainder
+  item->SetSegmentOffset (600);
+  NS_TEST_EXPECT_MSG_EQ (item->GetSize (), 400, "The item should only count the remainder");
+  NS_TEST_EXPECT_MSG_EQ (item->GetPacket ()->GetSize (), 1000, "The packet should be left whole");
+  NS_TEST_EXPECT_MSG_EQ (item->GetIpv4HeaderOffset (), DUALQ_NO_IPV4_HEADER,
+                         "The remainder should carry no IPv4 header");
+  NS_TEST_EXPECT_MSG_EQ (item->Mark (), false, "The remainder should never be marked");
+
+  queue->RequeueHead (item);
+  NS_TEST_EXPECT_MSG_EQ (queue->GetL4SBacklog ().packets, 2, "The remainder should be counted in the backlog");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetL4SBacklog ().bytes, 900, "The remainder should be counted in the backlog");
+
+  std::vector<Ptr<QueueDiscItem> > out;
+  queue->DequeueBurst (10000, out, 12);
+  NS_TEST_EXPECT_MSG_EQ (out.size (), 2, "The remainder and the second item should have been dequeued");
+  NS_TEST_EXPECT_MSG_EQ (out[0], item, "The remainder should be served first");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetL4SBacklog ().bytes, 0, "The queue should be empty");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Header of fixed size holding raw bytes, for the metadata test
+ */
+template <uint32_t N>
+class DualQRawTestHeader : public Header
+{
+public:
+  DualQRawTestHeader ()
+  {
+    memset (m_bytes, 0, N);
+  }
+  DualQRawTestHeader (const uint8_t *bytes)
+  {
+    memcpy (m_bytes, bytes, N);
+  }
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::DualQRawTestHeader" + std::to_string (N))
+      .SetParent<Header> ()
+      .SetGroupName ("TrafficControl")
+      .AddConstructor<DualQRawTestHeader<N> > ()
+    ;
+    return tid;
+  }
+  virtual TypeId GetInstanceTypeId (void) const
+  {
+    return GetTypeId ();
+  }
+  virtual uint32_t GetSerializedSize (void) const
+  {
+    return N;
+  }
+  virtual void Serialize (Buffer::Iterator start) const
+  {
+    start.Write (m_bytes, N);
+  }
+  virtual uint32_t Deserialize (Buffer::Iterator start)
+  {
+    start.Read (m_bytes, N);
+    return N;
+  }
+  virtual void Print (std::ostream &os) const
+  {
+    os << "size=" << N;
+  }
+
+  uint8_t m_bytes[N]; //!< Raw bytes
+};
+
+/**
+ * \brief Checks that marking rewrites the header bytes in place and, if
+ *        the packet metadata is enabled, keeps the headers recorded in it,
+ *        so that the receiver can still remove them
+ */
+class DualQCoupledPiSquareMarkMetadataTestCase : public TestCase
+{
+public:
+  DualQCoupledPiSquareMarkMetadataTestCase ();
+  virtual void DoRun (void);
+};
+
+DualQCoupledPiSquareMarkMetadataTestCase::DualQCoupledPiSquareMarkMetadataTestCase ()
+  : TestCase ("Check ECN marking of DualQ items with packet headers")
+{
+}
+
+void
+DualQCoupledPiSquareMarkMetadataTestCase::DoRun (void)
+{
+  // ECT(1) IPv4 header, with checksums disabled, below a 2-byte header (e.g., PDCP)
+  uint8_t ipBytes[20] = {0x45, 0xb9, 0, 100, 0, 0, 0, 0, 64, 6, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2};
+  uint8_t prefixBytes[2] = {0xa0, 0xa1};
+  Ptr<Packet> p = Create<Packet> (78);
+  p->AddHeader (DualQRawTestHeader<20> (ipBytes));
+  p->AddHeader (DualQRawTestHeader<2> (prefixBytes));
+
+  Address dest;
+  Ptr<DualQueueL4SQueueDiscItem> item = Create<DualQueueL4SQueueDiscItem> (p, dest, 0);
+  item->SetIpv4HeaderOffset (2);
+  NS_TEST_EXPECT_MSG_EQ (item->Mark (), true, "An ECT(1) packet should be marked");
+  NS_TEST_EXPECT_MSG_EQ (p->GetSize (), 100, "Marking should not change the packet size");
+
+  uint8_t bytes[22];
+  p->CopyData (bytes, 22);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[1], 0xa1, "The preceding header bytes should be untouched");
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[3], 0xbb, "The ECN field should be CE and the DSCP untouched");
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) bytes[21], 2, "The rest of the IPv4 header bytes should be untouched");
+
+  // The headers are only recorded if the metadata was already enabled:
+  // enabling it here would leak into the rest of the process
+  PacketMetadata::ItemIterator it = p->BeginItem ();
+  if (it.HasNext ())
+    {
+      PacketMetadata::Item first = it.Next ();
+      NS_TEST_EXPECT_MSG_EQ ((first.type == PacketMetadata::Item::HEADER
+                              && first.tid == DualQRawTestHeader<2>::GetTypeId ()), true,
+                             "The preceding header should still be on top of the metadata");
+      NS_TEST_ASSERT_MSG_EQ (it.HasNext (), true, "The IPv4 header should still be in the metadata");
+      PacketMetadata::Item second = it.Next ();
+      NS_TEST_EXPECT_MSG_EQ ((second.type == PacketMetadata::Item::HEADER
+                              && second.tid == DualQRawTestHeader<20>::GetTypeId ()), true,
+                             "The IPv4 header should still follow the preceding header in the metadata");
+    }
+
+  DualQRawTestHeader<2> prefix;
+  p->RemoveHeader (prefix);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) prefix.m_bytes[1], 0xa1, "The preceding header should be untouched");
+  DualQRawTestHeader<20> ip;
+  p->RemoveHeader (ip);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) ip.m_bytes[1], 0xbb, "The ECN field should be CE and the DSCP untouched");
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) ip.m_bytes[19], 2, "The rest of the IPv4 header should be untouched");
+  NS_TEST_EXPECT_MSG_EQ (p->GetSize (), 78, "The payload should be left");
+}
+
 static class DualQCoupledPiSquareQueueDiscTestSuite : public TestSuite
 {
 public:
@@ -366,5 +1629,19 @@ public:
     : TestSuite ("dual-q-coupled-pi-square-queue-disc", Type::UNIT)
   {
     AddTestCase (new DualQCoupledPiSquareQueueDiscTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareStorageTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareMarkTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareBurstTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareRequeueHeadTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareRfc9332TestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareFixedPointTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareLazyUpdateTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareDepartureRateTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareTargetScaleTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareMarkingPointTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareMultiClassTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareBurstBytesTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareSegmentOffsetTestCase (), Duration::QUICK);
+    AddTestCase (new DualQCoupledPiSquareMarkMetadataTestCase (), Duration::QUICK);
   }
 } g_DualQCoupledPiSquareQueueTestSuite;
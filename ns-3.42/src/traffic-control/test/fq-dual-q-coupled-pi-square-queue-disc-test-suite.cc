@@ -0,0 +1,298 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "ns3/test.h"
+#include "ns3/fq-dual-q-coupled-pi-square-queue-disc.h"
+#include "ns3/uinteger.h"
+#include "ns3/string.h"
+#include "ns3/boolean.h"
+#include "ns3/simulator.h"
+
+using namespace ns3;
+
+/**
+ * \brief Queue disc item of a given flow and class
+ */
+class FqDualQTestItem : public QueueDiscItem
+{
+public:
+  FqDualQTestItem (Ptr<Packet> p, const Address & addr, uint32_t flow, bool l4s);
+  virtual ~FqDualQTestItem ();
+  virtual void AddHeader (void);
+  virtual bool Mark (void);
+  virtual bool IsL4S (void);
+  virtual uint32_t Hash (uint32_t perturbation) const;
+  /**
+   * \return the flow of the item
+   */
+  uint32_t GetFlow (void) const;
+
+private:
+  FqDualQTestItem ();
+  FqDualQTestItem (const FqDualQTestItem &);
+  FqDualQTestItem &operator = (const FqDualQTestItem &);
+  uint32_t m_flow; //!< Flow of the item, used as its hash
+  bool m_l4s;      //!< Whether the item is L4S
+};
+
+FqDualQTestItem::FqDualQTestItem (Ptr<Packet> p, const Address & addr, uint32_t flow, bool l4s)
+  : QueueDiscItem (p, addr, 0),
+    m_flow (flow),
+    m_l4s (l4s)
+{
+}
+
+FqDualQTestItem::~FqDualQTestItem ()
+{
+}
+
+void
+FqDualQTestItem::AddHeader (void)
+{
+}
+
+bool
+FqDualQTestItem::Mark (void)
+{
+  return true;
+}
+
+bool
+FqDualQTestItem::IsL4S (void)
+{
+  return m_l4s;
+}
+
+uint32_t
+FqDualQTestItem::Hash (uint32_t /* perturbation */) const
+{
+  return m_flow;
+}
+
+uint32_t
+FqDualQTestItem::GetFlow (void) const
+{
+  return m_flow;
+}
+
+/**
+ * \brief Checks the deficit round robin between the flows of a queue
+ */
+class FqDualQCoupledPiSquareDrrTestCase : public TestCase
+{
+public:
+  FqDualQCoupledPiSquareDrrTestCase ();
+  virtual void DoRun (void);
+};
+
+FqDualQCoupledPiSquareDrrTestCase::FqDualQCoupledPiSquareDrrTestCase ()
+  : TestCase ("Check the deficit round robin between the flows of the FQ DualQ")
+{
+}
+
+void
+FqDualQCoupledPiSquareDrrTestCase::DoRun (void)
+{
+  Ptr<FqDualQCoupledPiSquareQueueDisc> queue = CreateObject<FqDualQCoupledPiSquareQueueDisc> ();
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("QueueLimit", UintegerValue (1000)), true,
+                         "Verify that we can actually set the attribute QueueLimit");
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("Quantum", UintegerValue (1000)), true,
+                         "Verify that we can actually set the attribute Quantum");
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("CheckBacklog", BooleanValue (true)), true,
+                         "Verify that we can actually set the attribute CheckBacklog");
+  queue->Initialize ();
+
+  // A heavy flow arrives first and a light flow behind it
+  Address dest;
+  for (uint32_t i = 0; i < 20; i++)
+    {
+      queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (1000), dest, 1, false));
+    }
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (500), dest, 2, false));
+    }
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 2, "There should be two Classic flows");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (1), 0, "There should be no L4S flow");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassicBacklog ().packets, 25, "There should be 25 Classic packets");
+
+  // One 1000 byte packet of flow 1, then two 500 byte packets of flow 2, and so on
+  uint32_t expected[9] = {1, 2, 2, 1, 2, 2, 1, 2, 1};
+  for (uint32_t i = 0; i < 9; i++)
+    {
+      Ptr<QueueDiscItem> item = queue->Dequeue ();
+      NS_TEST_ASSERT_MSG_NE (item, nullptr, "The queue should not be empty");
+      NS_TEST_EXPECT_MSG_EQ (DynamicCast<FqDualQTestItem> (item)->GetFlow (), expected[i],
+                             "Unexpected flow for dequeue " << i);
+    }
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 1, "Flow 2 should have left the round");
+
+  while (queue->Dequeue ())
+    {
+    }
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 0, "There should be no flow left");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassicBacklog ().bytes, 0, "There should be no byte left");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Checks the open addressing of the flow table and the coupling
+ *        between the L4S and Classic flows
+ */
+class FqDualQCoupledPiSquareFlowTableTestCase : public TestCase
+{
+public:
+  FqDualQCoupledPiSquareFlowTableTestCase ();
+  virtual void DoRun (void);
+};
+
+FqDualQCoupledPiSquareFlowTableTestCase::FqDualQCoupledPiSquareFlowTableTestCase ()
+  : TestCase ("Check the flow table of the FQ DualQ")
+{
+}
+
+void
+FqDualQCoupledPiSquareFlowTableTestCase::DoRun (void)
+{
+  Ptr<FqDualQCoupledPiSquareQueueDisc> queue = CreateObject<FqDualQCoupledPiSquareQueueDisc> ();
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("QueueLimit", UintegerValue (1000)), true,
+                         "Verify that we can actually set the attribute QueueLimit");
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("Flows", UintegerValue (3)), true,
+                         "Verify that we can actually set the attribute Flows");
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("MaxProbes", UintegerValue (2)), true,
+                         "Verify that we can actually set the attribute MaxProbes");
+  NS_TEST_EXPECT_MSG_EQ (queue->SetAttributeFailSafe ("CheckBacklog", BooleanValue (true)), true,
+                         "Verify that we can actually set the attribute CheckBacklog");
+  queue->Initialize ();
+
+  // Four buckets: flows 0, 4 and 8 all start probing at bucket 0
+  Address dest;
+  queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (100), dest, 0, false));
+  queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (100), dest, 4, false));
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 2, "Flow 4 should take the next bucket");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNCollisions (), 0, "There should be no collision yet");
+  queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (100), dest, 8, false));
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 2, "Flow 8 should share a bucket");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNCollisions (), 1, "Flow 8 should collide");
+
+  // The L4S queue has its own table
+  queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (100), dest, 0, true));
+  queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (100), dest, 1, true));
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (1), 2, "There should be two L4S flows");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNCollisions (), 1, "The L4S flows should not collide");
+
+  Ptr<QueueDiscItem> item = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (item->IsL4S (), true, "The L4S queue should be served first");
+  item = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (item->IsL4S (), true, "The L4S queue should be served first");
+
+  // Flows 0 and 8 share bucket 0, which is served first
+  item = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (DynamicCast<FqDualQTestItem> (item)->GetFlow (), 0, "Flow 0 should be served first");
+  item = queue->Dequeue ();
+  NS_TEST_EXPECT_MSG_EQ (DynamicCast<FqDualQTestItem> (item)->GetFlow (), 8, "Flow 8 should follow in the same bucket");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 1, "Bucket 0 should be free");
+
+  // Flow 4 is still found past the bucket freed in front of it
+  queue->Enqueue (Create<FqDualQTestItem> (Create<Packet> (100), dest, 4, false));
+  NS_TEST_EXPECT_MSG_EQ (queue->GetNActiveFlows (0), 1, "Flow 4 should stay in its bucket");
+  NS_TEST_EXPECT_MSG_EQ (queue->GetClassicBacklog ().packets, 2, "There should be 2 Classic packets");
+
+  queue->Dispose ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \brief Checks the 5-tuple hash of the DualQ items
+ */
+class FqDualQCoupledPiSquareHashTestCase : public TestCase
+{
+public:
+  FqDualQCoupledPiSquareHashTestCase ();
+  virtual void DoRun (void);
+private:
+  /**
+   * \brief Create a TCP/IPv4 packet
+   * \param prefix the number of bytes preceding the IPv4 header
+   * \param srcPort the source port
+   * \param payload the value of the payload bytes
+   * \return the packet
+   */
+  Ptr<Packet> CreateTcpPacket (uint32_t prefix, uint16_t srcPort, uint8_t payload);
+};
+
+FqDualQCoupledPiSquareHashTestCase::FqDualQCoupledPiSquareHashTestCase ()
+  : TestCase ("Check the flow hash of the DualQ items")
+{
+}
+
+Ptr<Packet>
+FqDualQCoupledPiSquareHashTestCase::CreateTcpPacket (uint32_t prefix, uint16_t srcPort, uint8_t payload)
+{
+  uint8_t bytes[100] = {0};
+  uint8_t *ip = bytes + prefix;
+  ip[0] = 0x45;
+  ip[1] = 0x01;
+  ip[3] = 100 - prefix;
+  ip[8] = 64;
+  ip[9] = 6;
+  ip[12] = 10;
+  ip[15] = 1;
+  ip[16] = 10;
+  ip[19] = 2;
+  ip[20] = srcPort >> 8;
+  ip[21] = srcPort & 0xff;
+  ip[23] = 80;
+  for (uint32_t i = prefix + 24; i < 100; i++)
+    {
+      bytes[i] = payload;
+    }
+  return Create<Packet> (bytes, 100);
+}
+
+void
+FqDualQCoupledPiSquareHashTestCase::DoRun (void)
+{
+  Address dest;
+  Ptr<DualQueueL4SQueueDiscItem> a = Create<DualQueueL4SQueueDiscItem> (CreateTcpPacket (0, 1000, 1), dest, 0);
+  Ptr<DualQueueL4SQueueDiscItem> b = Create<DualQueueL4SQueueDiscItem> (CreateTcpPacket (0, 1000, 2), dest, 0);
+  Ptr<DualQueueL4SQueueDiscItem> c = Create<DualQueueL4SQueueDiscItem> (CreateTcpPacket (0, 1001, 1), dest, 0);
+  NS_TEST_EXPECT_MSG_EQ (a->Hash (0), b->Hash (0), "Packets of the same flow should have the same hash");
+  NS_TEST_EXPECT_MSG_NE (a->Hash (0), c->Hash (0), "Packets of different flows should have different hashes");
+  NS_TEST_EXPECT_MSG_NE (a->Hash (0), a->Hash (1), "The perturbation should change the hash");
+
+  // The same flow below a 2-byte header (e.g., PDCP)
+  Ptr<DualQueueClassicQueueDiscItem> d = Create<DualQueueClassicQueueDiscItem> (CreateTcpPacket (2, 1000, 3), dest, 0);
+  d->SetIpv4HeaderOffset (2);
+  NS_TEST_EXPECT_MSG_EQ (d->Hash (0), a->Hash (0), "The hash should skip the bytes preceding the IPv4 header");
+  d->SetIpv4HeaderOffset (DUALQ_NO_IPV4_HEADER);
+  NS_TEST_EXPECT_MSG_EQ (d->Hash (0), 0, "A packet without IPv4 header should hash to 0");
+}
+
+static class FqDualQCoupledPiSquareQueueDiscTestSuite : public TestSuite
+{
+public:
+  FqDualQCoupledPiSquareQueueDiscTestSuite ()
+    : TestSuite ("fq-dual-q-coupled-pi-square-queue-disc", Type::UNIT)
+  {
+    AddTestCase (new FqDualQCoupledPiSquareDrrTestCase (), Duration::QUICK);
+    AddTestCase (new FqDualQCoupledPiSquareFlowTableTestCase (), Duration::QUICK);
+    AddTestCase (new FqDualQCoupledPiSquareHashTestCase (), Duration::QUICK);
+  }
+} g_FqDualQCoupledPiSquareQueueTestSuite;